@@ -8,9 +8,70 @@
 #include <time.h>
 
 #include "game_aux.h"
+#include "game_private.h"
 #include "game_struct.h"
 #include "queue.h"
 
+/* mémoire de l'historique, allouée avec l'allocateur du jeu */
+static void *_history_alloc(void *context, size_t size) {
+  return _game_malloc(context, size, sizeof(void *));
+}
+
+static void _history_free(void *context, void *ptr, size_t size) {
+  _game_free(context, ptr, size);
+}
+
+/**
+ * Fonction : _game_alloc
+
+ * Alloue un jeu en un seul bloc aligné sur une ligne de cache : l'en-tête,
+ * les deux files de l'historique et les cases (voir game_struct.h). Le bloc
+ * et les éléments de l'historique viennent de l'allocateur courant.
+
+ * Paramètres :
+ *  height : Le nombre de lignes du jeu.
+ *  width : Le nombre de colonnes du jeu.
+
+ * Retour : Un jeu dont les cases ne sont pas initialisées et sans table des
+ * cases adjacentes, ou NULL en cas d'erreur.
+ */
+
+game _game_alloc(uint height, uint width) {
+  size_t nb_squares = (size_t)height * width;
+  if (nb_squares > (SIZE_MAX - sizeof(struct game_s)) / sizeof(Acase)) {
+    return NULL;
+  }
+
+  game_allocator allocator = game_get_allocator();
+  game g = _game_malloc(&allocator,
+                        sizeof(struct game_s) + nb_squares * sizeof(Acase),
+                        GAME_ALIGNMENT);
+  if (g == NULL) {
+    return NULL;
+  }
+
+  g->allocator = allocator;
+  g->height = height;
+  g->width = width;
+  g->isWrapping = false;
+  g->nbrs = NULL;
+  g->hash_valid = false;
+  g->grid = NULL;
+  g->capacity = nb_squares;
+  g->extra_capacity = 0;
+  g->cases = g->inline_cases;
+  // l'historique est un tableau circulaire : jouer n'alloue plus rien une
+  // fois qu'il a atteint sa taille maximale
+  for (int k = 0; k < 2; k++) {
+    queue_init_with_allocator(&g->history[k], _history_alloc, _history_free,
+                              &g->allocator);
+    queue_set_contiguous(&g->history[k]);
+  }
+  g->do_queue = &g->history[0];
+  g->undo_queue = &g->history[1];
+  return g;
+}
+
 /**
  * Fonction : game_new_empty
 
@@ -21,30 +82,17 @@
  */
 
 game game_new_empty(void) {
-  game new_game_empty = malloc(sizeof(struct game_s));
+  game new_game_empty = _game_alloc(DEFAULT_SIZE, DEFAULT_SIZE);
   if (new_game_empty == NULL) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
 
-  new_game_empty->do_queue = queue_new();
-  if (new_game_empty->do_queue == NULL) {
-    fprintf(stderr, "Error: NULL pointer detected.\n");
-    exit(EXIT_FAILURE);
-  }
-
-  new_game_empty->undo_queue = queue_new();
-  if (new_game_empty->undo_queue == NULL) {
-    fprintf(stderr, "Error: NULL pointer detected.\n");
-    exit(EXIT_FAILURE);
-  }
-
-  new_game_empty->height = DEFAULT_SIZE;
-  new_game_empty->width = DEFAULT_SIZE;
   new_game_empty->isWrapping = true;
 
-  new_game_empty->cases = malloc((DEFAULT_SIZE * DEFAULT_SIZE) * sizeof(Acase));
-  if (new_game_empty->cases == NULL) {
+  new_game_empty->nbrs = _neighbours_new(DEFAULT_SIZE, DEFAULT_SIZE, true,
+                                         &new_game_empty->allocator);
+  if (new_game_empty->nbrs == NULL) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
@@ -123,39 +171,23 @@ game game_copy(cgame g) {
     exit(EXIT_FAILURE);
   }
 
-  game copy = malloc(sizeof(struct game_s));
+  game copy = _game_alloc(g->height, g->width);
   if (copy == NULL) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
-  copy->height = g->height;
-  copy->width = g->width;
-
-  copy->do_queue = queue_new();
-  if (copy->do_queue == NULL) {
+  copy->isWrapping = g->isWrapping;
+  copy->hash = g->hash;
+  copy->shape_hash = g->shape_hash;
+  copy->hash_valid = g->hash_valid;
+  // la copie partage la table des cases adjacentes de l'original
+  if (!_game_share_neighbours(copy, g)) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
 
-  copy->undo_queue = queue_new();
-  if (copy->undo_queue == NULL) {
-    fprintf(stderr, "Error: NULL pointer detected.\n");
-    exit(EXIT_FAILURE);
-  }
-
-  copy->cases = malloc(sizeof(Acase) * (copy->height * copy->width));
-  if (copy->cases == NULL) {
-    fprintf(stderr, "Error: NULL pointer detected.\n");
-    exit(EXIT_FAILURE);
-  }
-
-  for (int i = 0; i < g->height; i++) {
-    for (int j = 0; j < g->width; j++) {
-      copy->cases[i * copy->width + j].shape = g->cases[i * g->width + j].shape;
-      copy->cases[i * copy->width + j].orientation =
-          g->cases[i * g->width + j].orientation;
-    }
-  }
+  memcpy(copy->cases, g->cases, sizeof(Acase) * (size_t)g->height * g->width);
+  _game_share_grid(copy, g);
 
   return copy;
 }
@@ -186,27 +218,14 @@ bool game_equal(cgame g1, cgame g2, bool ignore_orientation) {
     return false;
   }
 
-  if (ignore_orientation) {
-    for (int i = 0; i < g1->height; i++) {
-      for (int j = 0; j < g1->width; j++) {
-        if (g1->cases[i * g1->width + j].shape !=
-            g2->cases[i * g2->width + j].shape) {
-          fprintf(stderr, "there is a difference in i:%d, j;%d", i, j);
-          return false;
-        }
-      }
-    }
-  } else {
-    for (int i = 0; i < g1->height; i++) {
-      for (int j = 0; j < g1->width; j++) {
-        if (g1->cases[i * g1->width + j].shape !=
-                g2->cases[i * g2->width + j].shape ||
-            g1->cases[i * g1->width + j].orientation !=
-                g2->cases[i * g2->width + j].orientation) {
-          fprintf(stderr, "there is a difference in i:%d, j;%d", i, j);
-          return false;
-        }
-      }
+  size_t nb_squares = (size_t)g1->height * g1->width;
+  for (size_t k = 0; k < nb_squares; k++) {
+    if (g1->cases[k].shape != g2->cases[k].shape ||
+        (!ignore_orientation &&
+         g1->cases[k].orientation != g2->cases[k].orientation)) {
+      fprintf(stderr, "there is a difference in i:%zu, j;%zu", k / g1->width,
+              k % g1->width);
+      return false;
     }
   }
   return true;
@@ -222,20 +241,15 @@ bool game_equal(cgame g1, cgame g2, bool ignore_orientation) {
 
 void game_delete(game g) {
   if (g != NULL) {
-    if (g->cases != NULL) {
-      free(g->cases);
-      g->cases = NULL;
-    }
-    if (g->do_queue != NULL) {
-      queue_free(g->do_queue);
-      g->do_queue = NULL;
-    }
-    if (g->undo_queue != NULL) {
-      queue_free(g->undo_queue);
-      g->undo_queue = NULL;
-    }
-    free(g);
-    g = NULL;
+    // les cases et l'historique sont dans le même bloc que le jeu
+    _game_free(&g->allocator, g->cases == g->inline_cases ? NULL : g->cases,
+               g->extra_capacity * sizeof(Acase));
+    queue_finalize(g->do_queue);
+    queue_finalize(g->undo_queue);
+    _neighbours_release(g->nbrs);
+    _grid_release(g->grid);
+    game_allocator allocator = g->allocator;
+    _game_free(&allocator, g, sizeof(struct game_s) + g->capacity * sizeof(Acase));
   }
 }
 
@@ -256,13 +270,13 @@ void game_set_piece_shape(game g, uint i, uint j, shape s) {
     exit(EXIT_FAILURE);
   }
 
-  if (i > g->height || j > g->width) {
+  if (i >= g->height || j >= g->width) {
     fprintf(stderr, "position error");
     exit(EXIT_FAILURE);
   }
 
   if (s >= EMPTY && s < NB_SHAPES) {
-    g->cases[i * g->width + j].shape = s;
+    _set_shape(g, i, j, s);
   } else {
     fprintf(stderr, "s is not a shape");
     exit(EXIT_FAILURE);
@@ -286,13 +300,13 @@ void game_set_piece_orientation(game g, uint i, uint j, direction o) {
     exit(EXIT_FAILURE);
   }
 
-  if (i > g->height || j > g->width) {
+  if (i >= g->height || j >= g->width) {
     fprintf(stderr, "position error");
     exit(EXIT_FAILURE);
   }
 
   if (o == NORTH || o == EAST || o == WEST || o == SOUTH) {
-    g->cases[i * g->width + j].orientation = o;
+    _set_orientation(g, i, j, o);
   } else {
     fprintf(stderr, "s is not an orientation");
     exit(EXIT_FAILURE);
@@ -356,34 +370,21 @@ void game_play_move(game g, uint i, uint j, int nb_quarter_turns) {
     exit(EXIT_FAILURE);
   }
 
-  queue_push_head(g->do_queue, (void *)(intptr_t)i);
-  queue_push_head(g->do_queue, (void *)(intptr_t)j);
-  queue_push_head(g->do_queue,
-                  (void *)(intptr_t)game_get_piece_orientation(g, i, j));
-
-  int height = g->height;
-  int width = g->width;
-
-  if (i >= height || j >= width) {
+  if (i >= g->height || j >= g->width) {
     fprintf(stderr, "Error\n");
     exit(EXIT_FAILURE);
   }
-  direction current_orientation = game_get_piece_orientation(g, i, j);
+  direction current_orientation = _get_orientation(g, i, j);
 
-  int new_orientation = (current_orientation + nb_quarter_turns) % 4;
-  if (new_orientation < 0) {
-    new_orientation += 4;
-  }
+  queue_push_head(g->do_queue, (void *)(intptr_t)i);
+  queue_push_head(g->do_queue, (void *)(intptr_t)j);
+  queue_push_head(g->do_queue, (void *)(intptr_t)current_orientation);
 
-  if (new_orientation == 0) {
-    game_set_piece_orientation(g, i, j, NORTH);
-  } else if (new_orientation == 1) {
-    game_set_piece_orientation(g, i, j, EAST);
-  } else if (new_orientation == 2) {
-    game_set_piece_orientation(g, i, j, SOUTH);
-  } else if (new_orientation == 3) {
-    game_set_piece_orientation(g, i, j, WEST);
+  int new_orientation = (current_orientation + nb_quarter_turns) % NB_DIRS;
+  if (new_orientation < 0) {
+    new_orientation += NB_DIRS;
   }
+  _set_orientation(g, i, j, new_orientation);
 
   if (!queue_is_empty(g->undo_queue)) {
     queue_clear(g->undo_queue);
@@ -405,7 +406,7 @@ bool game_won(cgame g) {
   if (g == NULL) {
     return false;
   }
-  if (game_is_well_paired(g) && game_is_connected(g)) {
+  if (game_is_well_paired(g) && _game_is_connected(g)) {
     return true;
   }
   return false;
@@ -426,11 +427,11 @@ void game_reset_orientation(game g) {
     exit(EXIT_FAILURE);
   }
 
-  for (int i = 0; i < g->height; i++) {
-    for (int j = 0; j < g->width; j++) {
-      g->cases[i * g->width + j].orientation = 0;
-    }
+  size_t nb_squares = (size_t)g->height * g->width;
+  for (size_t k = 0; k < nb_squares; k++) {
+    g->cases[k].orientation = NORTH;
   }
+  _game_invalidate_caches(g);
   if (!queue_is_empty(g->undo_queue)) {
     queue_clear(g->undo_queue);
   }
@@ -453,11 +454,11 @@ void game_shuffle_orientation(game g) {
     exit(EXIT_FAILURE);
   }
 
-  for (int i = 0; i < g->height; i++) {
-    for (int j = 0; j < g->width; j++) {
-      g->cases[i * g->width + j].orientation = rand() % 4;
-    }
+  size_t nb_squares = (size_t)g->height * g->width;
+  for (size_t k = 0; k < nb_squares; k++) {
+    g->cases[k].orientation = rand() % NB_DIRS;
   }
+  _game_invalidate_caches(g);
   if (!queue_is_empty(g->undo_queue)) {
     queue_clear(g->undo_queue);
   }
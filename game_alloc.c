@@ -0,0 +1,417 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "game_alloc.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "game_struct.h"
+
+/* ************************************************************************** */
+/*                                 ALLOCATEURS                                */
+/* ************************************************************************** */
+
+static void *_std_alloc(void *context, size_t size, size_t alignment) {
+  (void)context;
+  if (alignment <= sizeof(void *)) return malloc(size);
+  void *p;
+  return posix_memalign(&p, alignment, size) == 0 ? p : NULL;
+}
+
+static void _std_free(void *context, void *ptr, size_t size) {
+  (void)context;
+  (void)size;
+  free(ptr);
+}
+
+static const game_allocator STD_ALLOCATOR = {_std_alloc, _std_free, NULL};
+
+static game_allocator global_allocator = {_std_alloc, _std_free, NULL};
+static __thread game_allocator thread_allocator;
+static __thread bool has_thread_allocator = false;
+
+static game_alloc_stats stats;
+
+game_allocator _game_std_allocator(void) { return STD_ALLOCATOR; }
+
+/**
+ * Fonction : game_set_allocator
+
+ * Change l'allocateur global (NULL : celui de la bibliothèque standard).
+ */
+
+void game_set_allocator(const game_allocator *allocator) {
+  global_allocator = allocator ? *allocator : STD_ALLOCATOR;
+}
+
+/**
+ * Fonction : game_set_thread_allocator
+
+ * Change l'allocateur du thread appelant (NULL : l'allocateur global).
+ */
+
+void game_set_thread_allocator(const game_allocator *allocator) {
+  has_thread_allocator = allocator != NULL;
+  if (allocator) thread_allocator = *allocator;
+}
+
+/**
+ * Fonction : game_get_allocator
+
+ * Retour : L'allocateur du thread appelant s'il y en a un, sinon l'allocateur
+ * global.
+ */
+
+game_allocator game_get_allocator(void) {
+  return has_thread_allocator ? thread_allocator : global_allocator;
+}
+
+/* ************************************************************************** */
+
+bool _allocator_equal(const game_allocator *a, const game_allocator *b) {
+  return a->alloc == b->alloc && a->free == b->free &&
+         a->context == b->context;
+}
+
+void *_game_malloc(const game_allocator *a, size_t size, size_t alignment) {
+  void *p = a->alloc(a->context, size, alignment);
+  if (p != NULL) {
+    __atomic_add_fetch(&stats.nb_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.bytes_allocated, size, __ATOMIC_RELAXED);
+  }
+  return p;
+}
+
+void _game_free(const game_allocator *a, void *ptr, size_t size) {
+  if (ptr == NULL) return;
+  __atomic_add_fetch(&stats.nb_frees, 1, __ATOMIC_RELAXED);
+  a->free(a->context, ptr, size);
+}
+
+/* ************************************************************************** */
+
+void game_get_alloc_stats(game_alloc_stats *s) {
+  assert(s);
+  s->nb_allocs = __atomic_load_n(&stats.nb_allocs, __ATOMIC_RELAXED);
+  s->nb_frees = __atomic_load_n(&stats.nb_frees, __ATOMIC_RELAXED);
+  s->bytes_allocated =
+      __atomic_load_n(&stats.bytes_allocated, __ATOMIC_RELAXED);
+}
+
+void game_reset_alloc_stats(void) {
+  __atomic_store_n(&stats.nb_allocs, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats.nb_frees, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats.bytes_allocated, 0, __ATOMIC_RELAXED);
+}
+
+/* ************************************************************************** */
+/*                                    ARENE                                   */
+/* ************************************************************************** */
+
+/* Les blocs sont découpés dans une liste de morceaux ; reset revient au premier
+ * morceau sans rien libérer. */
+struct arena_chunk_s {
+  struct arena_chunk_s *next;
+  size_t size;
+  unsigned char *data;
+};
+
+struct game_arena_s {
+  size_t chunk_size;
+  struct arena_chunk_s *first;
+  struct arena_chunk_s *current;
+  size_t offset;  // première position libre dans current
+};
+
+static struct arena_chunk_s *_chunk_new(size_t size) {
+  struct arena_chunk_s *c =
+      malloc(sizeof(struct arena_chunk_s) + GAME_ALIGNMENT + size);
+  if (c == NULL) return NULL;
+  c->next = NULL;
+  c->size = size;
+  uintptr_t start = (uintptr_t)(c + 1);
+  c->data = (unsigned char *)((start + GAME_ALIGNMENT - 1) &
+                              ~(uintptr_t)(GAME_ALIGNMENT - 1));
+  return c;
+}
+
+/* position alignée d'un bloc de size octets dans c, ou SIZE_MAX */
+static size_t _chunk_fit(struct arena_chunk_s *c, size_t offset, size_t size,
+                         size_t alignment) {
+  size_t start = (offset + alignment - 1) & ~(alignment - 1);
+  if (start > c->size || size > c->size - start) return SIZE_MAX;
+  return start;
+}
+
+static void *_arena_alloc(void *context, size_t size, size_t alignment) {
+  game_arena *arena = context;
+  // l'alignement des morceaux est garanti jusqu'à GAME_ALIGNMENT
+  if (alignment > GAME_ALIGNMENT) return NULL;
+  size_t start = _chunk_fit(arena->current, arena->offset, size, alignment);
+  while (start == SIZE_MAX && arena->current->next) {
+    arena->current = arena->current->next;
+    start = _chunk_fit(arena->current, 0, size, alignment);
+  }
+  if (start == SIZE_MAX) {
+    size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+    struct arena_chunk_s *c = _chunk_new(chunk_size);
+    if (c == NULL) return NULL;
+    arena->current->next = c;
+    arena->current = c;
+    start = 0;
+  }
+  arena->offset = start + size;
+  return arena->current->data + start;
+}
+
+static void _arena_free(void *context, void *ptr, size_t size) {
+  // rien à faire : la mémoire est rendue par game_arena_reset
+  (void)context;
+  (void)ptr;
+  (void)size;
+}
+
+/**
+ * Fonction : game_arena_new
+
+ * Crée une arène qui découpe ses blocs dans des morceaux de chunk_size octets.
+
+ * Retour : L'arène, ou NULL en cas d'erreur.
+ */
+
+game_arena *game_arena_new(size_t chunk_size) {
+  if (chunk_size == 0 || chunk_size > SIZE_MAX / 2) return NULL;
+  game_arena *arena = malloc(sizeof(game_arena));
+  if (arena == NULL) return NULL;
+  arena->chunk_size = chunk_size;
+  arena->first = arena->current = _chunk_new(chunk_size);
+  arena->offset = 0;
+  if (arena->first == NULL) {
+    free(arena);
+    return NULL;
+  }
+  return arena;
+}
+
+game_allocator game_arena_allocator(game_arena *arena) {
+  assert(arena);
+  game_allocator a = {_arena_alloc, _arena_free, arena};
+  return a;
+}
+
+/**
+ * Fonction : game_arena_reset
+
+ * Libère d'un coup tous les blocs de l'arène, en gardant ses morceaux.
+ */
+
+void game_arena_reset(game_arena *arena) {
+  assert(arena);
+  arena->current = arena->first;
+  arena->offset = 0;
+}
+
+void game_arena_delete(game_arena *arena) {
+  if (arena == NULL) return;
+  struct arena_chunk_s *c = arena->first;
+  while (c) {
+    struct arena_chunk_s *next = c->next;
+    free(c);
+    c = next;
+  }
+  free(arena);
+}
+
+/* ************************************************************************** */
+/*                                   POOL                                     */
+/* ************************************************************************** */
+
+/* Les objets sont découpés dans une liste de dalles ; un objet libéré est mis
+ * dans une liste libre, et reset revient à la première dalle. Les objets trop
+ * grands sont demandés au parent, précédés d'un en-tête qui les chaîne pour
+ * que reset et delete les libèrent. */
+struct slab_s {
+  struct slab_s *next;
+};
+
+struct large_s {
+  struct large_s *prev;
+  struct large_s *next;
+  size_t offset;  // distance entre le bloc du parent et l'objet
+  size_t size;    // taille du bloc du parent
+};
+
+struct game_pool_s {
+  size_t object_size;
+  size_t stride;      // taille d'un emplacement dans une dalle
+  size_t alignment;   // alignement garanti des emplacements
+  size_t nb_per_slab;
+  game_allocator parent;
+  struct slab_s *first;
+  struct slab_s *current;
+  size_t used;        // emplacements déjà découpés dans current
+  void *free_list;
+  struct large_s *large;  // objets transmis au parent
+};
+
+/* les emplacements commencent après l'en-tête de la dalle */
+static unsigned char *_slab_data(struct slab_s *s) {
+  return (unsigned char *)s + GAME_ALIGNMENT;
+}
+
+/* l'en-tête d'un grand objet est juste avant lui */
+static struct large_s *_large_header(void *ptr) {
+  return (struct large_s *)((unsigned char *)ptr - sizeof(struct large_s));
+}
+
+static void *_large_alloc(game_pool *pool, size_t size, size_t alignment) {
+  if (alignment < sizeof(void *)) alignment = sizeof(void *);
+  size_t offset = (sizeof(struct large_s) + alignment - 1) & ~(alignment - 1);
+  if (size > SIZE_MAX - offset) return NULL;
+  unsigned char *base =
+      pool->parent.alloc(pool->parent.context, offset + size, alignment);
+  if (base == NULL) return NULL;
+  struct large_s *h = _large_header(base + offset);
+  h->offset = offset;
+  h->size = offset + size;
+  h->prev = NULL;
+  h->next = pool->large;
+  if (pool->large) pool->large->prev = h;
+  pool->large = h;
+  return base + offset;
+}
+
+static void _large_release(game_pool *pool, struct large_s *h) {
+  unsigned char *base = (unsigned char *)(h + 1) - h->offset;
+  pool->parent.free(pool->parent.context, base, h->size);
+}
+
+static void _large_free(game_pool *pool, void *ptr) {
+  struct large_s *h = _large_header(ptr);
+  if (h->prev)
+    h->prev->next = h->next;
+  else
+    pool->large = h->next;
+  if (h->next) h->next->prev = h->prev;
+  _large_release(pool, h);
+}
+
+/* libère tous les grands objets encore alloués */
+static void _large_free_all(game_pool *pool) {
+  struct large_s *h = pool->large;
+  while (h) {
+    struct large_s *next = h->next;
+    _large_release(pool, h);
+    h = next;
+  }
+  pool->large = NULL;
+}
+
+static void *_pool_alloc(void *context, size_t size, size_t alignment) {
+  game_pool *pool = context;
+  if (size > pool->object_size) return _large_alloc(pool, size, alignment);
+  if (alignment > pool->alignment) return NULL;
+
+  if (pool->free_list) {
+    void *p = pool->free_list;
+    pool->free_list = *(void **)p;
+    return p;
+  }
+  if (pool->current == NULL || pool->used == pool->nb_per_slab) {
+    struct slab_s *s = pool->current ? pool->current->next : pool->first;
+    if (s == NULL) {
+      s = pool->parent.alloc(pool->parent.context,
+                             GAME_ALIGNMENT + pool->stride * pool->nb_per_slab,
+                             GAME_ALIGNMENT);
+      if (s == NULL) return NULL;
+      s->next = NULL;
+      if (pool->current)
+        pool->current->next = s;
+      else
+        pool->first = s;
+    }
+    pool->current = s;
+    pool->used = 0;
+  }
+  return _slab_data(pool->current) + pool->stride * pool->used++;
+}
+
+static void _pool_free(void *context, void *ptr, size_t size) {
+  game_pool *pool = context;
+  if (size > pool->object_size) {
+    _large_free(pool, ptr);
+    return;
+  }
+  *(void **)ptr = pool->free_list;
+  pool->free_list = ptr;
+}
+
+/**
+ * Fonction : game_pool_new
+
+ * Crée un pool d'objets d'au plus object_size octets, découpés dans des dalles
+ * de nb_per_slab objets demandées à parent (NULL : la bibliothèque standard).
+
+ * Retour : Le pool, ou NULL en cas d'erreur.
+ */
+
+game_pool *game_pool_new(size_t object_size, size_t nb_per_slab,
+                         const game_allocator *parent) {
+  if (object_size == 0 || nb_per_slab == 0 || object_size > SIZE_MAX / 4)
+    return NULL;
+  // un emplacement doit pouvoir contenir le chaînage de la liste libre
+  if (object_size < sizeof(void *)) object_size = sizeof(void *);
+  // les objets d'au moins une ligne de cache (les jeux) sont alignés dessus
+  size_t alignment = object_size >= GAME_ALIGNMENT ? GAME_ALIGNMENT : 16;
+  size_t stride = (object_size + alignment - 1) & ~(alignment - 1);
+  if (nb_per_slab > (SIZE_MAX - GAME_ALIGNMENT) / stride) return NULL;
+
+  game_pool *pool = malloc(sizeof(game_pool));
+  if (pool == NULL) return NULL;
+  pool->object_size = object_size;
+  pool->stride = stride;
+  pool->alignment = alignment;
+  pool->nb_per_slab = nb_per_slab;
+  pool->parent = parent ? *parent : STD_ALLOCATOR;
+  pool->first = pool->current = NULL;
+  pool->used = 0;
+  pool->free_list = NULL;
+  pool->large = NULL;
+  return pool;
+}
+
+game_allocator game_pool_allocator(game_pool *pool) {
+  assert(pool);
+  game_allocator a = {_pool_alloc, _pool_free, pool};
+  return a;
+}
+
+/**
+ * Fonction : game_pool_reset
+
+ * Libère d'un coup tous les objets du pool, en gardant ses dalles ; les grands
+ * objets sont rendus un par un au parent.
+ */
+
+void game_pool_reset(game_pool *pool) {
+  assert(pool);
+  pool->current = NULL;
+  pool->used = 0;
+  pool->free_list = NULL;
+  _large_free_all(pool);
+}
+
+void game_pool_delete(game_pool *pool) {
+  if (pool == NULL) return;
+  _large_free_all(pool);
+  size_t slab_size = GAME_ALIGNMENT + pool->stride * pool->nb_per_slab;
+  struct slab_s *s = pool->first;
+  while (s) {
+    struct slab_s *next = s->next;
+    pool->parent.free(pool->parent.context, s, slab_size);
+    s = next;
+  }
+  free(pool);
+}
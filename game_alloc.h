@@ -0,0 +1,176 @@
+/**
+ * @file game_alloc.h
+ * @brief Game Memory Allocation.
+ * @details All the memory owned by a game (the game itself, its history and
+ * its neighbour table) is obtained through a game_allocator. By default, it is
+ * the standard library allocator. The allocator in use when a game is created
+ * (with @ref game_new_empty, @ref game_new_empty_ext, @ref game_copy, ...) is
+ * recorded in the game and used until @ref game_delete.
+ *
+ * Two allocators are provided: a bump arena and a fixed-size slab pool. Both
+ * can be reset in O(1), which releases at once all the games allocated from
+ * them (those games must then be forgotten, not deleted).
+ * @copyright University of Bordeaux. All rights reserved, 2024.
+ **/
+
+#ifndef __GAME_ALLOC_H__
+#define __GAME_ALLOC_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @name Allocators
+ * @{
+ */
+
+/**
+ * @brief Memory allocator hooks.
+ * @details @p alloc returns a block of @p size bytes aligned on @p alignment (a
+ * power of two), or NULL on failure. @p free releases a block returned by
+ * @p alloc, with the same size. Both receive @p context as first argument.
+ **/
+typedef struct {
+  void *(*alloc)(void *context, size_t size, size_t alignment);
+  void (*free)(void *context, void *ptr, size_t size);
+  void *context;
+} game_allocator;
+
+/**
+ * @brief Sets the allocator used by all threads without a thread allocator.
+ * @details Must not be called while other threads create games.
+ * @param allocator the allocator, or NULL to restore the standard library one
+ **/
+void game_set_allocator(const game_allocator *allocator);
+
+/**
+ * @brief Sets the allocator used by the calling thread.
+ * @param allocator the allocator, or NULL to use the global one again
+ **/
+void game_set_thread_allocator(const game_allocator *allocator);
+
+/**
+ * @brief Gets the allocator used by the calling thread to create games.
+ * @return the thread allocator if any, the global one otherwise
+ **/
+game_allocator game_get_allocator(void);
+
+/**
+ * @brief Allocation counters.
+ * @details Counts the calls to the allocators made by the game library since
+ * the start of the program (or the last @ref game_reset_alloc_stats), in all
+ * threads.
+ **/
+typedef struct {
+  size_t nb_allocs;    /**< number of successful allocations */
+  size_t nb_frees;     /**< number of releases */
+  size_t bytes_allocated; /**< total size of the allocations */
+} game_alloc_stats;
+
+/**
+ * @brief Gets the allocation counters.
+ * @param stats where to store the counters
+ **/
+void game_get_alloc_stats(game_alloc_stats *stats);
+
+/**
+ * @brief Resets the allocation counters to zero.
+ **/
+void game_reset_alloc_stats(void);
+
+/**
+ * @}
+ */
+
+/**
+ * @name Arena
+ * @{
+ */
+
+/**
+ * @brief Bump allocator: allocations are carved in large chunks, and
+ * individual releases do nothing.
+ **/
+typedef struct game_arena_s game_arena;
+
+/**
+ * @brief Creates an arena.
+ * @param chunk_size size in bytes of the chunks requested to the standard
+ * library (larger allocations get their own chunk)
+ * @return the arena, or NULL if @p chunk_size is zero or on allocation failure
+ **/
+game_arena *game_arena_new(size_t chunk_size);
+
+/**
+ * @brief Gets an allocator that allocates from an arena.
+ * @param arena the arena
+ * @return the allocator, valid until @ref game_arena_delete
+ **/
+game_allocator game_arena_allocator(game_arena *arena);
+
+/**
+ * @brief Releases at once all the memory allocated from an arena.
+ * @details The chunks are kept to be reused by the next allocations.
+ * @param arena the arena
+ **/
+void game_arena_reset(game_arena *arena);
+
+/**
+ * @brief Deletes an arena and all the memory allocated from it.
+ * @param arena the arena
+ **/
+void game_arena_delete(game_arena *arena);
+
+/**
+ * @}
+ */
+
+/**
+ * @name Pool
+ * @{
+ */
+
+/**
+ * @brief Slab allocator for objects of a fixed maximal size: released objects
+ * are kept on a free list and reused.
+ **/
+typedef struct game_pool_s game_pool;
+
+/**
+ * @brief Creates a pool.
+ * @param object_size maximal size of the objects allocated from the pool
+ * (larger allocations are forwarded to @p parent)
+ * @param nb_per_slab number of objects per slab
+ * @param parent allocator for the slabs and the large objects, or NULL for the
+ * standard library one
+ * @return the pool, or NULL on bad parameters or allocation failure
+ **/
+game_pool *game_pool_new(size_t object_size, size_t nb_per_slab,
+                         const game_allocator *parent);
+
+/**
+ * @brief Gets an allocator that allocates from a pool.
+ * @param pool the pool
+ * @return the allocator, valid until @ref game_pool_delete
+ **/
+game_allocator game_pool_allocator(game_pool *pool);
+
+/**
+ * @brief Releases at once all the objects allocated from a pool.
+ * @details The slabs are kept to be reused; the large objects forwarded to the
+ * parent allocator are released to it.
+ * @param pool the pool
+ **/
+void game_pool_reset(game_pool *pool);
+
+/**
+ * @brief Deletes a pool, its slabs and its remaining large objects.
+ * @param pool the pool
+ **/
+void game_pool_delete(game_pool *pool);
+
+/**
+ * @}
+ */
+
+#endif  // __GAME_ALLOC_H__
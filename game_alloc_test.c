@@ -0,0 +1,295 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "game_alloc.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "game_aux.h"
+#include "game_ext.h"
+#include "game_struct.h"
+#include "game_tools.h"
+#include "queue.h"
+
+/* Allocateur de test : compte les blocs vivants et les octets alloués. */
+typedef struct {
+  size_t nb_blocks;
+  size_t nb_bytes;
+} counter;
+
+static void *counter_alloc(void *context, size_t size, size_t alignment) {
+  counter *c = context;
+  void *p;
+  if (alignment < sizeof(void *)) alignment = sizeof(void *);
+  if (posix_memalign(&p, alignment, size) != 0) return NULL;
+  c->nb_blocks++;
+  c->nb_bytes += size;
+  return p;
+}
+
+static void counter_free(void *context, void *ptr, size_t size) {
+  counter *c = context;
+  c->nb_blocks--;
+  c->nb_bytes -= size;
+  free(ptr);
+}
+
+bool test_game_allocator() {
+  counter c = {0, 0};
+  game_allocator a = {counter_alloc, counter_free, &c};
+  game_set_thread_allocator(&a);
+  game_allocator current = game_get_allocator();
+  bool ok = current.alloc == counter_alloc && current.context == &c;
+
+  // Toute la mémoire d'un jeu passe par l'allocateur courant
+  game g = game_new_empty_ext(4, 5, true);
+  game_play_move(g, 1, 2, 1);
+  game copy = game_copy(g);
+  game_undo(copy);
+  if (c.nb_blocks == 0 || copy->nbrs != g->nbrs) ok = false;
+  game_delete(copy);
+
+  // Une copie faite avec un autre allocateur a sa propre table
+  game_set_thread_allocator(NULL);
+  copy = game_copy(g);
+  if (copy->nbrs == g->nbrs) ok = false;
+  game_delete(g);
+  if (c.nb_blocks != 0 || c.nb_bytes != 0) ok = false;
+  game_delete(copy);
+  return ok;
+}
+
+bool test_game_alloc_stats() {
+  game g = game_new_empty_ext(10, 10, false);
+  game dst = game_new_empty_ext(10, 10, false);
+  game_alloc_stats before, after;
+  game_get_alloc_stats(&before);
+  game dummy = game_copy(g);
+  game_delete(dummy);
+  game_get_alloc_stats(&after);
+  // Une copie : un bloc pour le jeu, la table est partagée
+  bool ok = after.nb_allocs == before.nb_allocs + 1 &&
+            after.nb_frees == before.nb_frees + 1 &&
+            after.bytes_allocated > before.bytes_allocated;
+
+  // game_copy_into n'alloue rien quand la grille tient dans dst
+  game_get_alloc_stats(&before);
+  for (uint k = 0; k < 100; k++) ok &= game_copy_into(dst, g);
+  game_get_alloc_stats(&after);
+  if (after.nb_allocs != before.nb_allocs) ok = false;
+
+  // un snapshot de 100 cases : la grille persistante et un morceau, libérés
+  // avec le jeu
+  game_get_alloc_stats(&before);
+  game_snapshot_delete(game_snapshot(dst));
+  game_get_alloc_stats(&after);
+  if (after.nb_allocs != before.nb_allocs + 2 ||
+      after.nb_frees != before.nb_frees)
+    ok = false;
+
+  game_reset_alloc_stats();
+  game_get_alloc_stats(&after);
+  if (after.nb_allocs != 0 || after.nb_frees != 0) ok = false;
+  game_delete(dst);
+  game_delete(g);
+  return ok;
+}
+
+bool test_game_arena() {
+  game_arena *arena = game_arena_new(4096);
+  if (arena == NULL) return false;
+  game_allocator a = game_arena_allocator(arena);
+  game_set_thread_allocator(&a);
+
+  // Un lot de jeux, plus grand qu'un morceau, libéré d'un coup
+  game first = NULL;
+  bool ok = true;
+  for (uint k = 0; k < 100; k++) {
+    game g = game_new_empty_ext(8, 8, k % 2);
+    game_play_move(g, k % 8, 0, 1);
+    if ((uintptr_t)g % GAME_ALIGNMENT != 0) ok = false;
+    if (first == NULL) first = g;
+  }
+  game_arena_reset(arena);
+  game g = game_new_empty_ext(8, 8, false);
+  if (g != first) ok = false;  // les morceaux sont réutilisés
+  game_delete(g);              // ne fait rien dans une arène
+  game_set_thread_allocator(NULL);
+  game_arena_delete(arena);
+  return ok && game_arena_new(0) == NULL;
+}
+
+bool test_game_pool() {
+  game_arena *arena = game_arena_new(1 << 16);
+  game_allocator parent = game_arena_allocator(arena);
+  // pool pour les blocs de jeux 5x5 et les éléments de l'historique
+  game_pool *pool =
+      game_pool_new(sizeof(struct game_s) + 25 * sizeof(Acase), 16, &parent);
+  if (pool == NULL) return false;
+  game_allocator a = game_pool_allocator(pool);
+  game_set_thread_allocator(&a);
+
+  game g = game_new_empty_ext(5, 5, true);
+  bool ok = g != NULL && (uintptr_t)g % GAME_ALIGNMENT == 0;
+  game_delete(g);
+  // l'emplacement libéré est réutilisé
+  game g2 = game_new_empty_ext(5, 5, false);
+  if (g2 == NULL || g2 != g) return false;
+  for (uint k = 0; k < 100; k++) game_play_move(g2, k % 5, k % 3, 1);
+  for (uint k = 0; k < 100; k++) game_undo(g2);
+  if (game_get_piece_orientation(g2, 0, 0) != NORTH) ok = false;
+
+  // les grands objets passent par l'allocateur parent
+  game big = game_new_empty_ext(50, 50, false);
+  if (big == NULL) ok = false;
+  game_delete(big);
+
+  game_pool_reset(pool);
+  game g3 = game_new_empty_ext(5, 5, false);
+  if (g3 == NULL) ok = false;
+  game_set_thread_allocator(NULL);
+  game_pool_delete(pool);
+  game_arena_delete(arena);
+  return ok && game_pool_new(0, 16, NULL) == NULL;
+}
+
+bool test_game_pool_large() {
+  // blocs de jeux 6x6 : le bloc de jeu et la table de voisinage d'une grille
+  // 10x10 sont transmis au parent
+  size_t object_size = sizeof(struct game_s) + 36 * sizeof(Acase);
+  counter c = {0, 0};
+  game_allocator parent = {counter_alloc, counter_free, &c};
+  game_pool *pool = game_pool_new(object_size, 16, &parent);
+  if (pool == NULL) return false;
+  game_allocator a = game_pool_allocator(pool);
+  game_set_thread_allocator(&a);
+  for (uint k = 0; k < 4; k++) game_new_empty_ext(10, 10, k % 2 == 0);
+  size_t nb_before = c.nb_blocks;
+  // reset rend au parent les grands objets encore vivants (deux par jeu)
+  game_pool_reset(pool);
+  size_t nb_slabs = c.nb_blocks;
+  bool ok = nb_slabs + 8 <= nb_before;
+  game big = game_new_empty_ext(10, 10, true);
+  if (big == NULL || c.nb_blocks <= nb_slabs) ok = false;
+  game_delete(big);
+  if (c.nb_blocks != nb_slabs) ok = false;
+  game_set_thread_allocator(NULL);
+  game_pool_delete(pool);
+  if (c.nb_blocks != 0 || c.nb_bytes != 0) ok = false;
+
+  // même chose avec la bibliothèque standard comme parent (vérifié sans fuite
+  // sous valgrind ou -fsanitize=address)
+  pool = game_pool_new(object_size, 16, NULL);
+  if (pool == NULL) return false;
+  a = game_pool_allocator(pool);
+  game_set_thread_allocator(&a);
+  for (uint k = 0; k < 4; k++) game_new_empty_ext(10, 10, k % 2 == 0);
+  game_pool_reset(pool);
+  for (uint k = 0; k < 4; k++) game_new_empty_ext(12, 12, false);
+  game_set_thread_allocator(NULL);
+  game_pool_delete(pool);
+  return ok;
+}
+
+bool test_game_play_no_alloc() {
+  // une grille résolue : game_won parcourt alors toute la grille
+  game g = game_random(6, 6, true, 0, 0);
+  direction o = game_get_piece_orientation(g, 0, 0);
+  // premier passage : l'historique atteint sa taille maximale, et game_won
+  // alloue son tampon
+  for (uint k = 0; k < 100; k++) game_play_move(g, k % 6, k / 6 % 6, 1);
+  for (uint k = 0; k < 100; k++) game_undo(g);
+  bool ok = game_won(g);
+
+  game_alloc_stats before, after;
+  game_get_alloc_stats(&before);
+  for (uint n = 0; n < 10; n++) {
+    for (uint k = 0; k < 100; k++) game_redo(g);
+    for (uint k = 0; k < 100; k++) game_undo(g);
+    for (uint k = 0; k < 100; k++) game_play_move(g, k % 6, k % 5, 3);
+    for (uint k = 0; k < 100; k++) game_undo(g);
+    ok = ok && game_won(g);
+  }
+  game_get_alloc_stats(&after);
+  ok = ok && after.nb_allocs == before.nb_allocs &&
+       game_get_piece_orientation(g, 0, 0) == o;
+  game_delete(g);
+  return ok;
+}
+
+/* Remplit et vide une file par les deux bouts, et vérifie l'ordre. */
+static bool check_queue(queue *q) {
+  for (intptr_t k = 0; k < 100; k++) queue_push_tail(q, (void *)k);
+  for (intptr_t k = 1; k <= 100; k++) queue_push_head(q, (void *)-k);
+  if (queue_length(q) != 200 || (intptr_t)queue_peek_head(q) != -100 ||
+      (intptr_t)queue_peek_tail(q) != 99)
+    return false;
+  for (intptr_t k = 100; k >= 1; k--)
+    if ((intptr_t)queue_pop_head(q) != -k) return false;
+  for (intptr_t k = 99; k >= 50; k--)
+    if ((intptr_t)queue_pop_tail(q) != k) return false;
+  queue_clear(q);
+  return queue_is_empty(q);
+}
+
+bool test_queue_pool() {
+  queue *list = queue_new();
+  queue *ring = queue_new_contiguous();
+  bool ok = check_queue(list) && check_queue(ring);
+  // les éléments libérés sont réutilisés
+  struct queue_chunk_s *chunks = list->chunks;
+  void **buffer = ring->ring;
+  ok = ok && check_queue(list) && check_queue(ring);
+  if (list->chunks != chunks || ring->ring != buffer) ok = false;
+  queue_free(list);
+  queue_free(ring);
+  return ok;
+}
+
+void usage(int argc, char *argv[]) {
+  fprintf(stderr, "Usage: %s <testname> [<...>]\n", argv[0]);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 1) {
+    usage(argc, argv);
+  }
+
+  bool etat = true;
+  fprintf(stderr, "=> Start test \"%s\"\n", argv[1]);
+
+  if (strcmp("game_allocator", argv[1]) == 0) {
+    etat = test_game_allocator();
+  } else if (strcmp("game_alloc_stats", argv[1]) == 0) {
+    etat = test_game_alloc_stats();
+  } else if (strcmp("game_arena", argv[1]) == 0) {
+    etat = test_game_arena();
+  } else if (strcmp("game_pool", argv[1]) == 0) {
+    etat = test_game_pool();
+  } else if (strcmp("game_pool_large", argv[1]) == 0) {
+    etat = test_game_pool_large();
+  } else if (strcmp("game_play_no_alloc", argv[1]) == 0) {
+    etat = test_game_play_no_alloc();
+  } else if (strcmp("queue_pool", argv[1]) == 0) {
+    etat = test_queue_pool();
+  } else {
+    fprintf(stderr, "Test \"%s\" finished: FAILURE\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  // print test result
+  if (etat) {
+    fprintf(stderr, "Test \"%s\" finished: SUCCESS\n", argv[1]);
+    return EXIT_SUCCESS;
+  } else {
+    fprintf(stderr, "Test \"%s\" finished: FAILURE\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,455 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "game_archive.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "game_ext.h"
+#include "game_private.h"
+#include "game_struct.h"
+#include "queue.h"
+
+// @copyright University of Bordeaux. All rights reserved, 2024.
+
+#define BIN_VERSION 1
+#define BIN_WRAPPING 0x1
+
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 32
+#define ARCHIVE_ALIGNMENT 8
+#define ARCHIVE_MIN_INDEX 16
+
+/* ************************************************************************** */
+/*                               FORMAT BINAIRE                               */
+/* ************************************************************************** */
+
+/* les entiers sont stockés en little-endian, quelle que soit la machine */
+static void _put32(uint8_t *p, uint32_t v) {
+  for (int k = 0; k < 4; k++) p[k] = v >> (8 * k);
+}
+
+static uint32_t _get32(const uint8_t *p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static void _put64(uint8_t *p, uint64_t v) {
+  _put32(p, (uint32_t)v);
+  _put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t _get64(const uint8_t *p) {
+  return _get32(p) | (uint64_t)_get32(p + 4) << 32;
+}
+
+/* taille d'un plateau codé : en-tête, formes (4 bits) et orientations (2
+ * bits) */
+static size_t _encoded_size(size_t nb_squares) {
+  return GAME_BIN_HEADER_SIZE + (nb_squares + 1) / 2 + (nb_squares + 3) / 4;
+}
+
+/* lit l'en-tête d'un plateau ; retour : le nombre de cases, 0 s'il est
+ * invalide ou si le tampon est trop court */
+static size_t _decode_header(const uint8_t *p, size_t len, uint *height,
+                             uint *width, bool *wrapping) {
+  if (len < GAME_BIN_HEADER_SIZE || memcmp(p, "NETB", 4) != 0 ||
+      p[4] != BIN_VERSION || (p[5] & ~BIN_WRAPPING) != 0)
+    return 0;
+  *height = _get32(p + 8);
+  *width = _get32(p + 12);
+  if (*height < 1 || *width < 1 || *height > MAX_SQUARES / *width) return 0;
+  size_t nb_squares = (size_t)*height * *width;
+  if (_encoded_size(nb_squares) > len) return 0;
+  *wrapping = p[5] & BIN_WRAPPING;
+  return nb_squares;
+}
+
+static bool _check_shapes(const uint8_t *p, size_t nb_squares) {
+  const uint8_t *shapes = p + GAME_BIN_HEADER_SIZE;
+  for (size_t k = 0; k < nb_squares; k++)
+    if ((shapes[k / 2] >> (4 * (k % 2)) & 0xF) >= NB_SHAPES) return false;
+  return true;
+}
+
+static void _decode_cases(Acase *cases, const uint8_t *p, size_t nb_squares) {
+  const uint8_t *shapes = p + GAME_BIN_HEADER_SIZE;
+  const uint8_t *dirs = shapes + (nb_squares + 1) / 2;
+  for (size_t k = 0; k < nb_squares; k++) {
+    cases[k].shape = shapes[k / 2] >> (4 * (k % 2)) & 0xF;
+    cases[k].orientation = dirs[k / 4] >> (2 * (k % 4)) & 0x3;
+  }
+}
+
+/**
+ * Fonction : game_encode
+
+ * Code un jeu dans le format binaire.
+
+ * Paramètres :
+ *  g : Le jeu.
+ *  buf, cap : Le tampon de sortie et sa taille.
+
+ * Retour : La taille du jeu codé (rien n'est écrit si elle dépasse cap).
+ */
+
+size_t game_encode(cgame g, void *buf, size_t cap) {
+  if (g == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  size_t nb_squares = (size_t)g->height * g->width;
+  size_t size = _encoded_size(nb_squares);
+  if (size > cap) return size;
+
+  uint8_t *p = buf;
+  memset(p, 0, size);
+  memcpy(p, "NETB", 4);
+  p[4] = BIN_VERSION;
+  p[5] = g->isWrapping ? BIN_WRAPPING : 0;
+  _put32(p + 8, g->height);
+  _put32(p + 12, g->width);
+  uint8_t *shapes = p + GAME_BIN_HEADER_SIZE;
+  uint8_t *dirs = shapes + (nb_squares + 1) / 2;
+  for (size_t k = 0; k < nb_squares; k++) {
+    shapes[k / 2] |= g->cases[k].shape << (4 * (k % 2));
+    dirs[k / 4] |= g->cases[k].orientation << (2 * (k % 4));
+  }
+  return size;
+}
+
+/**
+ * Fonction : game_decode
+
+ * Décode un jeu dans le format binaire.
+
+ * Retour : Le jeu, ou NULL si le tampon ne contient pas un jeu valide.
+ */
+
+game game_decode(const void *buf, size_t len) {
+  uint height, width;
+  bool wrapping;
+  if (buf == NULL) return NULL;
+  size_t nb_squares = _decode_header(buf, len, &height, &width, &wrapping);
+  if (nb_squares == 0 || !_check_shapes(buf, nb_squares)) return NULL;
+  game g = game_new_empty_ext(height, width, wrapping);
+  if (g == NULL) return NULL;
+  _decode_cases(g->cases, buf, nb_squares);
+  return g;
+}
+
+/**
+ * Fonction : game_decode_into
+
+ * Décode un jeu dans le format binaire dans un jeu existant de même taille,
+ * sans allocation.
+
+ * Retour : true en cas de succès, sinon false (le jeu est inchangé).
+ */
+
+bool game_decode_into(game g, const void *buf, size_t len) {
+  uint height, width;
+  bool wrapping;
+  if (g == NULL || buf == NULL) return false;
+  size_t nb_squares = _decode_header(buf, len, &height, &width, &wrapping);
+  if (nb_squares == 0 || height != g->height || width != g->width ||
+      !_check_shapes(buf, nb_squares))
+    return false;
+  bool old_wrapping = g->isWrapping;
+  g->isWrapping = wrapping;
+  if (!_game_update_neighbours(g)) {
+    g->isWrapping = old_wrapping;
+    return false;
+  }
+  _decode_cases(g->cases, buf, nb_squares);
+  _game_invalidate_caches(g);
+  queue_clear(g->do_queue);
+  queue_clear(g->undo_queue);
+  return true;
+}
+
+/* ************************************************************************** */
+
+/* projette un fichier en lecture ; retour : false si c'est impossible */
+static bool _map_file(int fd, const uint8_t **map, size_t *len) {
+  struct stat st;
+  *map = NULL;
+  *len = 0;
+  if (fstat(fd, &st) != 0) return false;
+  if (st.st_size == 0) return true;
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) return false;
+  *map = p;
+  *len = st.st_size;
+  return true;
+}
+
+static bool _write_all(int fd, const void *buf, size_t len, off_t pos) {
+  const uint8_t *p = buf;
+  while (len > 0) {
+    ssize_t n = pwrite(fd, p, len, pos);
+    if (n <= 0) return false;
+    p += n;
+    pos += n;
+    len -= n;
+  }
+  return true;
+}
+
+/**
+ * Fonction : game_load_bin
+
+ * Charge un jeu depuis un fichier binaire.
+
+ * Retour : Le jeu, ou NULL en cas d'erreur.
+ */
+
+game game_load_bin(const char *filename) {
+  if (filename == NULL) return NULL;
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+  const uint8_t *map;
+  size_t len;
+  game g = NULL;
+  if (_map_file(fd, &map, &len)) {
+    g = game_decode(map, len);
+    if (map) munmap((void *)map, len);
+  }
+  close(fd);
+  return g;
+}
+
+/**
+ * Fonction : game_save_bin
+
+ * Sauvegarde un jeu dans un fichier binaire.
+
+ * Retour : true en cas de succès, sinon false.
+ */
+
+bool game_save_bin(cgame g, const char *filename) {
+  if (g == NULL || filename == NULL) return false;
+  size_t size = game_encode(g, NULL, 0);
+  uint8_t *buf = malloc(size);
+  if (buf == NULL) return false;
+  game_encode(g, buf, size);
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd >= 0 && _write_all(fd, buf, size, 0);
+  if (fd >= 0 && close(fd) != 0) ok = false;
+  free(buf);
+  return ok;
+}
+
+/* ************************************************************************** */
+/*                                  ARCHIVES                                  */
+/* ************************************************************************** */
+
+struct game_archive_s {
+  int fd;
+  bool writable;
+  bool dirty;              // des plateaux ont été ajoutés
+  const uint8_t *map;      // le fichier projeté en mémoire
+  size_t map_len;
+  uint64_t nb_boards;
+  uint64_t end;            // fin des plateaux (l'index en lecture seule)
+  uint64_t *index;         // copie de l'index (en écriture seulement)
+  uint64_t capacity;
+  uint8_t *buf;            // tampon de codage (en écriture seulement)
+  size_t buf_len;
+};
+
+static bool _archive_map(game_archive *a) {
+  if (a->map) munmap((void *)a->map, a->map_len);
+  return _map_file(a->fd, &a->map, &a->map_len);
+}
+
+static bool _archive_free(game_archive *a) {
+  bool ok = true;
+  if (a->map) munmap((void *)a->map, a->map_len);
+  if (a->fd >= 0 && close(a->fd) != 0) ok = false;
+  free(a->index);
+  free(a->buf);
+  free(a);
+  return ok;
+}
+
+/* écrit l'en-tête d'une archive dont l'index commence à index_pos */
+static bool _archive_write_header(int fd, uint64_t nb_boards,
+                                  uint64_t index_pos) {
+  uint8_t header[ARCHIVE_HEADER_SIZE] = {'N', 'E', 'T', 'A'};
+  _put32(header + 4, ARCHIVE_VERSION);
+  _put64(header + 8, nb_boards);
+  _put64(header + 16, index_pos);
+  return _write_all(fd, header, sizeof(header), 0);
+}
+
+static bool _archive_read_header(game_archive *a) {
+  const uint8_t *p = a->map;
+  if (a->map_len < ARCHIVE_HEADER_SIZE || memcmp(p, "NETA", 4) != 0 ||
+      _get32(p + 4) != ARCHIVE_VERSION)
+    return false;
+  a->nb_boards = _get64(p + 8);
+  a->end = _get64(p + 16);
+  return a->end >= ARCHIVE_HEADER_SIZE && a->end <= a->map_len &&
+         a->nb_boards <= (a->map_len - a->end) / sizeof(uint64_t);
+}
+
+/**
+ * Fonction : game_archive_open
+
+ * Ouvre une archive (et la crée si elle est ouverte en écriture et n'existe
+ * pas).
+
+ * Retour : L'archive, ou NULL en cas d'erreur.
+ */
+
+game_archive *game_archive_open(const char *filename, bool writable) {
+  if (filename == NULL) return NULL;
+  game_archive *a = calloc(1, sizeof(game_archive));
+  if (a == NULL) return NULL;
+  a->writable = writable;
+  a->fd = open(filename, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (a->fd < 0 || !_archive_map(a)) {
+    _archive_free(a);
+    return NULL;
+  }
+
+  if (a->map_len == 0 && writable) {
+    // nouvelle archive : un en-tête vide, pour qu'elle soit valide d'emblée
+    a->end = ARCHIVE_HEADER_SIZE;
+    if (!_archive_write_header(a->fd, 0, a->end)) {
+      _archive_free(a);
+      return NULL;
+    }
+  } else if (!_archive_read_header(a)) {
+    _archive_free(a);
+    return NULL;
+  }
+
+  if (writable) {
+    a->capacity =
+        a->nb_boards > ARCHIVE_MIN_INDEX ? a->nb_boards : ARCHIVE_MIN_INDEX;
+    a->index = malloc(a->capacity * sizeof(uint64_t));
+    if (a->index == NULL) {
+      _archive_free(a);
+      return NULL;
+    }
+    for (uint64_t id = 0; id < a->nb_boards; id++)
+      a->index[id] = _get64(a->map + a->end + id * sizeof(uint64_t));
+    // les plateaux ajoutés vont après l'ancien index, que l'en-tête désigne
+    // jusqu'à ce que game_archive_close écrive le nouveau
+    a->end += a->nb_boards * sizeof(uint64_t);
+  }
+  return a;
+}
+
+uint64_t game_archive_size(const game_archive *a) {
+  assert(a);
+  return a->nb_boards;
+}
+
+/* position d'un plateau dans le fichier projeté, ou NULL */
+static const uint8_t *_archive_board(game_archive *a, uint64_t id,
+                                     size_t *len) {
+  if (a == NULL || id >= a->nb_boards) return NULL;
+  // les plateaux ajoutés depuis la projection ne sont pas encore visibles
+  if (a->writable && a->end > a->map_len && !_archive_map(a)) return NULL;
+  uint64_t pos = a->writable
+                     ? a->index[id]
+                     : _get64(a->map + a->end + id * sizeof(uint64_t));
+  if (pos < ARCHIVE_HEADER_SIZE || pos >= a->end) return NULL;
+  *len = a->end - pos;
+  return a->map + pos;
+}
+
+/**
+ * Fonction : game_archive_get
+
+ * Décode un plateau d'une archive, directement depuis le fichier projeté.
+
+ * Retour : Le plateau, ou NULL en cas d'erreur.
+ */
+
+game game_archive_get(game_archive *a, uint64_t id) {
+  size_t len;
+  const uint8_t *p = _archive_board(a, id, &len);
+  return p ? game_decode(p, len) : NULL;
+}
+
+bool game_archive_get_into(game_archive *a, uint64_t id, game g) {
+  size_t len;
+  const uint8_t *p = _archive_board(a, id, &len);
+  return p && game_decode_into(g, p, len);
+}
+
+/**
+ * Fonction : game_archive_append
+
+ * Ajoute un plateau à la fin d'une archive ouverte en écriture. Il est écrit
+ * après l'ancien index, qui reste valide : l'archive n'est modifiée pour les
+ * lecteurs qu'à la fermeture.
+
+ * Retour : L'identifiant du plateau, ou UINT64_MAX en cas d'erreur.
+ */
+
+uint64_t game_archive_append(game_archive *a, cgame g) {
+  if (a == NULL || g == NULL || !a->writable) return UINT64_MAX;
+  size_t size = game_encode(g, NULL, 0);
+  size_t padded = (size + ARCHIVE_ALIGNMENT - 1) & ~(size_t)(ARCHIVE_ALIGNMENT - 1);
+  if (padded > a->buf_len) {
+    uint8_t *buf = realloc(a->buf, padded);
+    if (buf == NULL) return UINT64_MAX;
+    a->buf = buf;
+    a->buf_len = padded;
+  }
+  if (a->nb_boards == a->capacity) {
+    uint64_t *index = realloc(a->index, 2 * a->capacity * sizeof(uint64_t));
+    if (index == NULL) return UINT64_MAX;
+    a->index = index;
+    a->capacity *= 2;
+  }
+  game_encode(g, a->buf, size);
+  memset(a->buf + size, 0, padded - size);
+  if (!_write_all(a->fd, a->buf, padded, a->end)) return UINT64_MAX;
+  a->dirty = true;
+  a->index[a->nb_boards] = a->end;
+  a->end += padded;
+  return a->nb_boards++;
+}
+
+/**
+ * Fonction : game_archive_close
+
+ * Ferme une archive, en écrivant son index et son en-tête si elle a été
+ * modifiée. Le nouvel index est écrit et synchronisé avant l'en-tête : en cas
+ * d'interruption, l'archive reste valide, avec ou sans les nouveaux plateaux.
+
+ * Retour : true en cas de succès, sinon false.
+ */
+
+bool game_archive_close(game_archive *a) {
+  if (a == NULL) return true;
+  bool ok = true;
+  if (a->writable && a->dirty) {
+    size_t len = a->nb_boards * sizeof(uint64_t);
+    uint8_t *index = malloc(len ? len : 1);
+    if (index) {
+      for (uint64_t id = 0; id < a->nb_boards; id++)
+        _put64(index + id * sizeof(uint64_t), a->index[id]);
+    }
+    ok = index && _write_all(a->fd, index, len, a->end) &&
+         ftruncate(a->fd, a->end + len) == 0 && fsync(a->fd) == 0 &&
+         _archive_write_header(a->fd, a->nb_boards, a->end);
+    free(index);
+  }
+  return _archive_free(a) && ok;
+}
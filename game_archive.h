@@ -0,0 +1,160 @@
+/**
+ * @file game_archive.h
+ * @brief Game Binary Format and Archives.
+ * @details A binary board starts with a 16-byte header: the magic "NETB", a
+ * version byte, a flag byte (bit 0: wrapping), two reserved bytes, then the
+ * number of rows and columns as little-endian 32-bit integers. It is followed
+ * by the shapes, 4 bits per square in row-major order (two squares per byte,
+ * low nibble first), then by the orientations, 2 bits per square (four
+ * squares per byte, low bits first).
+ *
+ * An archive is a file holding many binary boards: a 32-byte header (the magic
+ * "NETA", a version, the number of boards and the position of the index), the
+ * boards themselves (each aligned on 8 bytes), then an index with the position
+ * of each board. Archives are read through mmap, so that a board is decoded
+ * straight from the mapped file in O(1) by its id. Boards appended to an
+ * existing archive are written after its index, which stays in place: the
+ * file is a valid archive at every point, at the cost of the old index left
+ * unused among the boards.
+ * @copyright University of Bordeaux. All rights reserved, 2024.
+ **/
+
+#ifndef __GAME_ARCHIVE_H__
+#define __GAME_ARCHIVE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+#include "game_ext.h"
+
+/**
+ * @name Binary Format
+ * @{
+ */
+
+/**
+ * @brief Size of the header of a binary board.
+ **/
+#define GAME_BIN_HEADER_SIZE 16
+
+/**
+ * @brief Encodes a game in the binary format.
+ * @param g the game
+ * @param buf output buffer (may be NULL if @p cap is 0)
+ * @param cap size of the output buffer
+ * @return the size of the encoded game; nothing is written if it is larger
+ * than @p cap
+ * @pre @p g is a valid pointer toward a game structure
+ **/
+size_t game_encode(cgame g, void *buf, size_t cap);
+
+/**
+ * @brief Decodes a game in the binary format.
+ * @param buf input buffer
+ * @param len size of the input buffer (it may extend past the game)
+ * @return the decoded game, or NULL if the buffer does not hold a valid game
+ **/
+game game_decode(const void *buf, size_t len);
+
+/**
+ * @brief Decodes a game in the binary format into an existing game.
+ * @details Nothing is allocated; the history of @p g is cleared.
+ * @param g the game, with the same size as the encoded one
+ * @param buf input buffer
+ * @param len size of the input buffer
+ * @return true on success, false if the buffer does not hold a valid game of
+ * the size of @p g (then @p g is unchanged)
+ **/
+bool game_decode_into(game g, const void *buf, size_t len);
+
+/**
+ * @brief Creates a game by loading it from a binary file.
+ * @param filename input file
+ * @return the loaded game, or NULL on error
+ **/
+game game_load_bin(const char *filename);
+
+/**
+ * @brief Saves a game in a binary file.
+ * @param g the game
+ * @param filename output file
+ * @return true on success, false on error
+ **/
+bool game_save_bin(cgame g, const char *filename);
+
+/**
+ * @}
+ */
+
+/**
+ * @name Archives
+ * @{
+ */
+
+/**
+ * @brief An archive of binary boards.
+ **/
+typedef struct game_archive_s game_archive;
+
+/**
+ * @brief Opens an archive.
+ * @param filename the archive file
+ * @param writable if true, the archive is created if needed and boards can be
+ * appended with @ref game_archive_append
+ * @return the archive, or NULL if the file cannot be opened or is not a valid
+ * archive
+ **/
+game_archive *game_archive_open(const char *filename, bool writable);
+
+/**
+ * @brief Gets the number of boards in an archive.
+ * @param a the archive
+ * @return the number of boards, including the appended ones
+ **/
+uint64_t game_archive_size(const game_archive *a);
+
+/**
+ * @brief Gets a board from an archive.
+ * @param a the archive
+ * @param id the id of the board, from 0 to @ref game_archive_size - 1
+ * @return the board, or NULL if @p id is out of range or the board is invalid
+ **/
+game game_archive_get(game_archive *a, uint64_t id);
+
+/**
+ * @brief Gets a board from an archive into an existing game.
+ * @details See @ref game_decode_into.
+ * @param a the archive
+ * @param id the id of the board
+ * @param g the game, with the same size as the board
+ * @return true on success, false otherwise
+ **/
+bool game_archive_get_into(game_archive *a, uint64_t id, game g);
+
+/**
+ * @brief Appends a board at the end of an archive.
+ * @details The board is written at once, but the index is only written by
+ * @ref game_archive_close: until then, readers of the file (or the file left
+ * by a crash) see the archive as it was when opened.
+ * @param a the archive, opened as writable
+ * @param g the board
+ * @return the id of the board, or UINT64_MAX on error
+ **/
+uint64_t game_archive_append(game_archive *a, cgame g);
+
+/**
+ * @brief Closes an archive, writing its index if boards were appended.
+ * @details The new index is written and synced before the header points to
+ * it.
+ * @param a the archive (or NULL)
+ * @return true on success, false if the index could not be written
+ **/
+bool game_archive_close(game_archive *a);
+
+/**
+ * @}
+ */
+
+#endif  // __GAME_ARCHIVE_H__
@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "game_archive.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "game_aux.h"
+#include "game_ext.h"
+#include "game_struct.h"
+#include "game_tools.h"
+
+/* Un jeu avec toutes les pièces dans toutes les orientations. */
+static game all_pieces(bool wrapping) {
+  game g = game_new_empty_ext(NB_SHAPES, NB_DIRS + 1, wrapping);
+  for (uint i = 0; i < NB_SHAPES; i++)
+    for (uint j = 0; j < NB_DIRS; j++) {
+      game_set_piece_shape(g, i, j, i);
+      game_set_piece_orientation(g, i, j, j);
+    }
+  return g;
+}
+
+bool test_game_encode() {
+  bool ok = true;
+  for (int wrapping = 0; wrapping < 2; wrapping++) {
+    game g = all_pieces(wrapping);
+    size_t size = game_encode(g, NULL, 0);
+    // 30 cases : 15 octets de formes et 8 d'orientations
+    if (size != GAME_BIN_HEADER_SIZE + 15 + 8) ok = false;
+    unsigned char *buf = malloc(size + 1);
+    buf[size - 1] = 0xAA;
+    if (game_encode(g, buf, size - 1) != size || buf[size - 1] != 0xAA)
+      ok = false;  // tampon trop petit : rien n'est écrit
+    if (game_encode(g, buf, size + 1) != size) ok = false;
+    game copy = game_decode(buf, size);
+    ok = ok && copy && game_equal_fast(g, copy, false);
+
+    // décodage sans allocation dans un jeu de même taille
+    game dst = game_new_empty_ext(NB_SHAPES, NB_DIRS + 1, !wrapping);
+    game_play_move(dst, 0, 0, 1);
+    ok = ok && game_decode_into(dst, buf, size) &&
+         game_equal_fast(g, dst, false);
+    // la table des cases adjacentes suit le nouveau mode wrapping
+    if (dst->nbrs->wrapping != wrapping) ok = false;
+    game_delete(dst);
+    game_delete(copy);
+    game_delete(g);
+    free(buf);
+  }
+  return ok;
+}
+
+bool test_game_decode_invalid() {
+  game g = game_default();
+  unsigned char buf[64];
+  size_t size = game_encode(g, buf, sizeof(buf));
+  bool ok = size <= sizeof(buf);
+  // tampon trop court
+  if (game_decode(buf, size - 1) || game_decode(buf, 4) || game_decode(NULL, 0))
+    ok = false;
+  // mauvaise signature
+  buf[0] = 'X';
+  if (game_decode(buf, size)) ok = false;
+  buf[0] = 'N';
+  // forme invalide
+  unsigned char saved = buf[GAME_BIN_HEADER_SIZE];
+  buf[GAME_BIN_HEADER_SIZE] = 0xF;
+  game dst = game_copy(g);
+  if (game_decode(buf, size) || game_decode_into(dst, buf, size)) ok = false;
+  if (!game_equal(dst, g, false)) ok = false;  // dst est inchangé
+  buf[GAME_BIN_HEADER_SIZE] = saved;
+  // taille nulle
+  memset(buf + 8, 0, 4);
+  if (game_decode(buf, size)) ok = false;
+  game_delete(dst);
+
+  // taille différente pour game_decode_into
+  dst = game_new_empty_ext(4, 5, false);
+  size = game_encode(g, buf, sizeof(buf));
+  if (game_decode_into(dst, buf, size)) ok = false;
+  game_delete(dst);
+  game_delete(g);
+  return ok;
+}
+
+bool test_game_bin_file() {
+  game g = game_random(13, 7, true, 4, 2);
+  bool ok = game_save_bin(g, "test_game_bin_file.bin");
+  game copy = game_load_bin("test_game_bin_file.bin");
+  ok = ok && copy && game_equal_fast(g, copy, false);
+  if (game_load_bin("test_game_bin_file.missing")) ok = false;
+  unlink("test_game_bin_file.bin");
+  game_delete(copy);
+  game_delete(g);
+  return ok;
+}
+
+bool test_game_archive() {
+  const char *filename = "test_game_archive.nar";
+  unlink(filename);
+  game games[50];
+  for (uint k = 0; k < 50; k++)
+    games[k] = game_random(2 + k % 7, 3 + k % 5, k % 2, 0, 0);
+
+  // création et ajouts, avec relecture pendant l'écriture
+  game_archive *a = game_archive_open(filename, true);
+  bool ok = a != NULL;
+  for (uint k = 0; ok && k < 30; k++) {
+    ok = game_archive_append(a, games[k]) == k;
+    game g = game_archive_get(a, k / 2);
+    ok = ok && g && game_equal_fast(g, games[k / 2], false);
+    game_delete(g);
+  }
+  // avant la fermeture, le fichier est une archive vide valide
+  game_archive *r = game_archive_open(filename, false);
+  ok = ok && r && game_archive_size(r) == 0;
+  game_archive_close(r);
+  ok = ok && game_archive_size(a) == 30 && game_archive_close(a);
+
+  // ajouts à une archive existante : jusqu'à la fermeture (ou en cas
+  // d'interruption), le fichier reste l'archive de départ
+  a = game_archive_open(filename, true);
+  ok = ok && a && game_archive_size(a) == 30;
+  for (uint k = 30; ok && k < 50; k++) {
+    ok = game_archive_append(a, games[k]) == k;
+    r = game_archive_open(filename, false);
+    ok = ok && r && game_archive_size(r) == 30;
+    for (uint l = 0; ok && l < 30; l += 7) {
+      game g = game_archive_get(r, l);
+      ok = g && game_equal_fast(g, games[l], false);
+      game_delete(g);
+    }
+    game_archive_close(r);
+  }
+  ok = ok && game_archive_close(a);
+
+  // lecture seule
+  a = game_archive_open(filename, false);
+  ok = ok && a && game_archive_size(a) == 50 &&
+       game_archive_append(a, games[0]) == UINT64_MAX;
+  for (uint k = 50; ok && k-- > 0;) {
+    game g = game_archive_get(a, k);
+    ok = g && game_equal_fast(g, games[k], false);
+    game_delete(g);
+  }
+  game dst = game_copy(games[14]);
+  game_reset_orientation(dst);
+  ok = ok && game_archive_get_into(a, 14, dst) &&
+       game_equal_fast(dst, games[14], false) &&
+       !game_archive_get_into(a, 15, dst);
+  if (game_archive_get(a, 50)) ok = false;
+  game_delete(dst);
+  game_archive_close(a);
+
+  // un fichier qui n'est pas une archive
+  game_save_bin(games[0], filename);
+  if (game_archive_open(filename, false) || game_archive_open(filename, true))
+    ok = false;
+  unlink(filename);
+  for (uint k = 0; k < 50; k++) game_delete(games[k]);
+  return ok;
+}
+
+void usage(int argc, char *argv[]) {
+  fprintf(stderr, "Usage: %s <testname> [<...>]\n", argv[0]);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 1) {
+    usage(argc, argv);
+  }
+
+  bool etat = true;
+  fprintf(stderr, "=> Start test \"%s\"\n", argv[1]);
+
+  if (strcmp("game_encode", argv[1]) == 0) {
+    etat = test_game_encode();
+  } else if (strcmp("game_decode_invalid", argv[1]) == 0) {
+    etat = test_game_decode_invalid();
+  } else if (strcmp("game_bin_file", argv[1]) == 0) {
+    etat = test_game_bin_file();
+  } else if (strcmp("game_archive", argv[1]) == 0) {
+    etat = test_game_archive();
+  } else {
+    fprintf(stderr, "Test \"%s\" finished: FAILURE\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  // print test result
+  if (etat) {
+    fprintf(stderr, "Test \"%s\" finished: SUCCESS\n", argv[1]);
+    return EXIT_SUCCESS;
+  } else {
+    fprintf(stderr, "Test \"%s\" finished: FAILURE\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
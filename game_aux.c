@@ -1,178 +1,115 @@
 #include "game_aux.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "game.h"
 #include "game_ext.h"
+#include "game_private.h"
 #include "game_struct.h"
 
 #define OPPOSITE_DIR(d) ((d + 2) % NB_DIRS)
 #define NEXT_DIR_CW(d) ((d + 1) % NB_DIRS)
 #define NEXT_DIR_CCW(d) ((d + 3) % NB_DIRS)
 
+#define GLYPH(s) {s, sizeof(s) - 1}
+
+const glyph GLYPHS[NB_SHAPES][NB_DIRS] = {
+    // EMPTY
+    {GLYPH("  "), GLYPH("  "), GLYPH("  "), GLYPH("  ")},
+    // ENDPOINT
+    {GLYPH("^ "), GLYPH("> "), GLYPH("v "), GLYPH("< ")},
+    // SEGMENT
+    {GLYPH("| "), GLYPH("- "), GLYPH("| "), GLYPH("- ")},
+    // CORNER
+    {GLYPH("└ "), GLYPH("┌ "), GLYPH("┐ "), GLYPH("┘ ")},
+    // TEE
+    {GLYPH("┴ "), GLYPH("├ "), GLYPH("┬ "), GLYPH("┤ ")},
+    // CROSS
+    {GLYPH("+ "), GLYPH("+ "), GLYPH("+ "), GLYPH("+ ")}};
+
+/* longueur maximale d'un numéro de ligne ou de colonne suivi d'un espace */
+#define INDEX_LEN 11
+
 /**
- * Fonction : game_print
+ * Fonction : game_print_to
 
- * Affiche le plateau de jeu sous forme de grille avec des indices de lignes et
- colonnes.
- * Chaque case contient un symbole représentant une pièce du jeu et son
- orientation.
+ * Affiche le plateau de jeu dans un fichier, sous forme de grille avec des
+ * indices de lignes et colonnes. Chaque ligne est composée dans un tampon à
+ * partir de la table des glyphes, puis écrite d'un seul fwrite.
 
- * Paramètres : g : Pointeur vers la structure du jeu (cgame) contenant la
- taille du plateau et les cases.
+ * Paramètres :
+ *  g : Le jeu.
+ *  out : Le fichier de sortie.
 
  * Symboles utilisés :
  *  -ENDPOINT : Flèches (`^`, `v`, `>`, `<`) pour indiquer la direction.
  *  -CORNER : Coins (`└`, `┐`, `┌`, `┘`) selon l'orientation.
  *  -SEGMENT : `|` (vertical) ou `-` (horizontal) selon l'orientation.
  *  -TEE : Formes en T (`┴`, `┬`, `├`, `┤`).
-
- * Notes :
- *  -Vérifie que le plateau est valide avant l'affichage.
- *  -Si une orientation invalide est trouvée, le programme s'arrête avec une
- erreur.
  */
 
-void game_print(cgame g) {
-  if (g == NULL) {
+void game_print_to(cgame g, FILE *out) {
+  if (g == NULL || out == NULL) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
 
-  printf("   ");  // Faire un decalage
-  for (uint col = 0; col < g->width; col++) {
-    printf("%d ", col);
+  // une ligne : son numéro, puis au plus 4 octets par case
+  size_t width = g->width;
+  size_t cap = INDEX_LEN * width + INDEX_LEN + 8;
+  char *line = malloc(cap);
+  if (line == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
   }
-  printf("\n");
 
-  printf("   ");  // Faire un decalage
-  for (uint col = 0; col < g->width; col++) {
-    printf("--");
-  }
-  printf("\n");
-
-  for (int i = 0; i < g->height; i++) {
-    printf("%d |", i);
-    for (int j = 0; j < g->width; j++) {
-      switch (g->cases[i * g->width + j].shape) {
-        case ENDPOINT:
-          switch (g->cases[i * g->width + j].orientation) {
-            case NORTH:
-              printf("^ ");
-              break;
-
-            case SOUTH:
-              printf("v ");
-              break;
-
-            case EAST:
-              printf("> ");
-              break;
-
-            case WEST:
-              printf("< ");
-              break;
-
-            case NB_DIRS:
-              exit(EXIT_FAILURE);
-              break;
-          }
-          break;
-
-        case CORNER:
-
-          switch (g->cases[i * g->width + j].orientation) {
-            case NORTH:
-              printf("└ ");
-              break;
-
-            case SOUTH:
-              printf("┐ ");
-              break;
-
-            case EAST:
-              printf("┌ ");
-              break;
-
-            case WEST:
-              printf("┘ ");
-              break;
-
-            case NB_DIRS:
-              exit(EXIT_FAILURE);
-              break;
-          }
-          break;
-
-        case SEGMENT:
-          switch (g->cases[i * g->width + j].orientation) {
-            case NORTH:
-              printf("| ");
-              break;
-
-            case SOUTH:
-              printf("| ");
-              break;
-
-            case EAST:
-              printf("- ");
-              break;
-
-            case WEST:
-              printf("- ");
-              break;
-
-            case NB_DIRS:
-              exit(EXIT_FAILURE);
-              break;
-          }
-          break;
-
-        case TEE:
-          switch (g->cases[i * g->width + j].orientation) {
-            case NORTH:
-              printf("┴ ");
-              break;
-
-            case SOUTH:
-              printf("┬ ");
-              break;
-
-            case EAST:
-              printf("├ ");
-              break;
-
-            case WEST:
-              printf("┤ ");
-              break;
-
-            case NB_DIRS:
-              exit(EXIT_FAILURE);
-              break;
-          }
-          break;
-
-        case CROSS:
-          printf("+ ");
-          break;
-        default:
-          printf("  ");  // Faire un decalage
-          break;
-      }
+  size_t len = 3;
+  memcpy(line, "   ", 3);  // Faire un decalage
+  for (uint col = 0; col < width; col++)
+    len += snprintf(line + len, cap - len, "%u ", col);
+  line[len++] = '\n';
+  fwrite(line, 1, len, out);
+
+  char *border = line;
+  memcpy(border, "   ", 3);  // Faire un decalage
+  memset(border + 3, '-', 2 * width);
+  border[3 + 2 * width] = '\n';
+  fwrite(border, 1, 4 + 2 * width, out);
+
+  for (uint i = 0; i < g->height; i++) {
+    len = snprintf(line, cap, "%u |", i);
+    const Acase *row = g->cases + i * width;
+    for (size_t j = 0; j < width; j++) {
+      assert(row[j].shape < NB_SHAPES && row[j].orientation < NB_DIRS);
+      const glyph *gl = &GLYPHS[row[j].shape][row[j].orientation];
+      memcpy(line + len, gl->text, 4);  // le tampon a toujours 4 octets libres
+      len += gl->len;
     }
-    printf("|\n");
-  }
-  printf("   ");  // Faire un decalage
-  for (uint col = 0; col < g->width; col++) {
-    printf("--");
+    memcpy(line + len, "|\n", 2);
+    fwrite(line, 1, len + 2, out);
   }
-  printf("\n");
+
+  memcpy(border, "   ", 3);  // Faire un decalage
+  memset(border + 3, '-', 2 * width);
+  border[3 + 2 * width] = '\n';
+  fwrite(border, 1, 4 + 2 * width, out);
+  free(line);
 }
 
+/**
+ * Fonction : game_print
+
+ * Affiche le plateau de jeu sur la sortie standard (voir game_print_to).
+ */
+
+void game_print(cgame g) { game_print_to(g, stdout); }
+
 /**
  * Fonction : game_default
 
@@ -211,8 +148,8 @@ game game_default(void) {
 
   for (int i = 0; i < 5; i++) {
     for (int j = 0; j < 5; j++) {
-      game_set_piece_shape(g, i, j, shapes[i * 5 + j]);
-      game_set_piece_orientation(g, i, j, orientations[i * 5 + j]);
+      _set_shape(g, i, j, shapes[i * 5 + j]);
+      _set_orientation(g, i, j, orientations[i * 5 + j]);
     }
   }
 
@@ -248,8 +185,8 @@ game game_default_solution(void) {
 
   for (int i = 0; i < 5; i++) {
     for (int j = 0; j < 5; j++) {
-      game_set_piece_shape(g, i, j, shapes[i * 5 + j]);
-      game_set_piece_orientation(g, i, j, orientations[i * 5 + j]);
+      _set_shape(g, i, j, shapes[i * 5 + j]);
+      _set_orientation(g, i, j, orientations[i * 5 + j]);
     }
   }
 
@@ -288,31 +225,173 @@ int DIR2OFFSET[][2] = {
 
 /* ************************************************************************** */
 
+neighbours* _neighbours_new(uint height, uint width, bool wrapping,
+                            const game_allocator* a) {
+  size_t nb_squares = (size_t)height * width;
+  neighbours* t = _game_malloc(
+      a, sizeof(neighbours) + nb_squares * NB_DIRS * sizeof(uint),
+      sizeof(void*));
+  if (t == NULL) return NULL;
+  t->allocator = *a;
+  t->height = height;
+  t->width = width;
+  t->wrapping = wrapping;
+  t->refcount = 1;
+
+  for (uint i = 0; i < height; i++)
+    for (uint j = 0; j < width; j++)
+      for (direction d = 0; d < NB_DIRS; d++) {
+        // move to the next square in a given direction
+        int ii = i + DIR2OFFSET[d][0];
+        int jj = j + DIR2OFFSET[d][1];
+        if (wrapping) {
+          ii = (ii + height) % height;
+          jj = (jj + width) % width;
+        }
+        bool out = ii < 0 || ii >= (int)height || jj < 0 || jj >= (int)width;
+        t->next[((size_t)i * width + j) * NB_DIRS + d] =
+            out ? NO_NEIGHBOUR : (uint)ii * width + jj;
+      }
+  return t;
+}
+
+/* ************************************************************************** */
+
+void _neighbours_release(neighbours* t) {
+  if (t != NULL && __atomic_sub_fetch(&t->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    _game_free(&t->allocator, t,
+               sizeof(neighbours) +
+                   (size_t)t->height * t->width * NB_DIRS * sizeof(uint));
+}
+
+/* ************************************************************************** */
+
+neighbours* _neighbours_share(neighbours* t) {
+  __atomic_add_fetch(&t->refcount, 1, __ATOMIC_RELAXED);
+  return t;
+}
+
+/* ************************************************************************** */
+
+static bool _neighbours_match(const neighbours* t, cgame g) {
+  return t != NULL && t->wrapping == g->isWrapping && t->height == g->height &&
+         t->width == g->width;
+}
+
+bool _game_update_neighbours(game g) {
+  if (_neighbours_match(g->nbrs, g)) return true;
+  neighbours* t =
+      _neighbours_new(g->height, g->width, g->isWrapping, &g->allocator);
+  if (t == NULL) return false;
+  _neighbours_release(g->nbrs);
+  g->nbrs = t;
+  return true;
+}
+
+/* ************************************************************************** */
+
+/* données propres à chaque thread, libérées à la fin du thread : la table de
+ * secours de _neighbours_fallback et le tampon de _thread_scratch */
+typedef struct {
+  neighbours* fallback;
+  void* scratch;
+  size_t scratch_size;
+} thread_data;
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+static void _thread_data_free(void* data) {
+  thread_data* d = data;
+  game_allocator std = _game_std_allocator();
+  _neighbours_release(d->fallback);
+  _game_free(&std, d->scratch, d->scratch_size);
+  free(d);
+}
+
+static void _thread_key_init(void) {
+  if (pthread_key_create(&thread_key, _thread_data_free) != 0) {
+    fprintf(stderr, "Error: unable to create a thread key.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static thread_data* _thread_data(void) {
+  pthread_once(&thread_once, _thread_key_init);
+  thread_data* d = pthread_getspecific(thread_key);
+  if (d == NULL) {
+    d = calloc(1, sizeof(thread_data));
+    if (d == NULL || pthread_setspecific(thread_key, d) != 0) {
+      fprintf(stderr, "Error: NULL pointer detected.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return d;
+}
+
+/* tampon de travail du thread appelant, d'au moins size octets, agrandi
+ * seulement s'il est trop petit */
+static void* _thread_scratch(size_t size) {
+  thread_data* d = _thread_data();
+  if (d->scratch_size < size) {
+    game_allocator std = _game_std_allocator();
+    _game_free(&std, d->scratch, d->scratch_size);
+    d->scratch = _game_malloc(&std, size, sizeof(uint));
+    d->scratch_size = size;
+    if (d->scratch == NULL) {
+      fprintf(stderr, "Error: NULL pointer detected.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return d->scratch;
+}
+
+const uint* _neighbours_fallback(cgame g) {
+  thread_data* d = _thread_data();
+  if (!_neighbours_match(d->fallback, g)) {
+    // l'allocateur du jeu pourrait disparaître avant le thread
+    game_allocator std = _game_std_allocator();
+    _neighbours_release(d->fallback);
+    d->fallback = _neighbours_new(g->height, g->width, g->isWrapping, &std);
+    if (d->fallback == NULL) {
+      fprintf(stderr, "Error: NULL pointer detected.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return d->fallback->next;
+}
+
+/* ************************************************************************** */
+
+bool _game_share_neighbours(game g, cgame src) {
+  neighbours* t;
+  if (_allocator_equal(&g->allocator, &src->allocator) &&
+      _neighbours_match(src->nbrs, src)) {
+    t = _neighbours_share(src->nbrs);
+  } else {
+    // une table ne doit pas survivre à l'allocateur qui l'a créée
+    t = _neighbours_new(src->height, src->width, src->isWrapping,
+                        &g->allocator);
+    if (t == NULL) return false;
+  }
+  _neighbours_release(g->nbrs);
+  g->nbrs = t;
+  return true;
+}
+
+/* ************************************************************************** */
+
 bool game_get_ajacent_square(cgame g, uint i, uint j, direction d,  //
                              uint* pi_next, uint* pj_next) {
   assert(g);
   assert(i < game_nb_rows(g));
   assert(j < game_nb_cols(g));
 
-  // convert direction to offset
-  int i_offset = DIR2OFFSET[d][0];
-  int j_offset = DIR2OFFSET[d][1];
-
-  // move to the next square in a given direction
-  int ii = i + i_offset;
-  int jj = j + j_offset;
-
-  if (game_is_wrapping(g)) {
-    ii = (ii + game_nb_rows(g)) % game_nb_rows(g);
-    jj = (jj + game_nb_cols(g)) % game_nb_cols(g);
-  }
+  uint next = _game_neighbours(g)[_index(g, i, j) * NB_DIRS + d];
+  if (next == NO_NEIGHBOUR) return false;
 
-  // check if next square at (ii,jj) is out of grid
-  if (ii < 0 || ii >= (int)game_nb_rows(g)) return false;
-  if (jj < 0 || jj >= (int)game_nb_cols(g)) return false;
-
-  *pi_next = ii;
-  *pj_next = jj;
+  *pi_next = next / g->width;
+  *pj_next = next % g->width;
 
   return true;
 }
@@ -339,36 +418,14 @@ bool game_get_ajacent_square(cgame g, uint i, uint j, direction d,  //
  invalides.
  */
 
-static bool has_half_edge(shape s, direction o, direction d) {
-  switch (s) {
-    case EMPTY:
-      return false;
-    case ENDPOINT:
-      return (d == o);
-    case SEGMENT:
-      return (d == o || d == OPPOSITE_DIR(o));
-    case TEE:
-      return (d != OPPOSITE_DIR(o));
-    case CORNER:
-      return (d == o || d == NEXT_DIR_CW(o));
-    case CROSS:
-      return true;
-    default:
-      assert(true);
-      return false;
-  }
-}
-
 /* ************************************************************************** */
 
 bool game_has_half_edge(cgame g, uint i, uint j, direction d) {
-  assert(g);
-  assert(i < game_nb_rows(g));
-  assert(j < game_nb_cols(g));
-  assert(d >= 0 && d < NB_DIRS);
-  shape s = game_get_piece_shape(g, i, j);
-  direction o = game_get_piece_orientation(g, i, j);
-  return has_half_edge(s, o, d);
+  if (g == NULL || i >= g->height || j >= g->width || d >= NB_DIRS) {
+    fprintf(stderr, "Error\n");
+    exit(EXIT_FAILURE);
+  }
+  return _has_half_edge(g->cases[_index(g, i, j)], d);
 }
 
 /**
@@ -395,24 +452,17 @@ bool game_has_half_edge(cgame g, uint i, uint j, direction d) {
  */
 
 edge_status game_check_edge(cgame g, uint i, uint j, direction d) {
-  bool he = game_has_half_edge(g, i, j, d);
-  uint nexti, nextj;
-  bool next = game_get_ajacent_square(g, i, j, d, &nexti, &nextj);
+  if (g == NULL || i >= g->height || j >= g->width || d >= NB_DIRS) {
+    fprintf(stderr, "Error\n");
+    exit(EXIT_FAILURE);
+  }
 
   /* The status can be simply computed based on the number of half-hedges:
    *  - 0: no edge
    *  - 1: mismatched edge
    *  - 2: well-matched edge
    */
-
-  edge_status status = NOEDGE;
-  if (he) status += 1;
-  if (next) {
-    bool nexthe = game_has_half_edge(g, nexti, nextj, OPPOSITE_DIR(d));
-    if (nexthe) status += 1;
-  }
-
-  return status;
+  return _check_edge(g, _index(g, i, j), d);
 }
 
 /**
@@ -440,13 +490,18 @@ bool game_is_well_paired(cgame g) {
     exit(EXIT_FAILURE);
   }
 
-  for (uint i = 0; i < g->height; i++) {
-    for (uint j = 0; j < g->width; j++) {
-      for (direction d = 0; d < NB_DIRS; d++) {
-        if (game_check_edge(g, i, j, d) == MISMATCH) {
-          return false;
-        }
-      }
+  const uint* nbrs = _game_neighbours(g);
+  size_t nb_squares = (size_t)g->height * g->width;
+  for (size_t k = 0; k < nb_squares; k++) {
+    uint8_t he = _half_edges(g->cases[k]);
+    if (he == 0) continue;
+    for (direction d = 0; d < NB_DIRS; d++) {
+      // une demi-arête doit faire face à une demi-arête (MISMATCH sinon)
+      if (!(he & HALF_EDGE_BIT(d))) continue;
+      uint next = nbrs[k * NB_DIRS + d];
+      if (next == NO_NEIGHBOUR ||
+          !_has_half_edge(g->cases[next], OPPOSITE_DIR(d)))
+        return false;
     }
   }
   return true;
@@ -455,93 +510,69 @@ bool game_is_well_paired(cgame g) {
 /**
  * Fonction : game_is_connected
 
- * Vérifie si le jeu est connecté, c'est-à-dire si toutes les arêtes sont bien
- appariées.
+ * Vérifie si le jeu est connecté, c'est-à-dire si toutes les pièces forment un
+ seul réseau.
 
  * Paramètres : g : Le jeu actuel (cgame).
 
  * Retour :
- *  -true si toutes les arêtes du jeu sont correctement appariées (le jeu est
- connecté).
+ *  -true si les arêtes sont bien appariées et relient toutes les pièces.
  *  -false sinon.
  *
  * Comportement :
  *  -Appelle la fonction game_is_well_paired pour vérifier que toutes les arêtes
- sont bien appariées.
- *  -Retourne false si des arêtes sont mal appariées, sinon true.
+ sont bien appariées, puis _game_is_connected.
  */
 
-/* square colors used in BFS algorithm */
-typedef enum {
-  WHITE, /* square not yet visited  */
-  GRAY,  /* square partially visited */
-  BLACK, /* square fully visited (included all its neighbors) */
-} bfscolor;
-
 bool game_is_connected(cgame g) {
-  /* In this algorithm, we assume all pieces are well paired (no edge mismatch).
-   */
-
   assert(g);
-  uint nb_cols = game_nb_cols(g);
-  uint nb_rows = game_nb_rows(g);
-
   // check precondition, but it should be already checked by the caller!
   if (!game_is_well_paired(g)) return false;
+  return _game_is_connected(g);
+}
 
-  /* initialize visited array */
-  bfscolor visited[nb_rows][nb_cols];
-  for (uint i = 0; i < nb_rows; i++)
-    for (uint j = 0; j < nb_cols; j++) {
-      shape s = game_get_piece_shape(g, i, j);
-      visited[i][j] = WHITE;
-      if (s == EMPTY) visited[i][j] = BLACK;
-    }
+/* ************************************************************************** */
 
-  /* lookup for a first square to start BFS */
-  bool start_found = false;
-  for (uint i = 0; i < nb_rows; i++)
-    for (uint j = 0; j < nb_cols; j++) {
-      if (visited[i][j] == WHITE && !start_found) {
-        visited[i][j] = GRAY;
-        start_found = true;
-      }
+bool _game_is_connected(cgame g) {
+  /* Single BFS from the first piece, following the matched edges: each square
+   * enters the queue at most once, so this is linear in the grid size. */
+  assert(g);
+  const uint* nbrs = _game_neighbours(g);
+  size_t nb_squares = (size_t)game_nb_rows(g) * game_nb_cols(g);
+
+  /* lookup for a first square to start BFS, and count the pieces */
+  size_t nb_pieces = 0, start = nb_squares;
+  for (size_t k = 0; k < nb_squares; k++)
+    if (g->cases[k].shape != EMPTY) {
+      if (nb_pieces++ == 0) start = k;
     }
+  if (nb_pieces == 0) return true;
 
-  /* BFS Algorithm */
-  bool new_visited = false;
-  do {
-    new_visited = false;
-    for (uint i = 0; i < nb_rows; i++)
-      for (uint j = 0; j < nb_cols; j++)
-        /* if the square (i,j) has been already visited, then we mark all its
-         * connected neighbors as visited...  */
-        if (visited[i][j] == GRAY) {
-          for (direction d = 0; d < NB_DIRS; d++) {
-            if (!game_has_half_edge(g, i, j, d)) continue;
-            uint nexti, nextj;
-            bool next = game_get_ajacent_square(g, i, j, d, &nexti, &nextj);
-            assert(next); /* Always true if the game is well paired! */
-            edge_status es = game_check_edge(g, i, j, d);
-            assert(es == MATCH); /* Always true... */
-
-            if (visited[nexti][nextj] == WHITE) {
-              visited[nexti][nextj] = GRAY;
-              new_visited = true;
-            }
-          }
-          /* now, we will not come back to this square... */
-          visited[i][j] = BLACK;
-        }
-  } while (new_visited == true);
+  /* the queue and the visited flags live in a buffer of the calling thread:
+   * a read of a shared game must not modify it */
+  uint *queue = _thread_scratch(nb_squares * (sizeof(uint) + sizeof(bool)));
+  bool *visited = (bool *)(queue + nb_squares);
+  memset(visited, 0, nb_squares * sizeof(bool));
 
-  // check all squares have been visited
-  for (uint i = 0; i < nb_rows; i++)
-    for (uint j = 0; j < nb_cols; j++) {
-      if (visited[i][j] != BLACK) {
-        return false;
+  /* BFS Algorithm */
+  size_t head = 0, tail = 0;
+  queue[tail++] = start;
+  visited[start] = true;
+  while (head < tail) {
+    uint k = queue[head++];
+    uint8_t he = _half_edges(g->cases[k]);
+    for (direction d = 0; d < NB_DIRS; d++) {
+      if (!(he & HALF_EDGE_BIT(d))) continue;
+      uint next = nbrs[k * NB_DIRS + d];
+      if (next == NO_NEIGHBOUR ||
+          !_has_half_edge(g->cases[next], OPPOSITE_DIR(d)))
+        continue;  // pas une arête (MATCH)
+      if (!visited[next]) {
+        visited[next] = true;
+        queue[tail++] = next;
       }
     }
+  }
 
-  return true;
-}
\ No newline at end of file
+  return tail == nb_pieces;
+}
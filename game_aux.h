@@ -8,6 +8,8 @@
 #ifndef __GAME_AUX_H__
 #define __GAME_AUX_H__
 
+#include <stdio.h>
+
 #include "game_struct.h"
 /**
  * @brief Prints a game as text on the standard output stream.
@@ -18,6 +20,17 @@
  **/
 void game_print(cgame g);
 
+/**
+ * @brief Prints a game as text on a stream.
+ * @details Same output as @ref game_print. Each row is built in a buffer and
+ * written at once, so that large boards are printed quickly.
+ * @param g the game
+ * @param out the output stream
+ * @pre @p g must be a valid pointer toward a game structure.
+ * @pre @p out must be a valid stream.
+ **/
+void game_print_to(cgame g, FILE *out);
+
 /**
  * @brief Creates the default game.
  * @details See the description of the default game in @ref index.
@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "game_aux.h"
+#include "game_ext.h"
+#include "game_timing.h"
+#include "game_tools.h"
+#include "queue.h"
+
+/* ************************************************************************** */
+
+/** print the mean time of a measured loop */
+static void _report(const char *name, double seconds, uint nb_iterations,
+                    size_t nb_squares) {
+  double per_call = seconds / nb_iterations;
+  printf("%-20s %10.3f ms/appel %8.2f ns/case\n", name, per_call * 1e3,
+         per_call * 1e9 / nb_squares);
+}
+
+/* ************************************************************************** */
+
+/** game_won and its two steps on a random solved grid */
+static int _bench_won(uint size, uint nb_iterations) {
+  game g = game_random(size, size, true, 0, 0);
+  if (!g) return EXIT_FAILURE;
+  size_t nb_squares = (size_t)size * size;
+  uint nb_won = 0;
+
+  double start = _now();
+  for (uint k = 0; k < nb_iterations; k++) nb_won += game_won(g);
+  _report("game_won", _now() - start, nb_iterations, nb_squares);
+
+  start = _now();
+  for (uint k = 0; k < nb_iterations; k++) nb_won += game_is_well_paired(g);
+  _report("game_is_well_paired", _now() - start, nb_iterations, nb_squares);
+
+  start = _now();
+  for (uint k = 0; k < nb_iterations; k++) nb_won += game_is_connected(g);
+  _report("game_is_connected", _now() - start, nb_iterations, nb_squares);
+
+  game_delete(g);
+  return nb_won == 3 * nb_iterations ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+/** game_copy (one allocation) against game_copy_into (none) */
+static int _bench_copy(uint size, uint nb_iterations) {
+  game g = game_random(size, size, true, 0, 0);
+  game dst = game_new_empty_ext(size, size, false);
+  if (!g || !dst) return EXIT_FAILURE;
+  size_t nb_squares = (size_t)size * size;
+
+  double start = _now();
+  for (uint k = 0; k < nb_iterations; k++) game_delete(game_copy(g));
+  _report("game_copy", _now() - start, nb_iterations, nb_squares);
+
+  bool ok = true;
+  start = _now();
+  for (uint k = 0; k < nb_iterations; k++) ok &= game_copy_into(dst, g);
+  _report("game_copy_into", _now() - start, nb_iterations, nb_squares);
+
+  ok &= game_equal(dst, g, false);
+  game_delete(dst);
+  game_delete(g);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+/** game_equal against game_equal_fast and game_hash on equal grids */
+static int _bench_equal(uint size, uint nb_iterations) {
+  game g = game_random(size, size, true, 0, 0);
+  if (!g) return EXIT_FAILURE;
+  game copy = game_copy(g);
+  size_t nb_squares = (size_t)size * size;
+  uint nb_equal = 0;
+
+  double start = _now();
+  for (uint k = 0; k < nb_iterations; k++) nb_equal += game_equal(g, copy, false);
+  _report("game_equal", _now() - start, nb_iterations, nb_squares);
+
+  start = _now();
+  for (uint k = 0; k < nb_iterations; k++)
+    nb_equal += game_equal_fast(g, copy, false);
+  _report("game_equal_fast", _now() - start, nb_iterations, nb_squares);
+
+  game_hash(g, false);  // premier calcul, en O(taille)
+  game_hash(copy, false);
+  start = _now();
+  for (uint k = 0; k < nb_iterations; k++) {
+    game_play_move(copy, k % size, 0, 1);
+    nb_equal += game_hash(copy, false) != game_hash(g, false);
+    game_undo(copy);
+  }
+  _report("coup + game_hash", _now() - start, nb_iterations, nb_squares);
+
+  game_delete(copy);
+  game_delete(g);
+  return nb_equal == 3 * nb_iterations ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+/* Previous queue implementation (one malloc per push, one free per pop), kept
+ * here as a reference for _bench_queue. */
+typedef struct old_element_s {
+  void *data;
+  struct old_element_s *next;
+} old_element;
+
+static void _old_push_head(old_element **head, void *data) {
+  old_element *e = malloc(sizeof(old_element));
+  e->data = data;
+  e->next = *head;
+  *head = e;
+}
+
+static void *_old_pop_head(old_element **head) {
+  old_element *e = *head;
+  void *data = e->data;
+  *head = e->next;
+  free(e);
+  return data;
+}
+
+/** history-like workload: push then pop <size> elements, repeatedly */
+static int _bench_queue(uint size, uint nb_iterations) {
+  uintptr_t sum = 0;
+  old_element *old = NULL;
+  double start = _now();
+  for (uint k = 0; k < nb_iterations; k++) {
+    for (uint n = 0; n < size; n++) _old_push_head(&old, (void *)(uintptr_t)n);
+    for (uint n = 0; n < size; n++) sum += (uintptr_t)_old_pop_head(&old);
+  }
+  _report("ancienne file", _now() - start, nb_iterations, size);
+
+  queue *list = queue_new();
+  queue *ring = queue_new_contiguous();
+  queue *queues[] = {list, ring};
+  const char *names[] = {"liste (pool)", "tableau circulaire"};
+  for (uint q = 0; q < 2; q++) {
+    start = _now();
+    for (uint k = 0; k < nb_iterations; k++) {
+      for (uint n = 0; n < size; n++)
+        queue_push_head(queues[q], (void *)(uintptr_t)n);
+      for (uint n = 0; n < size; n++)
+        sum += (uintptr_t)queue_pop_head(queues[q]);
+    }
+    _report(names[q], _now() - start, nb_iterations, size);
+  }
+  queue_free(list);
+  queue_free(ring);
+  uintptr_t expected = 3 * (uintptr_t)nb_iterations * size * (size - 1) / 2;
+  return sum == expected ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+/** game_load of a saved random grid, and game_load_mem of the same text */
+static int _bench_load(uint size, uint nb_iterations) {
+  const char *filename = "game_bench_load.txt";
+  game g = game_random(size, size, true, 0, 0);
+  if (!g) return EXIT_FAILURE;
+  game_save(g, (char *)filename);
+  size_t nb_squares = (size_t)size * size;
+  bool ok = true;
+
+  double start = _now();
+  for (uint k = 0; k < nb_iterations; k++) {
+    game h = game_load((char *)filename);
+    ok &= h != NULL;
+    game_delete(h);
+  }
+  _report("game_load", _now() - start, nb_iterations, nb_squares);
+
+  FILE *file = fopen(filename, "r");
+  char *text = malloc(4 * nb_squares + 64);
+  size_t len = file && text ? fread(text, 1, 4 * nb_squares + 64, file) : 0;
+  if (file) fclose(file);
+  start = _now();
+  for (uint k = 0; k < nb_iterations; k++) {
+    game h = game_load_mem(text, len);
+    ok &= h != NULL && game_equal(h, g, false);
+    game_delete(h);
+  }
+  _report("game_load_mem", _now() - start, nb_iterations, nb_squares);
+
+  free(text);
+  remove(filename);
+  game_delete(g);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+/** print the percentiles of a set of measures (sorted in place) */
+static void _report_percentiles(const char *name, double *seconds, uint nb) {
+  printf("%-20s (ms)", name);
+  _print_percentiles(stdout, seconds, nb, 1e3);
+  printf("\n");
+}
+
+/** game_solve on shuffled random grids, one per iteration: the tail of the
+ * distribution shows the effect of the restarts */
+static int _bench_solve(uint size, uint nb_iterations) {
+  double *seconds = malloc(nb_iterations * sizeof(double));
+  if (!seconds) return EXIT_FAILURE;
+  uint64_t nb_restarts = 0, nb_fails = 0;
+  uint nb_restarted = 0;
+  bool ok = true;
+  for (uint k = 0; k < nb_iterations && ok; k++) {
+    game g = game_random(size, size, k % 2, 0, size / 3);
+    if (!g) {
+      ok = false;
+      break;
+    }
+    game_shuffle_orientation(g);
+    solve_stats stats;
+    double start = _now();
+    ok = game_solve_stats(g, &stats);
+    seconds[k] = _now() - start;
+    ok = ok && game_won(g);
+    nb_restarts += stats.nb_restarts;
+    nb_restarted += stats.nb_restarts > 0;
+    nb_fails += stats.nb_fails;
+    game_delete(g);
+  }
+  if (ok) {
+    _report_percentiles("game_solve", seconds, nb_iterations);
+    printf("%u grilles sur %u relancées (%.2f restarts, %.1f échecs en "
+           "moyenne)\n",
+           nb_restarted, nb_iterations, (double)nb_restarts / nb_iterations,
+           (double)nb_fails / nb_iterations);
+  }
+  free(seconds);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+/** game_rate_difficulty on shuffled random grids (e.g. size 7), generated
+ * before the measure so that only the ratings are timed */
+static int _bench_rate(uint size, uint nb_iterations) {
+  game *games = calloc(nb_iterations, sizeof(game));
+  if (!games) return EXIT_FAILURE;
+  bool ok = true;
+  for (uint k = 0; k < nb_iterations && ok; k++) {
+    games[k] = game_random(size, size, k % 2, 0, size / 3);
+    ok = games[k] != NULL;
+    if (ok) game_shuffle_orientation(games[k]);
+  }
+
+  uint nb_levels[NB_DIFFICULTIES] = {0};
+  uint64_t nb_rounds = 0;
+  if (ok) {
+    double start = _now();
+    for (uint k = 0; k < nb_iterations; k++) {
+      rating r = game_rate_difficulty(games[k]);
+      nb_levels[r.level]++;
+      nb_rounds += r.nb_rounds;
+    }
+    double seconds = _now() - start;
+    _report("game_rate_difficulty", seconds, nb_iterations,
+            (size_t)size * size);
+    printf("%.0f notations/s, %.1f tours en moyenne, niveaux :",
+           nb_iterations / seconds, (double)nb_rounds / nb_iterations);
+    for (uint l = 0; l < NB_DIFFICULTIES; l++) printf(" %u", nb_levels[l]);
+    printf("\n");
+  }
+
+  for (uint k = 0; k < nb_iterations; k++) game_delete(games[k]);
+  free(games);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+static void usage(char *argv[]) {
+  fprintf(stderr, "Usage: %s won|copy|equal|queue|load|solve|rate [<size>] [<nb_iterations>]\n", argv[0]);
+  exit(EXIT_FAILURE);
+}
+
+/* ************************************************************************** */
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) usage(argv);
+  uint size = argc > 2 ? atoi(argv[2]) : 1000;
+  uint nb_iterations = argc > 3 ? atoi(argv[3]) : 10;
+  if (size == 0 || nb_iterations == 0) usage(argv);
+  srand(42);
+
+  if (strcmp(argv[1], "won") == 0) return _bench_won(size, nb_iterations);
+  if (strcmp(argv[1], "copy") == 0) return _bench_copy(size, nb_iterations);
+  if (strcmp(argv[1], "equal") == 0) return _bench_equal(size, nb_iterations);
+  if (strcmp(argv[1], "queue") == 0) return _bench_queue(size, nb_iterations);
+  if (strcmp(argv[1], "load") == 0) return _bench_load(size, nb_iterations);
+  if (strcmp(argv[1], "solve") == 0) return _bench_solve(size, nb_iterations);
+  if (strcmp(argv[1], "rate") == 0) return _bench_rate(size, nb_iterations);
+  usage(argv);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "game_archive.h"
+#include "game_ext.h"
+#include "game_tools.h"
+
+/* ************************************************************************** */
+
+/** a file is in the binary format if it starts with the magic "NETB" */
+static bool _is_binary(const char *filename) {
+  char magic[4];
+  FILE *file = fopen(filename, "rb");
+  if (!file) return false;
+  bool binary = fread(magic, 1, 4, file) == 4 && memcmp(magic, "NETB", 4) == 0;
+  fclose(file);
+  return binary;
+}
+
+/** the output is in the binary format if its name ends with ".bin" */
+static bool _has_bin_extension(const char *filename) {
+  size_t len = strlen(filename);
+  return len >= 4 && strcmp(filename + len - 4, ".bin") == 0;
+}
+
+static game _load(char *filename) {
+  game g = _is_binary(filename) ? game_load_bin(filename) : game_load(filename);
+  if (!g) fprintf(stderr, "Erreur : impossible de charger %s\n", filename);
+  return g;
+}
+
+static bool _save(cgame g, char *filename) {
+  if (_has_bin_extension(filename)) return game_save_bin(g, filename);
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd >= 0 && game_save_fd(g, fd);
+  if (fd >= 0 && close(fd) != 0) ok = false;
+  return ok;
+}
+
+/** parse a board id: a decimal number, without sign nor trailing text */
+static bool _parse_id(const char *s, uint64_t *id) {
+  char *end;
+  errno = 0;
+  unsigned long long n = strtoull(s, &end, 10);
+  if (s[0] < '0' || s[0] > '9' || *end != '\0' || errno) return false;
+  *id = n;
+  return true;
+}
+
+/* ************************************************************************** */
+
+static int _convert(char *input, char *output) {
+  game g = _load(input);
+  if (!g) return EXIT_FAILURE;
+  bool ok = _save(g, output);
+  game_delete(g);
+  if (!ok) fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", output);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+static int _append(char *archive, int nb_inputs, char *inputs[]) {
+  game_archive *a = game_archive_open(archive, true);
+  if (!a) {
+    fprintf(stderr, "Erreur : archive invalide %s\n", archive);
+    return EXIT_FAILURE;
+  }
+  bool ok = true;
+  for (int k = 0; k < nb_inputs && ok; k++) {
+    game g = _load(inputs[k]);
+    ok = g && game_archive_append(a, g) != UINT64_MAX;
+    game_delete(g);
+  }
+  if (!game_archive_close(a) || !ok) {
+    fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", archive);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/* ************************************************************************** */
+
+static int _extract(char *archive, char *id, char *output) {
+  uint64_t n;
+  if (!_parse_id(id, &n)) {
+    fprintf(stderr, "Erreur : numéro de plateau invalide %s\n", id);
+    return EXIT_FAILURE;
+  }
+  game_archive *a = game_archive_open(archive, false);
+  if (!a) {
+    fprintf(stderr, "Erreur : archive invalide %s\n", archive);
+    return EXIT_FAILURE;
+  }
+  game g = game_archive_get(a, n);
+  game_archive_close(a);
+  if (!g) {
+    fprintf(stderr, "Erreur : plateau %s introuvable dans %s\n", id, archive);
+    return EXIT_FAILURE;
+  }
+  bool ok = _save(g, output);
+  game_delete(g);
+  if (!ok) fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", output);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+static int _list(char *archive) {
+  game_archive *a = game_archive_open(archive, false);
+  if (!a) {
+    fprintf(stderr, "Erreur : archive invalide %s\n", archive);
+    return EXIT_FAILURE;
+  }
+  printf("Nombre de plateaux : %" PRIu64 "\n", game_archive_size(a));
+  game_archive_close(a);
+  return EXIT_SUCCESS;
+}
+
+/* ************************************************************************** */
+
+static void usage(char *argv[]) {
+  fprintf(stderr,
+          "Usage: %s <input> <output>\n"
+          "  <input> <output>                 convert a game (text or binary,\n"
+          "                                   binary if <output> ends with .bin)\n"
+          "  -a <archive> <input> [<...>]     append games to an archive\n"
+          "  -x <archive> <id> <output>       extract a game from an archive\n"
+          "  -l <archive>                     print the number of games\n",
+          argv[0]);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 3 && strcmp(argv[1], "-l") == 0) {
+    return _list(argv[2]);
+  } else if (argc >= 4 && strcmp(argv[1], "-a") == 0) {
+    return _append(argv[2], argc - 3, argv + 3);
+  } else if (argc == 5 && strcmp(argv[1], "-x") == 0) {
+    return _extract(argv[2], argv[3], argv[4]);
+  } else if (argc == 3 && argv[1][0] != '-') {
+    return _convert(argv[1], argv[2]);
+  }
+  usage(argv);
+  return EXIT_FAILURE;
+}
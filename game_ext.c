@@ -8,6 +8,7 @@
 
 #include "game.h"
 #include "game_aux.h"
+#include "game_private.h"
 #include "game_struct.h"
 #include "queue.h"
 
@@ -27,36 +28,30 @@
  */
 
 game game_new_empty_ext(uint nb_rows, uint nb_cols, bool wrapping) {
-  if (nb_cols < 1 || nb_cols > 10 || nb_rows < 1 || nb_rows > 10) {
+  // taille limitée par MAX_SQUARES pour que les indices tiennent dans un uint
+  if (nb_cols < 1 || nb_rows < 1 || nb_rows > MAX_SQUARES / nb_cols) {
     fprintf(stderr, "Error sur les paramètres\n");
     return NULL;
   }
+  size_t nb_squares = (size_t)nb_rows * nb_cols;
 
-  game g = malloc(sizeof(struct game_s));
+  // un seul bloc pour le jeu, son historique et ses cases
+  game g = _game_alloc(nb_rows, nb_cols);
   if (g == NULL) {
     fprintf(stderr, "Error d'allocation\n");
     return NULL;
   }
-
-  g->width = nb_cols;
-  g->height = nb_rows;
-  g->cases = malloc(nb_rows * nb_cols * sizeof(Acase));
-  if (g->cases == NULL) {
-    return NULL;
-  }
   g->isWrapping = wrapping;
 
-  g->do_queue = queue_new();
-  g->undo_queue = queue_new();
-  if (g->do_queue == NULL || g->undo_queue == NULL) {
+  g->nbrs = _neighbours_new(nb_rows, nb_cols, wrapping, &g->allocator);
+  if (g->nbrs == NULL) {
+    game_delete(g);
     return NULL;
   }
   // assigner les shapes et les orientations
-  for (int i = 0; i < nb_rows; i++) {
-    for (int j = 0; j < nb_cols; j++) {
-      g->cases[i * g->width + j].shape = EMPTY;
-      g->cases[i * g->width + j].orientation = NORTH;
-    }
+  for (size_t k = 0; k < nb_squares; k++) {
+    g->cases[k].shape = EMPTY;
+    g->cases[k].orientation = NORTH;
   }
   return g;
 }
@@ -82,50 +77,340 @@ game game_new_empty_ext(uint nb_rows, uint nb_cols, bool wrapping) {
 
 game game_new_ext(uint nb_rows, uint nb_cols, shape *shapes,
                   direction *orientations, bool wrapping) {
-  if (nb_cols < 1 || nb_cols > 10 || nb_rows < 1 || nb_rows > 10) {
+  game g = game_new_empty_ext(nb_rows, nb_cols, wrapping);
+  if (g == NULL) {
     return NULL;
   }
+  size_t nb_squares = (size_t)nb_rows * nb_cols;
 
   if (shapes != NULL) {
-    for (int i = 0; i < nb_rows * nb_cols; i++) {
-      if (shapes[i] < 0 || shapes[i] >= NB_SHAPES) {
+    for (size_t k = 0; k < nb_squares; k++) {
+      if (shapes[k] < 0 || shapes[k] >= NB_SHAPES) {
+        game_delete(g);
         return NULL;
       }
+      g->cases[k].shape = shapes[k];
     }
   }
 
   if (orientations != NULL) {
-    for (int i = 0; i < nb_rows * nb_cols; i++) {
-      if (orientations[i] < 0 || orientations[i] >= NB_DIRS) {
+    for (size_t k = 0; k < nb_squares; k++) {
+      if (orientations[k] < 0 || orientations[k] >= NB_DIRS) {
+        game_delete(g);
         return NULL;
       }
+      g->cases[k].orientation = orientations[k];
     }
   }
 
-  game g = game_new_empty_ext(nb_rows, nb_cols, wrapping);
+  return g;
+}
+
+/**
+ * Fonction : game_copy_into
+
+ * Copie un jeu dans un jeu existant, en réutilisant sa mémoire : les cases
+ * sont recopiées dans le bloc de dst s'il est assez grand, sinon dans un
+ * tableau à part. L'historique de dst est vidé.
+
+ * Paramètres :
+ *  dst : Le jeu à écraser.
+ *  src : Le jeu à copier.
+
+ * Retour : true en cas de succès, false en cas d'erreur (dst est inchangé).
+ */
+
+bool game_copy_into(game dst, cgame src) {
+  if (dst == NULL || src == NULL) {
+    return false;
+  }
+  if (dst == src) {
+    return true;
+  }
+  size_t nb_squares = (size_t)src->height * src->width;
+
+  // cases de dst : dans son bloc si elles y tiennent, sinon dans un tableau à
+  // part qui n'est réalloué que s'il est trop petit
+  Acase *cases = dst->inline_cases;
+  size_t extra_capacity = 0;
+  if (nb_squares > dst->capacity) {
+    cases = dst->cases;
+    extra_capacity = dst->extra_capacity;
+    if (nb_squares > extra_capacity) {
+      cases = _game_malloc(&dst->allocator, nb_squares * sizeof(Acase),
+                           sizeof(void *));
+      extra_capacity = nb_squares;
+    }
+  }
+  if (cases == NULL || !_game_share_neighbours(dst, src)) {
+    if (cases != NULL && cases != dst->cases && cases != dst->inline_cases) {
+      _game_free(&dst->allocator, cases, extra_capacity * sizeof(Acase));
+    }
+    return false;
+  }
+  if (dst->cases != cases && dst->cases != dst->inline_cases) {
+    _game_free(&dst->allocator, dst->cases,
+               dst->extra_capacity * sizeof(Acase));
+  }
+  dst->cases = cases;
+  dst->extra_capacity = extra_capacity;
+  memcpy(dst->cases, src->cases, nb_squares * sizeof(Acase));
+  _game_share_grid(dst, src);
+
+  dst->height = src->height;
+  dst->width = src->width;
+  dst->isWrapping = src->isWrapping;
+  dst->hash = src->hash;
+  dst->shape_hash = src->shape_hash;
+  dst->hash_valid = src->hash_valid;
+  queue_clear(dst->do_queue);
+  queue_clear(dst->undo_queue);
+  return true;
+}
+
+/**
+ * Fonction : game_hash
+
+ * Calcule le hash de Zobrist d'un jeu. Les hashs des pièces sont conservés
+ * dans le jeu et mis à jour à chaque coup : seul le premier appel après une
+ * modification globale (création, chargement, mélange) parcourt la grille.
+
+ * Paramètres :
+ *  g : Le jeu.
+ *  ignore_orientation : Booléen pour savoir si les orientations doivent être
+ ignorées.
+
+ * Retour : Le hash du jeu.
+ */
+
+uint64_t game_hash(cgame g, bool ignore_orientation) {
   if (g == NULL) {
-    return NULL;
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
   }
+  if (!g->hash_valid) {
+    // les hashs sont un cache : on peut les recalculer même pour un cgame
+    game mg = (game)g;
+    uint64_t hash = 0, shape_hash = 0;
+    size_t nb_squares = (size_t)g->height * g->width;
+    for (size_t k = 0; k < nb_squares; k++) {
+      hash ^= _piece_key(k, g->cases[k]);
+      shape_hash ^= _shape_key(k, g->cases[k].shape);
+    }
+    mg->hash = hash;
+    mg->shape_hash = shape_hash;
+    mg->hash_valid = true;
+  }
+  // la taille et le mode wrapping, avec des codes inutilisés par les pièces
+  uint64_t header = _zobrist(g->height, 30) ^ _zobrist(g->width, 31) ^
+                    (g->isWrapping ? 0x5851f42d4c957f2dULL : 0);
+  return header ^ (ignore_orientation ? g->shape_hash : g->hash);
+}
 
-  for (int i = 0; i < nb_rows; i++) {
-    for (int j = 0; j < nb_cols; j++) {
-      if (shapes == NULL) {
-        g->cases[i * g->width + j].shape = EMPTY;
-      } else {
-        g->cases[i * g->width + j].shape = shapes[i * g->width + j];
-      }
+/**
+ * Fonction : game_equal_fast
 
-      if (orientations == NULL) {
-        g->cases[i * g->width + j].orientation = NORTH;
-      } else {
-        g->cases[i * g->width + j].orientation = orientations[i * g->width + j];
-      }
+ * Compare deux jeux comme game_equal, modes wrapping compris, sans rien
+ * afficher.
+
+ * Retour : true si les jeux sont égaux, sinon false.
+ */
+
+bool game_equal_fast(cgame g1, cgame g2, bool ignore_orientation) {
+  if (g1 == NULL || g2 == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (g1->height != g2->height || g1->width != g2->width ||
+      g1->isWrapping != g2->isWrapping) {
+    return false;
+  }
+  if (g1->hash_valid && g2->hash_valid &&
+      (ignore_orientation ? g1->shape_hash != g2->shape_hash
+                          : g1->hash != g2->hash)) {
+    return false;
+  }
+  size_t nb_squares = (size_t)g1->height * g1->width;
+  if (!ignore_orientation) {
+    return memcmp(g1->cases, g2->cases, nb_squares * sizeof(Acase)) == 0;
+  }
+  for (size_t k = 0; k < nb_squares; k++) {
+    if (g1->cases[k].shape != g2->cases[k].shape) return false;
+  }
+  return true;
+}
+
+/* ************************************************************************** */
+
+static grid_chunk *_grid_chunk_new(const game_allocator *a) {
+  grid_chunk *c = _game_malloc(a, sizeof(grid_chunk), sizeof(void *));
+  if (c == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  c->refcount = 1;
+  c->allocator = *a;
+  return c;
+}
+
+static void _grid_chunk_release(grid_chunk *c) {
+  if (__atomic_sub_fetch(&c->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    _game_free(&c->allocator, c, sizeof(grid_chunk));
+}
+
+static size_t _grid_size(size_t nb_chunks) {
+  return sizeof(struct snapshot_s) + nb_chunks * sizeof(grid_chunk *);
+}
+
+static snapshot _grid_new(uint height, uint width, bool wrapping,
+                          const game_allocator *a) {
+  size_t nb_squares = (size_t)height * width;
+  size_t nb_chunks = (nb_squares + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+  snapshot s = _game_malloc(a, _grid_size(nb_chunks), sizeof(void *));
+  if (s == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  s->refcount = 1;
+  s->allocator = *a;
+  s->height = height;
+  s->width = width;
+  s->wrapping = wrapping;
+  s->hash_valid = false;
+  s->nb_chunks = nb_chunks;
+  return s;
+}
+
+void _grid_release(snapshot s) {
+  if (s == NULL ||
+      __atomic_sub_fetch(&s->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+  for (size_t k = 0; k < s->nb_chunks; k++) _grid_chunk_release(s->chunks[k]);
+  game_allocator allocator = s->allocator;
+  _game_free(&allocator, s, _grid_size(s->nb_chunks));
+}
+
+static bool _is_shared(uint *refcount) {
+  return __atomic_load_n(refcount, __ATOMIC_ACQUIRE) > 1;
+}
+
+/* la grille du jeu, recopiée si elle est partagée avec un snapshot */
+static snapshot _grid_own(game g) {
+  snapshot s = g->grid;
+  if (_is_shared(&s->refcount)) {
+    snapshot copy = _grid_new(s->height, s->width, s->wrapping, &g->allocator);
+    for (size_t k = 0; k < s->nb_chunks; k++) {
+      __atomic_add_fetch(&s->chunks[k]->refcount, 1, __ATOMIC_RELAXED);
+      copy->chunks[k] = s->chunks[k];
     }
+    _grid_release(s);
+    g->grid = s = copy;
   }
+  return s;
+}
 
-  return g;
+void _grid_write(game g, uint sq, Acase c) {
+  snapshot s = _grid_own(g);
+  grid_chunk **chunk = &s->chunks[sq / SNAPSHOT_CHUNK];
+  if (_is_shared(&(*chunk)->refcount)) {
+    grid_chunk *copy = _grid_chunk_new(&g->allocator);
+    memcpy(copy->cases, (*chunk)->cases, sizeof(copy->cases));
+    _grid_chunk_release(*chunk);
+    *chunk = copy;
+  }
+  (*chunk)->cases[sq % SNAPSHOT_CHUNK] = c;
 }
 
+/**
+ * Fonction : game_snapshot
+
+ * Prend un snapshot du jeu : une référence vers sa grille persistante, qui est
+ * construite lors du premier appel.
+
+ * Paramètres : g : Le jeu.
+
+ * Retour : Le snapshot.
+ */
+
+snapshot game_snapshot(cgame g) {
+  if (g == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  // la grille est un cache : on peut la construire même pour un cgame
+  game mg = (game)g;
+  if (g->grid == NULL) {
+    snapshot s = _grid_new(g->height, g->width, g->isWrapping, &g->allocator);
+    size_t nb_squares = (size_t)g->height * g->width;
+    for (size_t k = 0; k < s->nb_chunks; k++) {
+      size_t first = k * SNAPSHOT_CHUNK;
+      size_t len = nb_squares - first < SNAPSHOT_CHUNK ? nb_squares - first
+                                                       : SNAPSHOT_CHUNK;
+      s->chunks[k] = _grid_chunk_new(&g->allocator);
+      memcpy(s->chunks[k]->cases, g->cases + first, len * sizeof(Acase));
+    }
+    mg->grid = s;
+  }
+  snapshot s = g->grid;
+  if (s->wrapping != g->isWrapping || s->hash_valid != g->hash_valid ||
+      (g->hash_valid && s->hash != g->hash)) {
+    s = _grid_own(mg);
+    s->wrapping = g->isWrapping;
+    s->hash_valid = g->hash_valid;
+    s->hash = g->hash;
+    s->shape_hash = g->shape_hash;
+  }
+  __atomic_add_fetch(&s->refcount, 1, __ATOMIC_RELAXED);
+  return s;
+}
+
+/**
+ * Fonction : game_restore
+
+ * Restaure les pièces d'un jeu depuis un snapshot, en ne recopiant que les
+ * morceaux de la grille qui diffèrent.
+
+ * Paramètres :
+ *  g : Le jeu.
+ *  s : Le snapshot, d'un jeu de même taille.
+
+ * Retour : true en cas de succès, sinon false.
+ */
+
+bool game_restore(game g, snapshot s) {
+  if (g == NULL || s == NULL || g->height != s->height ||
+      g->width != s->width) {
+    return false;
+  }
+  bool wrapping = g->isWrapping;
+  g->isWrapping = s->wrapping;
+  if (!_game_update_neighbours(g)) {
+    g->isWrapping = wrapping;
+    return false;
+  }
+  size_t nb_squares = (size_t)g->height * g->width;
+  for (size_t k = 0; k < s->nb_chunks; k++) {
+    if (g->grid && g->grid->chunks[k] == s->chunks[k]) continue;
+    size_t first = k * SNAPSHOT_CHUNK;
+    size_t len = nb_squares - first < SNAPSHOT_CHUNK ? nb_squares - first
+                                                     : SNAPSHOT_CHUNK;
+    memcpy(g->cases + first, s->chunks[k]->cases, len * sizeof(Acase));
+  }
+  __atomic_add_fetch(&s->refcount, 1, __ATOMIC_RELAXED);
+  _grid_release(g->grid);
+  g->grid = s;
+  g->hash_valid = s->hash_valid;
+  g->hash = s->hash;
+  g->shape_hash = s->shape_hash;
+  queue_clear(g->do_queue);
+  queue_clear(g->undo_queue);
+  return true;
+}
+
+void game_snapshot_delete(snapshot s) { _grid_release(s); }
+
+/* ************************************************************************** */
+
 uint game_nb_rows(cgame g) {
   if (g == NULL) {
     return 0;
@@ -181,10 +466,9 @@ void game_undo(game g) {
 
   queue_push_head(g->undo_queue, (void *)(intptr_t)i);
   queue_push_head(g->undo_queue, (void *)(intptr_t)j);
-  queue_push_head(g->undo_queue,
-                  (void *)(intptr_t)game_get_piece_orientation(g, i, j));
+  queue_push_head(g->undo_queue, (void *)(intptr_t)_get_orientation(g, i, j));
 
-  game_set_piece_orientation(g, i, j, dir);
+  _set_orientation(g, i, j, dir);
 }
 
 /**
@@ -209,9 +493,7 @@ void game_redo(game g) {
 
   queue_push_head(g->do_queue, (void *)(intptr_t)i);
   queue_push_head(g->do_queue, (void *)(intptr_t)j);
-  queue_push_head(
-      g->do_queue,
-      (void *)(void *)(intptr_t)game_get_piece_orientation(g, i, j));
+  queue_push_head(g->do_queue, (void *)(intptr_t)_get_orientation(g, i, j));
 
-  game_set_piece_orientation(g, i, j, dir);
+  _set_orientation(g, i, j, dir);
 }
@@ -9,6 +9,7 @@
 #define __GAME_EXT_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "game.h"
 
@@ -32,7 +33,8 @@
  * NULL).
  * @pre @p orientations must be an initialized array of size nb_rows*nb_cols (or
  * NULL).
- * @return the created game
+ * @return the created game, or NULL if a size is zero, if the grid is too large
+ * (see game_new_empty_ext()) or if a shape or an orientation is invalid
  **/
 game game_new_ext(uint nb_rows, uint nb_cols, shape* shapes,
                   direction* orientations, bool wrapping);
@@ -44,10 +46,90 @@ game game_new_ext(uint nb_rows, uint nb_cols, shape* shapes,
  * @param nb_rows number of rows in game
  * @param nb_cols number of columns in game
  * @param wrapping wrapping option
- * @return the created game
+ * @details The grid size is only limited by memory, up to UINT_MAX/8 squares
+ * (so that the index of every square and half-edge fits in an uint).
+ * @return the created game, or NULL if a size is zero, if the grid is too large
+ * or if the allocation fails
  **/
 game game_new_empty_ext(uint nb_rows, uint nb_cols, bool wrapping);
 
+/**
+ * @brief Copies a game into an existing one.
+ * @details Same as @ref game_copy, but the memory of @p dst is reused instead of
+ * allocating a new game: the size, the wrapping option and all the pieces of
+ * @p src are copied, and the history of @p dst is cleared. No allocation is
+ * done when @p src does not have more squares than @p dst had when it was
+ * created, and both games were created with the same allocator (see
+ * game_alloc.h).
+ * @param dst the game to overwrite
+ * @param src the game to copy
+ * @return true on success, false if a pointer is NULL or if the allocation
+ * fails (in that case @p dst is left unchanged)
+ **/
+bool game_copy_into(game dst, cgame src);
+
+/**
+ * @brief Computes a 64-bit hash of a game.
+ * @details The hash depends on the size, the wrapping option and the pieces
+ * (with or without their orientation), so that games equal according to
+ * @ref game_equal_fast have the same hash. It is a Zobrist hash, updated in
+ * O(1) by each move, so that reading it is O(1) (except for the first call
+ * after the game was created, loaded or shuffled, which is O(size)).
+ * @param g the game
+ * @param ignore_orientation if true, the orientation of pieces is ignored
+ * @return the hash
+ * @pre @p g is a valid pointer toward a game structure
+ **/
+uint64_t game_hash(cgame g, bool ignore_orientation);
+
+/**
+ * @brief Tests if two games are equal, without printing anything.
+ * @details Same as @ref game_equal, except that the wrapping options must also
+ * be equal. The pieces are compared with memcmp, after a comparison of the
+ * hashes when both are already known.
+ * @param g1 the first game
+ * @param g2 the second game
+ * @param ignore_orientation if true, the orientation of pieces is ignored
+ * @return true if the two games are equal, false otherwise
+ * @pre @p g1 and @p g2 are valid pointers toward game structures
+ **/
+bool game_equal_fast(cgame g1, cgame g2, bool ignore_orientation);
+
+/**
+ * @brief Opaque snapshot of the pieces of a game (see @ref game_snapshot).
+ **/
+typedef struct snapshot_s* snapshot;
+
+/**
+ * @brief Takes a snapshot of a game.
+ * @details The pieces of the game are kept in a persistent grid, split into
+ * reference-counted chunks shared by the game and its snapshots: a snapshot
+ * costs O(1), and a move only copies the chunk it modifies (the first time it
+ * is modified after a snapshot). The first snapshot of a game builds this grid
+ * in O(size).
+ * @param g the game
+ * @return the snapshot, to be freed with @ref game_snapshot_delete
+ * @pre @p g is a valid pointer toward a game structure
+ **/
+snapshot game_snapshot(cgame g);
+
+/**
+ * @brief Restores the pieces of a game from a snapshot.
+ * @details Only the chunks that differ between the game and the snapshot are
+ * copied. The wrapping option is restored as well, and the history is
+ * cleared. The snapshot can be restored again later.
+ * @param g the game
+ * @param s a snapshot of a game of the same size
+ * @return true on success, false if a pointer is NULL or the sizes differ
+ **/
+bool game_restore(game g, snapshot s);
+
+/**
+ * @brief Deletes a snapshot.
+ * @param s the snapshot (or NULL)
+ **/
+void game_snapshot_delete(snapshot s);
+
 /**
  * @brief Gets the number of rows (or height).
  * @param g the game
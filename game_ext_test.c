@@ -1,7 +1,9 @@
 #include "game_ext.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +11,7 @@
 #include "game.h"
 #include "game_aux.h"
 #include "game_struct.h"
+#include "game_tools.h"
 #include "queue.h"
 
 bool test_game_new_ext() {
@@ -263,6 +266,374 @@ bool test_cross_piece() {
   return true;
 }
 
+bool test_game_neighbours() {
+  game g = game_new_empty_ext(3, 4, false);
+  uint i, j;
+  bool ok = !game_get_ajacent_square(g, 0, 0, NORTH, &i, &j) &&
+            game_get_ajacent_square(g, 2, 3, WEST, &i, &j) && i == 2 && j == 2;
+
+  // Une copie partage la table de l'original
+  game copy = game_copy(g);
+  if (copy->nbrs != g->nbrs || g->nbrs->refcount != 2) ok = false;
+  game_delete(g);
+  if (copy->nbrs->refcount != 1) ok = false;
+
+  // Les lectures suivent un changement direct du mode wrapping, sans modifier
+  // le jeu
+  neighbours *t = copy->nbrs;
+  copy->isWrapping = true;
+  if (!game_get_ajacent_square(copy, 0, 0, NORTH, &i, &j) || i != 2 || j != 0)
+    ok = false;
+  if (!game_get_ajacent_square(copy, 1, 3, EAST, &i, &j) || i != 1 || j != 0)
+    ok = false;
+  if (copy->nbrs != t || t->wrapping) ok = false;
+
+  // game_restore change le mode wrapping, et reconstruit la table
+  snapshot s = game_snapshot(copy);
+  copy->isWrapping = false;
+  ok = ok && game_restore(copy, s) && copy->nbrs->wrapping &&
+       game_get_ajacent_square(copy, 0, 0, NORTH, &i, &j) && i == 2;
+  game_snapshot_delete(s);
+  game_delete(copy);
+  return ok;
+}
+
+bool test_game_copy_into() {
+  game g = game_default();
+  game dst = game_new_empty_ext(2, 3, false);
+  game_play_move(dst, 0, 0, 1);
+  bool ok = game_copy_into(dst, g) && game_equal(dst, g, false) &&
+            game_is_wrapping(dst) == game_is_wrapping(g) &&
+            queue_is_empty(dst->do_queue) && queue_is_empty(dst->undo_queue);
+  // Le jeu et son historique sont dans le même bloc, aligné
+  if ((uintptr_t)g % GAME_ALIGNMENT != 0 || g->cases != g->inline_cases ||
+      g->do_queue != &g->history[0] || g->undo_queue != &g->history[1])
+    ok = false;
+  // dst a dû être agrandi ; la copie est indépendante de l'original
+  if (dst->cases == dst->inline_cases || dst->nbrs != g->nbrs) ok = false;
+  game_play_move(dst, 0, 0, 1);
+  if (game_equal(dst, g, false)) ok = false;
+
+  // Une grille plus petite revient dans le bloc du jeu
+  game small = game_new_empty_ext(1, 2, true);
+  if (!game_copy_into(dst, small) || !game_equal(dst, small, false) ||
+      dst->cases != dst->inline_cases || game_nb_rows(dst) != 1)
+    ok = false;
+  if (game_copy_into(NULL, g) || game_copy_into(dst, NULL)) ok = false;
+  game_delete(small);
+  game_delete(dst);
+  game_delete(g);
+  return ok;
+}
+
+bool test_game_hash() {
+  game g = game_default();
+  game copy = game_copy(g);
+  uint64_t h = game_hash(g, false), hs = game_hash(g, true);
+  bool ok = game_hash(copy, false) == h && hs != h;
+
+  // mis à jour à chaque coup, sans dépendre des orientations pour hs
+  game_play_move(g, 2, 3, 1);
+  uint64_t h2 = game_hash(g, false);
+  if (h2 == h || game_hash(g, true) != hs) ok = false;
+  g->hash_valid = false;  // recalcul complet
+  if (game_hash(g, false) != h2) ok = false;
+  game_undo(g);
+  if (game_hash(g, false) != h) ok = false;
+  game_set_piece_shape(g, 0, 0, CROSS);
+  if (game_hash(g, true) == hs) ok = false;
+
+  // la taille et le mode wrapping comptent
+  game a = game_new_empty_ext(2, 3, false);
+  game b = game_new_empty_ext(3, 2, false);
+  game c = game_new_empty_ext(2, 3, true);
+  if (game_hash(a, false) == game_hash(b, false) ||
+      game_hash(a, false) == game_hash(c, false))
+    ok = false;
+  game_delete(a);
+  game_delete(b);
+  game_delete(c);
+  game_delete(copy);
+  game_delete(g);
+  return ok;
+}
+
+bool test_game_equal_fast() {
+  game g = game_default();
+  game copy = game_copy(g);
+  bool ok = game_equal_fast(g, copy, false);
+  game_play_move(copy, 4, 4, 1);
+  if (game_equal_fast(g, copy, false) || !game_equal_fast(g, copy, true))
+    ok = false;
+  game_hash(g, false);  // hashs connus : comparaison immédiate
+  game_hash(copy, false);
+  if (game_equal_fast(g, copy, false) || !game_equal_fast(g, copy, true))
+    ok = false;
+  copy->isWrapping = !g->isWrapping;
+  game_undo(copy);
+  if (game_equal_fast(g, copy, false)) ok = false;
+  game_delete(copy);
+  game_delete(g);
+  return ok;
+}
+
+/* Vérifie une grille résolue partagée (lecture seule). */
+static void *check_won(void *data) {
+  cgame g = data;
+  bool won = game_won(g) && game_is_connected(g);
+  return won ? data : NULL;
+}
+
+bool test_game_won_threads() {
+  // premiers appels simultanés de game_won sur le même jeu : une lecture ne
+  // doit rien modifier de partagé
+  game g = game_random(300, 300, true, 0, 0);
+  if (!g) return false;
+  pthread_t threads[8];
+  uint nb_started = 0;
+  while (nb_started < 8 &&
+         pthread_create(&threads[nb_started], NULL, check_won, g) == 0)
+    nb_started++;
+  bool ok = nb_started == 8;
+  for (uint k = 0; k < nb_started; k++) {
+    void *res;
+    pthread_join(threads[k], &res);
+    if (res != g) ok = false;
+  }
+  game_delete(g);
+  return ok;
+}
+
+/* ************************************************************************** */
+/*                              GRANDES GRILLES                               */
+/* ************************************************************************** */
+
+bool test_game_snapshot() {
+  game g = game_default();
+  game_hash(g, false);
+  snapshot s0 = game_snapshot(g);
+  game copy = game_copy(g);
+  game_play_move(g, 0, 0, 1);
+  game_play_move(g, 4, 4, 2);
+  snapshot s1 = game_snapshot(g);
+  game_set_piece_shape(g, 2, 2, CROSS);
+
+  // retour au premier état, puis au second
+  bool ok = game_restore(g, s0) && game_equal(g, copy, false) &&
+            game_hash(g, false) == game_hash(copy, false);
+  ok = ok && game_restore(g, s1) &&
+       game_get_piece_orientation(g, 0, 0) ==
+           (game_get_piece_orientation(copy, 0, 0) + 1) % NB_DIRS &&
+       game_get_piece_shape(g, 2, 2) == game_get_piece_shape(copy, 2, 2);
+  game_restore(g, s0);
+  game_delete(copy);
+
+  // l'option wrapping fait partie du snapshot
+  bool wrapping = game_is_wrapping(g);
+  g->isWrapping = !wrapping;
+  snapshot s2 = game_snapshot(g);
+  g->isWrapping = wrapping;
+  ok = ok && game_restore(g, s2) && game_is_wrapping(g) != wrapping &&
+       game_restore(g, s0) && game_is_wrapping(g) == wrapping;
+
+  // les tailles doivent correspondre
+  game other = game_new_empty_ext(3, 4, false);
+  if (game_restore(other, s0) || game_restore(g, NULL)) ok = false;
+  game_delete(other);
+  game_delete(g);
+  // un snapshot survit au jeu
+  game g2 = game_new_empty();
+  ok = ok && game_restore(g2, s1) && game_get_piece_shape(g2, 4, 4) != EMPTY;
+  game_delete(g2);
+  game_snapshot_delete(s0);
+  game_snapshot_delete(s1);
+  game_snapshot_delete(s2);
+  game_snapshot_delete(NULL);
+  return ok;
+}
+
+bool test_game_print_to() {
+  game g = game_default();
+  const char *expected =
+      "   0 1 2 3 4 \n"
+      "   ----------\n"
+      "0 |┘ ^ < └ v |\n"
+      "1 |┬ ┤ ┴ ├ ├ |\n"
+      "2 |> ^ ┤ < - |\n"
+      "3 |v ┬ ┴ ┘ | |\n"
+      "4 |> ┤ v > v |\n"
+      "   ----------\n";
+  FILE *file = tmpfile();
+  if (file == NULL) return false;
+  game_print_to(g, file);
+  // une case vide et des indices sur plusieurs chiffres
+  game big = game_new_empty_ext(11, 12, false);
+  game_set_piece_shape(big, 10, 11, CROSS);
+  game_print_to(big, file);
+
+  char buf[1024];
+  rewind(file);
+  size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+  buf[len] = '\0';
+  fclose(file);
+  size_t n = strlen(expected);
+  bool ok = len > n && memcmp(buf, expected, n) == 0;
+  ok = ok && strncmp(buf + n, "   0 1 2 3 4 5 6 7 8 9 10 11 \n", 30) == 0;
+  ok = ok && strstr(buf + n, "\n10 |                      + |\n") != NULL;
+  game_delete(big);
+  game_delete(g);
+  return ok;
+}
+
+bool test_large_game_new_ext() {
+  // Les grilles de plus de 10x10 sont acceptées
+  uint nb_rows = 1000, nb_cols = 1000;
+  size_t nb_squares = (size_t)nb_rows * nb_cols;
+  shape *shapes = malloc(nb_squares * sizeof(shape));
+  direction *orientations = malloc(nb_squares * sizeof(direction));
+  if (!shapes || !orientations) return false;
+  for (size_t k = 0; k < nb_squares; k++) {
+    shapes[k] = k % NB_SHAPES;
+    orientations[k] = k % NB_DIRS;
+  }
+
+  game g = game_new_ext(nb_rows, nb_cols, shapes, orientations, true);
+  free(shapes);
+  free(orientations);
+  if (g == NULL) return false;
+  bool ok = game_nb_rows(g) == nb_rows && game_nb_cols(g) == nb_cols;
+  uint i = nb_rows - 1, j = nb_cols - 1;
+  size_t k = (size_t)i * nb_cols + j;
+  if (game_get_piece_shape(g, i, j) != k % NB_SHAPES ||
+      game_get_piece_orientation(g, i, j) != k % NB_DIRS)
+    ok = false;
+
+  game copy = game_copy(g);
+  if (!game_equal(g, copy, false) || !game_is_wrapping(copy)) ok = false;
+  game_play_move(g, i, j, 1);
+  game_undo(g);
+  if (!game_equal(g, copy, false)) ok = false;
+  game_delete(copy);
+  game_delete(g);
+
+  // Une seule ligne très longue
+  g = game_new_empty_ext(1, 1000000, false);
+  if (g == NULL || game_nb_cols(g) != 1000000) ok = false;
+  game_delete(g);
+
+  // Tailles nulles ou trop grandes
+  if (game_new_empty_ext(0, 5, false) != NULL) ok = false;
+  if (game_new_empty_ext(UINT_MAX, UINT_MAX, false) != NULL) ok = false;
+  if (game_new_ext(65536, 65536, NULL, NULL, false) != NULL) ok = false;
+  return ok;
+}
+
+/* place en (i,j) la pièce ayant exactement les demi-arêtes de mask (bit d pour
+ * la direction d) */
+static void set_piece_mask(game g, uint i, uint j, uint mask) {
+  for (shape s = 0; s < NB_SHAPES; s++)
+    for (direction o = 0; o < NB_DIRS; o++) {
+      game_set_piece_shape(g, i, j, s);
+      game_set_piece_orientation(g, i, j, o);
+      uint m = 0;
+      for (direction d = 0; d < NB_DIRS; d++)
+        if (game_has_half_edge(g, i, j, d)) m |= 1 << d;
+      if (m == mask) return;
+    }
+  assert(false);
+}
+
+bool test_large_game_is_connected_spiral() {
+  // Un seul chemin en spirale sur toute la grille : le pire cas d'un parcours
+  // par balayages successifs
+  uint n = 1000;
+  game g = game_new_empty_ext(n, n, false);
+  size_t nb_squares = (size_t)n * n;
+  uint *path = malloc(nb_squares * sizeof(uint));
+  uint *mask = calloc(nb_squares, sizeof(uint));
+  if (!g || !path || !mask) return false;
+
+  size_t len = 0;
+  uint top = 0, bottom = n - 1, left = 0, right = n - 1;
+  while (len < nb_squares) {
+    for (uint j = left; j <= right && len < nb_squares; j++)
+      path[len++] = top * n + j;
+    for (uint i = top + 1; i <= bottom && len < nb_squares; i++)
+      path[len++] = i * n + right;
+    for (uint j = right; j-- > left && len < nb_squares;)
+      path[len++] = bottom * n + j;
+    for (uint i = bottom; i-- > top + 1 && len < nb_squares;)
+      path[len++] = i * n + left;
+    top++, bottom--, left++, right--;
+  }
+
+  for (size_t k = 0; k + 1 < nb_squares; k++) {
+    uint a = path[k], b = path[k + 1];
+    direction d = (b > a) ? SOUTH : NORTH;
+    if (b == a + 1) d = EAST;
+    if (a == b + 1) d = WEST;
+    mask[a] |= 1 << d;
+    mask[b] |= 1 << ((d + 2) % NB_DIRS);
+  }
+  for (size_t k = 0; k < nb_squares; k++)
+    set_piece_mask(g, k / n, k % n, mask[k]);
+  uint ci = path[nb_squares / 2] / n, cj = path[nb_squares / 2] % n;
+  free(path);
+  free(mask);
+
+  bool ok = game_is_connected(g) && game_won(g);
+
+  // En coupant la spirale au milieu du chemin (sans erreur d'appariement), le
+  // réseau n'est plus connexe
+  game_set_piece_shape(g, ci, cj, EMPTY);
+  for (direction d = 0; d < NB_DIRS; d++) {
+    uint i2, j2;
+    if (game_get_ajacent_square(g, ci, cj, d, &i2, &j2) &&
+        game_check_edge(g, i2, j2, (d + 2) % NB_DIRS) == MISMATCH) {
+      uint m = 0;
+      for (direction d2 = 0; d2 < NB_DIRS; d2++)
+        if (d2 != (d + 2) % NB_DIRS && game_has_half_edge(g, i2, j2, d2))
+          m |= 1 << d2;
+      set_piece_mask(g, i2, j2, m);
+    }
+  }
+  if (!game_is_well_paired(g) || game_is_connected(g) || game_won(g))
+    ok = false;
+  game_delete(g);
+  return ok;
+}
+
+bool test_large_game_snapshot() {
+  uint n = 1000;
+  game g = game_new_empty_ext(n, n, true);
+  game ref = game_copy(g);
+  snapshot s = game_snapshot(g);
+  // un coup ne recopie que le morceau de grille qu'il modifie
+  game_play_move(g, 500, 500, 1);
+  bool ok = true;
+  uint nb_shared = 0;
+  for (size_t k = 0; k < s->nb_chunks; k++)
+    if (g->grid->chunks[k] == s->chunks[k]) nb_shared++;
+  if (nb_shared != s->nb_chunks - 1) ok = false;
+  // des points de contrôle successifs
+  snapshot checkpoints[10];
+  for (uint k = 0; k < 10; k++) {
+    checkpoints[k] = game_snapshot(g);
+    game_play_move(g, k, k, 1);
+  }
+  for (uint k = 10; k-- > 0;) {
+    ok = ok && game_restore(g, checkpoints[k]) &&
+         game_get_piece_orientation(g, k, k) == NORTH &&
+         game_get_piece_orientation(g, 500, 500) == EAST;
+    game_snapshot_delete(checkpoints[k]);
+  }
+  ok = ok && game_restore(g, s) && game_equal(g, ref, false);
+  game_snapshot_delete(s);
+  game_delete(ref);
+  game_delete(g);
+  return ok;
+}
+
 void usage(int argc, char *argv[]) {
   fprintf(stderr, "Usage: %s <testname> [<...>]\n", argv[0]);
   exit(EXIT_FAILURE);
@@ -292,6 +663,26 @@ int main(int argc, char *argv[]) {
     etat = test_game_redo();
   } else if (strcmp("cross_piece", argv[1]) == 0) {
     etat = test_cross_piece();
+  } else if (strcmp("game_neighbours", argv[1]) == 0) {
+    etat = test_game_neighbours();
+  } else if (strcmp("game_copy_into", argv[1]) == 0) {
+    etat = test_game_copy_into();
+  } else if (strcmp("game_hash", argv[1]) == 0) {
+    etat = test_game_hash();
+  } else if (strcmp("game_equal_fast", argv[1]) == 0) {
+    etat = test_game_equal_fast();
+  } else if (strcmp("game_snapshot", argv[1]) == 0) {
+    etat = test_game_snapshot();
+  } else if (strcmp("game_print_to", argv[1]) == 0) {
+    etat = test_game_print_to();
+  } else if (strcmp("game_won_threads", argv[1]) == 0) {
+    etat = test_game_won_threads();
+  } else if (strcmp("large_game_new_ext", argv[1]) == 0) {
+    etat = test_large_game_new_ext();
+  } else if (strcmp("large_game_is_connected_spiral", argv[1]) == 0) {
+    etat = test_large_game_is_connected_spiral();
+  } else if (strcmp("large_game_snapshot", argv[1]) == 0) {
+    etat = test_large_game_snapshot();
   } else {
     fprintf(stderr, "Test \"%s\" finished: FAILURE\n", argv[1]);
     return EXIT_FAILURE;
@@ -0,0 +1,144 @@
+/**
+ * @file game_private.h
+ * @brief Internal Game Accessors.
+ * @details Unchecked inline accessors used by the inner loops of the game
+ * library. Unlike the public functions, they do not validate their arguments
+ * (this is only done with assert) and they must not be used outside of the
+ * library.
+ * @copyright University of Bordeaux. All rights reserved, 2024.
+ **/
+
+#ifndef __GAME_PRIVATE_H__
+#define __GAME_PRIVATE_H__
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+#include "game_struct.h"
+
+/**
+ * @brief Half-edges of each piece (shape & orientation).
+ * @details The 4 least significant bits encode the presence of an half-edge in
+ * the N-E-S-W directions (in that order). Thus, binary coding 1100 represents
+ * the piece "└" (a corner in north orientation).
+ */
+static const uint8_t HALF_EDGES[NB_SHAPES][NB_DIRS] = {
+    {0b0000, 0b0000, 0b0000, 0b0000},  // EMPTY {" ", " ", " ", " "}
+    {0b1000, 0b0100, 0b0010, 0b0001},  // ENDPOINT {"^", ">", "v", "<"},
+    {0b1010, 0b0101, 0b1010, 0b0101},  // SEGMENT {"|", "-", "|", "-"},
+    {0b1100, 0b0110, 0b0011, 0b1001},  // CORNER {"└", "┌", "┐", "┘"}
+    {0b1101, 0b1110, 0b0111, 0b1011},  // TEE {"┴", "├", "┬", "┤"}
+    {0b1111, 0b1111, 0b1111, 0b1111}   // CROSS {"+", "+", "+", "+"}
+};
+
+/** bit of the half-edge in direction d */
+#define HALF_EDGE_BIT(d) (0b1000 >> (d))
+
+/** index of square (i,j) in the row-major grid */
+static inline uint _index(cgame g, uint i, uint j) {
+  assert(g);
+  assert(i < g->height && j < g->width);
+  return i * g->width + j;
+}
+
+static inline shape _get_shape(cgame g, uint i, uint j) {
+  return g->cases[_index(g, i, j)].shape;
+}
+
+static inline direction _get_orientation(cgame g, uint i, uint j) {
+  return g->cases[_index(g, i, j)].orientation;
+}
+
+/** Zobrist key of a piece in square sq (a mix of sq and code, computed on the
+ * fly so that there is no table to size with the grid) */
+static inline uint64_t _zobrist(uint sq, uint code) {
+  uint64_t z = ((uint64_t)sq << 5 | code) + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/** key of a piece with its orientation (codes 0..23) */
+static inline uint64_t _piece_key(uint sq, Acase c) {
+  return _zobrist(sq, c.shape * NB_DIRS + c.orientation);
+}
+
+/** key of a piece without its orientation (codes 24..29) */
+static inline uint64_t _shape_key(uint sq, shape s) {
+  return _zobrist(sq, NB_SHAPES * NB_DIRS + s);
+}
+
+/** to call after writing directly in g->cases: the hashes are recomputed and
+ * the persistent grid rebuilt when needed */
+static inline void _game_invalidate_caches(game g) {
+  g->hash_valid = false;
+  _grid_release(g->grid);
+  g->grid = NULL;
+}
+
+/** share the persistent grid of src (if any) with dst, whose cells must be a
+ * copy of the cells of src */
+static inline void _game_share_grid(game dst, cgame src) {
+  if (src->grid) __atomic_add_fetch(&src->grid->refcount, 1, __ATOMIC_RELAXED);
+  _grid_release(dst->grid);
+  dst->grid = src->grid;
+}
+
+/** set the piece in square sq, keeping the hashes and the persistent grid up
+ * to date */
+static inline void _set_square(game g, uint sq, shape s, direction o) {
+  assert(s < NB_SHAPES && o < NB_DIRS);
+  Acase old = g->cases[sq];
+  Acase new = {o, s};
+  g->cases[sq] = new;
+  if (g->hash_valid) {
+    g->hash ^= _piece_key(sq, old) ^ _piece_key(sq, new);
+    g->shape_hash ^= _shape_key(sq, old.shape) ^ _shape_key(sq, s);
+  }
+  if (g->grid) _grid_write(g, sq, new);
+}
+
+static inline void _set_shape(game g, uint i, uint j, shape s) {
+  uint sq = _index(g, i, j);
+  _set_square(g, sq, s, g->cases[sq].orientation);
+}
+
+static inline void _set_orientation(game g, uint i, uint j, direction o) {
+  uint sq = _index(g, i, j);
+  _set_square(g, sq, g->cases[sq].shape, o);
+}
+
+/** half-edges of the piece in a square */
+static inline uint8_t _half_edges(Acase c) {
+  assert(c.shape < NB_SHAPES && c.orientation < NB_DIRS);
+  return HALF_EDGES[c.shape][c.orientation];
+}
+
+static inline bool _has_half_edge(Acase c, direction d) {
+  return _half_edges(c) & HALF_EDGE_BIT(d);
+}
+
+/** neighbour table of the game: the library keeps it up to date (see
+ * _game_update_neighbours()), and it is only looked up elsewhere when the
+ * fields of the game were written directly */
+static inline const uint* _game_neighbours(cgame g) {
+  const neighbours* t = g->nbrs;
+  if (t == NULL || t->wrapping != g->isWrapping || t->height != g->height ||
+      t->width != g->width)
+    return _neighbours_fallback(g);
+  return t->next;
+}
+
+/** edge status between square sq and its neighbour in direction d */
+static inline edge_status _check_edge(cgame g, uint sq, direction d) {
+  uint next = _game_neighbours(g)[sq * NB_DIRS + d];
+  edge_status status = _has_half_edge(g->cases[sq], d) ? 1 : 0;
+  if (next != NO_NEIGHBOUR &&
+      _has_half_edge(g->cases[next], (d + 2) % NB_DIRS))
+    status += 1;
+  return status;
+}
+
+#endif  // __GAME_PRIVATE_H__
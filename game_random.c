@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,13 +11,76 @@
 #include "game_struct.h"
 #include "game_tools.h"
 
+/* ************************************************************************** */
+
+typedef struct {
+  game_writer *writer;
+  uint nb_games;
+} batch;
+
+/** append a game to the batch file, in the format of game_save */
+static void _write_game(game g, void *data) {
+  batch *b = data;
+  if (game_writer_write(b->writer, g)) b->nb_games++;
+  game_delete(g);
+}
+
+/* ************************************************************************** */
+
+/** batch mode: stream games of a given difficulty into a single file */
+static int _batch(int argc, char *argv[]) {
+  uint nb_rows = atoi(argv[2]);
+  uint nb_cols = atoi(argv[3]);
+  bool wrapping = atoi(argv[4]);
+  difficulty level = atoi(argv[5]);
+  bool uniqueness = atoi(argv[6]);
+  uint n = atoi(argv[7]);
+  uint nb_threads = atoi(argv[8]);
+
+  batch b = {game_writer_open(argv[9]), 0};
+  if (!b.writer) {
+    fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", argv[9]);
+    return 1;
+  }
+
+  srand(time(NULL));
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint nb = game_random_target_stream(nb_rows, nb_cols, wrapping, level,
+                                      uniqueness, n, nb_threads, _write_game,
+                                      &b);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (!game_writer_close(b.writer) || b.nb_games != nb) {
+    fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", argv[9]);
+    return 1;
+  }
+  if (nb != n) {
+    fprintf(stderr, "Erreur dans la génération des jeux.\n");
+    return 1;
+  }
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+  fprintf(stderr, "%u games in %.2f s (%.0f games/s)\n", b.nb_games, seconds,
+          b.nb_games / seconds);
+  return 0;
+}
+
+/* ************************************************************************** */
+
 int main(int argc, char *argv[]) {
+  if (argc == 10 && strcmp(argv[1], "-b") == 0) {
+    return _batch(argc, argv);
+  }
+
   // Vérifier le nombre d'arguments
   if (argc < 7) {
     fprintf(stderr,
             "Usage: %s <nb_rows> <nb_cols> <wrapping> <nb_empty> <nb_extra> "
-            "<shuffle> [<filename>]\n",
-            argv[0]);
+            "<shuffle> [<filename>]\n"
+            "       %s -b <nb_rows> <nb_cols> <wrapping> <difficulty> "
+            "<uniqueness> <nb_games> <nb_threads> <filename>\n",
+            argv[0], argv[0]);
     return 1;
   }
 
@@ -17,7 +17,7 @@
 #include "game_ext.h"
 #include "game_struct.h"
 #include "game_tools.h"
-int main(int argc, char* argv) {
+int main(int argc, char* argv[]) {
   /* initialize SDL2 and some extensions */
   if (SDL_Init(SDL_INIT_VIDEO) != 0)
     ERROR("Error: SDL_Init VIDEO (%s)", SDL_GetError());
@@ -45,25 +45,35 @@ int main(int argc, char* argv) {
   /* initialize your environment */
   Env* env = init(win, ren, argc, argv);
 
-  /* main render loop */
+  /* main render loop: nothing is animated, so sleep until an event comes,
+   * then render and present a frame only if the state has changed */
   SDL_Event e;
   bool quit = false;
+  Uint32 shown_latency = 0;
 
   while (!quit) {
     /* manage events */
-    while (SDL_PollEvent(&e)) {
+    if (!SDL_WaitEvent(&e)) ERROR("Error: SDL_WaitEvent (%s)", SDL_GetError());
+    do {
       quit = process(win, ren, env, &e);
-      if (quit) break;
-    }
+    } while (!quit && SDL_PollEvent(&e));
+    if (quit) break;
 
-    /* background in gray */
-    SDL_SetRenderDrawColor(ren, 0xA0, 0xA0, 0xA0, 0xFF);
-    SDL_RenderClear(ren);
+    /* render all what you want, once per frame */
+    if (needs_render(env)) {
+      render(win, ren, env);
+      present(win, ren, env);
+    }
 
-    /* render all what you want */
-    render(win, ren, env);
-    SDL_RenderPresent(ren);
-    SDL_Delay(DELAY);
+    /* show the input-to-photon latency of the last move in the title */
+    Uint32 latency = input_latency(env);
+    if (latency != shown_latency) {
+      char title[64];
+      snprintf(title, sizeof(title), "%s - latence %u ms", APP_NAME,
+               (unsigned)latency);
+      SDL_SetWindowTitle(win, title);
+      shown_latency = latency;
+    }
   }
 
   /* clean your environment */
@@ -1,77 +1,689 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "game.h"
+#include "game_archive.h"
 #include "game_aux.h"
 #include "game_ext.h"
 #include "game_struct.h"
+#include "game_timing.h"
 #include "game_tools.h"
 
-int main(int argc, char *argv[]) {
-  if (argc < 3 || argc > 4) {
-    fprintf(stderr, "Usage: %s <option> <input> [<output>]\n", argv[0]);
-    return EXIT_FAILURE;
+/* ************************************************************************** */
+/*                       DISTRIBUTED SOLUTION COUNTING                        */
+/* ************************************************************************** */
+
+/* The counting of solutions is split into numbered jobs, each one fixing the
+ * orientation of the first squares of the grid. The job file starts with a
+ * line "<nb_fixed> <nb_jobs>", followed by one line "<id> <orientations>" per
+ * job. A worker claims a job by locking the byte <id> of the job file with
+ * fcntl(), so that the lock is released if the worker is killed, and appends a
+ * line "<id> <count> <checksum>" to the results log once the job is done. As
+ * fcntl() locks also work on NFS, workers may run on several machines sharing
+ * the same files. */
+
+#define DEFAULT_NB_FIXED 8
+
+static const char DIR2CHAR[NB_DIRS] = {'N', 'E', 'S', 'W'};
+
+typedef struct {
+  uint nb_fixed;
+  uint nb_jobs;
+  direction *prefixes; /* nb_fixed orientations per job */
+} jobs;
+
+typedef struct {
+  FILE *file;
+  uint nb_fixed;
+  uint nb_cols;
+  uint id;
+} job_writer;
+
+/* ************************************************************************** */
+
+static void _write_job(cgame job, void *data) {
+  job_writer *w = data;
+  fprintf(w->file, "%u ", w->id++);
+  for (uint k = 0; k < w->nb_fixed; k++)
+    fputc(DIR2CHAR[game_get_piece_orientation(job, k / w->nb_cols,
+                                              k % w->nb_cols)],
+          w->file);
+  fputc('\n', w->file);
+}
+
+/* ************************************************************************** */
+
+static bool _read_jobs(const char *filename, jobs *j) {
+  FILE *file = fopen(filename, "r");
+  if (!file) return false;
+  if (fscanf(file, "%u %u", &j->nb_fixed, &j->nb_jobs) != 2 ||
+      j->nb_fixed == 0) {
+    fclose(file);
+    return false;
+  }
+  j->prefixes = malloc((size_t)j->nb_jobs * j->nb_fixed * sizeof(direction));
+  if (!j->prefixes) {
+    fclose(file);
+    return false;
+  }
+  /* the jobs are written in order: line k must hold job k, so that every
+   * prefix is read exactly once */
+  bool ok = true;
+  for (uint k = 0; k < j->nb_jobs && ok; k++) {
+    uint id;
+    ok = fscanf(file, "%u ", &id) == 1 && id == k;
+    for (uint l = 0; l < j->nb_fixed && ok; l++) {
+      int c = fgetc(file);
+      char *d = c == EOF ? NULL : memchr(DIR2CHAR, c, NB_DIRS);
+      ok = d != NULL;
+      if (ok) j->prefixes[(size_t)k * j->nb_fixed + l] = d - DIR2CHAR;
+    }
   }
+  fclose(file);
+  if (!ok) free(j->prefixes);
+  return ok;
+}
 
-  char *option = argv[1];
-  char *input_filename = argv[2];
-  char *output_filename = (argc == 4) ? argv[3] : NULL;
+/* ************************************************************************** */
+
+/** lock (or unlock) a byte range of a file, len = 0 meaning up to its end */
+static bool _lock(int fd, short type, off_t start, off_t len, bool wait) {
+  struct flock fl;
+  memset(&fl, 0, sizeof(fl));
+  fl.l_type = type;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = start;
+  fl.l_len = len;
+  return fcntl(fd, wait ? F_SETLKW : F_SETLK, &fl) == 0;
+}
 
-  // Chargement du jeu
-  game g = game_load(input_filename);
+/* ************************************************************************** */
+
+static uint32_t _checksum(uint id, uint64_t count) {
+  return (uint32_t)(id * 2654435761u) ^ (uint32_t)(count * 40503u) ^
+         (uint32_t)(count >> 32);
+}
+
+/* ************************************************************************** */
+
+/** parse a line of the results log, ignoring the truncated or invalid ones */
+static void _parse_result(const char *line, uint nb_jobs, bool *done,
+                          uint64_t *counts) {
+  uint id, check;
+  uint64_t count;
+  int len;
+  if (sscanf(line, "%u %" SCNu64 " %x%n", &id, &count, &check, &len) != 3)
+    return;
+  if (line[len] != '\0' || id >= nb_jobs || check != _checksum(id, count))
+    return;
+  if (done[id]) return;
+  done[id] = true;
+  if (counts) counts[id] = count;
+}
+
+/* ************************************************************************** */
+
+/** read the lines appended to the results log since the last call */
+static void _scan_results(int fd, off_t *pos, uint nb_jobs, bool *done,
+                          uint64_t *counts) {
+  char buf[4096];
+  size_t len = 0;
+  _lock(fd, F_RDLCK, 0, 0, true);
+  for (;;) {
+    ssize_t n = pread(fd, buf + len, sizeof(buf) - 1 - len, *pos + len);
+    if (n <= 0) break;
+    len += n;
+    buf[len] = '\0';
+    char *line = buf, *eol;
+    while ((eol = memchr(line, '\n', buf + len - line)) != NULL) {
+      *eol = '\0';
+      _parse_result(line, nb_jobs, done, counts);
+      line = eol + 1;
+    }
+    size_t used = line - buf;
+    if (used == 0 && len == sizeof(buf) - 1) used = len; /* garbage */
+    *pos += used;
+    memmove(buf, buf + used, len - used);
+    len -= used;
+  }
+  _lock(fd, F_UNLCK, 0, 0, true);
+}
+
+/* ************************************************************************** */
+
+static bool _append_result(int fd, uint id, uint64_t count) {
+  char line[64];
+  int len = snprintf(line, sizeof(line), "%u %" PRIu64 " %08x\n", id, count,
+                     _checksum(id, count));
+  _lock(fd, F_WRLCK, 0, 0, true);
+  bool ok = lseek(fd, 0, SEEK_END) >= 0 && write(fd, line, len) == len &&
+            fsync(fd) == 0;
+  _lock(fd, F_UNLCK, 0, 0, true);
+  return ok;
+}
+
+/* ************************************************************************** */
+
+static int _split(char *input, char *jobfile, uint nb_fixed) {
+  game g = game_load(input);
   if (!g) {
-    fprintf(stderr, "Erreur : impossible de charger le jeu depuis %s\n",
-            input_filename);
+    fprintf(stderr, "Erreur : impossible de charger le jeu depuis %s\n", input);
     return EXIT_FAILURE;
   }
-  // game_print(g);
+  uint nb_squares = game_nb_rows(g) * game_nb_cols(g);
+  if (nb_fixed < 1) nb_fixed = 1;
+  if (nb_fixed > nb_squares) nb_fixed = nb_squares;
 
-  bool solve = false;
-  uint nbSolutions = 0;
-  // Traitement des options
-  if (strcmp(option, "-s") == 0) {
-    solve = game_solve(g);
-    if (!solve) {
-      fprintf(stderr, "Aucune solution trouvée.\n");
-      game_delete(g);
-      return EXIT_FAILURE;
+  FILE *file = fopen(jobfile, "w");
+  if (!file) {
+    fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", jobfile);
+    game_delete(g);
+    return EXIT_FAILURE;
+  }
+  job_writer w = {file, nb_fixed, game_nb_cols(g), 0};
+  fprintf(file, "%u %10u\n", nb_fixed, 0);
+  uint nb_jobs = game_split_solutions(g, nb_fixed, _write_job, &w);
+  rewind(file);
+  fprintf(file, "%u %10u\n", nb_fixed, nb_jobs);
+  fclose(file);
+  game_delete(g);
+
+  printf("Nombre de jobs : %u\n", nb_jobs);
+  return EXIT_SUCCESS;
+}
+
+/* ************************************************************************** */
+
+/** claim and count the jobs until all of them are done or claimed by other
+ * workers */
+static int _work_jobs(game g, jobs *j, int jfd, int rfd, bool *done,
+                      char *resfile) {
+  uint nb_cols = game_nb_cols(g);
+  off_t pos = 0;
+  uint nb_done = 0;
+  bool progress = true;
+  _scan_results(rfd, &pos, j->nb_jobs, done, NULL);
+
+  while (progress) {
+    progress = false;
+    for (uint id = 0; id < j->nb_jobs; id++) {
+      if (done[id] || !_lock(jfd, F_WRLCK, id, 1, false)) continue;
+      _scan_results(rfd, &pos, j->nb_jobs, done, NULL);
+      if (!done[id]) {
+        for (uint k = 0; k < j->nb_fixed; k++)
+          game_set_piece_orientation(g, k / nb_cols, k % nb_cols,
+                                     j->prefixes[(size_t)id * j->nb_fixed + k]);
+        uint64_t count = game_nb_solutions_fixed(g, j->nb_fixed);
+        if (!_append_result(rfd, id, count)) {
+          _lock(jfd, F_UNLCK, id, 1, false);
+          fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", resfile);
+          return EXIT_FAILURE;
+        }
+        done[id] = true;
+        progress = true;
+        nb_done++;
+      }
+      _lock(jfd, F_UNLCK, id, 1, false);
     }
+  }
 
-  } else if (strcmp(option, "-c") == 0) {
-    nbSolutions = game_nb_solutions(g);
-  } else {
-    fprintf(stderr, "Option invalide : %s\n", option);
-    game_delete(g);
+  printf("Jobs traités : %u\n", nb_done);
+  return EXIT_SUCCESS;
+}
+
+static int _work(char *input, char *jobfile, char *resfile) {
+  jobs j;
+  if (!_read_jobs(jobfile, &j)) {
+    fprintf(stderr, "Erreur : fichier de jobs invalide %s\n", jobfile);
+    return EXIT_FAILURE;
+  }
+  int jfd = open(jobfile, O_RDWR);
+  int rfd = open(resfile, O_RDWR | O_CREAT | O_APPEND, 0644);
+  bool *done = calloc(j.nb_jobs, sizeof(bool));
+  game g = game_load(input);
+
+  int status = EXIT_FAILURE;
+  if (jfd < 0 || rfd < 0 || !done)
+    fprintf(stderr, "Erreur : impossible d'ouvrir %s ou %s\n", jobfile,
+            resfile);
+  else if (!g)
+    fprintf(stderr, "Erreur : impossible de charger le jeu depuis %s\n", input);
+  else if (j.nb_fixed > game_nb_rows(g) * game_nb_cols(g))
+    fprintf(stderr, "Erreur : %s ne correspond pas à %s\n", jobfile, input);
+  else
+    status = _work_jobs(g, &j, jfd, rfd, done, resfile);
+
+  game_delete(g);
+  free(done);
+  free(j.prefixes);
+  if (jfd >= 0) close(jfd);
+  if (rfd >= 0) close(rfd);
+  return status;
+}
+
+/* ************************************************************************** */
+
+static int _merge(char *jobfile, char *resfile, char *output_filename) {
+  jobs j;
+  if (!_read_jobs(jobfile, &j)) {
+    fprintf(stderr, "Erreur : fichier de jobs invalide %s\n", jobfile);
+    return EXIT_FAILURE;
+  }
+  int rfd = open(resfile, O_RDONLY);
+  bool *done = calloc(j.nb_jobs, sizeof(bool));
+  uint64_t *counts = calloc(j.nb_jobs, sizeof(uint64_t));
+  if (rfd < 0 || !done || !counts) {
+    fprintf(stderr, "Erreur : impossible de lire %s\n", resfile);
+    if (rfd >= 0) close(rfd);
+    free(done);
+    free(counts);
+    free(j.prefixes);
+    return EXIT_FAILURE;
+  }
+  off_t pos = 0;
+  _scan_results(rfd, &pos, j.nb_jobs, done, counts);
+  close(rfd);
+
+  uint64_t total = 0;
+  uint nb_missing = 0;
+  for (uint id = 0; id < j.nb_jobs; id++) {
+    if (done[id])
+      total += counts[id];
+    else
+      nb_missing++;
+  }
+  free(done);
+  free(counts);
+  free(j.prefixes);
+
+  if (nb_missing > 0) {
+    fprintf(stderr, "Erreur : %u jobs sur %u ne sont pas terminés\n",
+            nb_missing, j.nb_jobs);
     return EXIT_FAILURE;
   }
 
-  // Écriture du résultat dans le fichier de sortie ou affichage
   if (output_filename) {
     FILE *output_file = fopen(output_filename, "w");
     if (!output_file) {
       fprintf(stderr, "Erreur : impossible d'écrire dans %s\n",
               output_filename);
-      game_delete(g);
       return EXIT_FAILURE;
     }
-    if (strcmp(option, "-s") == 0) {
-      game_save(g, (char *)output_file);  // Sauvegarde de la solution
-    } else {
-      fprintf(output_file, "%u\n",
-              nbSolutions);  // Écriture du nombre de solutions
-    }
+    fprintf(output_file, "%" PRIu64 "\n", total);
     fclose(output_file);
   } else {
-    if (strcmp(option, "-s") == 0) {
+    printf("Nombre de solution : %" PRIu64 "\n", total);
+  }
+  return EXIT_SUCCESS;
+}
+
+/* ************************************************************************** */
+
+/** solve (or count the solutions of) each game of a stream, in one process;
+ * the output file is only created once there is something to write in it */
+static int _solve_stream(bool solve, char *input_filename,
+                         char *output_filename) {
+  game_reader *reader = game_reader_open(input_filename);
+  if (!reader) {
+    fprintf(stderr, "Erreur : impossible de charger le jeu depuis %s\n",
+            input_filename);
+    return EXIT_FAILURE;
+  }
+  game_writer *writer = NULL;
+  FILE *output_file = NULL;
+  int status = EXIT_SUCCESS;
+  bool written = true;
+  uint nb_games = 0;
+  game g;
+
+  while ((g = game_reader_next(reader)) != NULL) {
+    nb_games++;
+    if (solve && !game_solve(g)) {
+      fprintf(stderr, "Aucune solution trouvée.\n");
+      status = EXIT_FAILURE;
+    } else if (solve && output_filename) {
+      if (!writer) writer = game_writer_open(output_filename);
+      written &= game_writer_write(writer, g);
+    } else if (solve) {
       game_print(g);
     } else {
-      printf("Nombre de solution : %u\n", nbSolutions);
+      uint nbSolutions = game_nb_solutions(g);
+      if (output_filename && !output_file)
+        output_file = fopen(output_filename, "w");
+      if (output_file)
+        fprintf(output_file, "%u\n", nbSolutions);
+      else if (output_filename)
+        written = false;
+      else
+        printf("Nombre de solution : %u\n", nbSolutions);
     }
+    game_delete(g);
   }
 
-  // Libération de la mémoire
-  game_delete(g);
-  return 0;
+  if (game_reader_error(reader) || nb_games == 0) {
+    fprintf(stderr, "Erreur : impossible de charger le jeu depuis %s\n",
+            input_filename);
+    status = EXIT_FAILURE;
+  }
+  game_reader_close(reader);
+  if (writer && !game_writer_close(writer)) written = false;
+  if (output_file && fclose(output_file) != 0) written = false;
+  if (!written) {
+    fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", output_filename);
+    status = EXIT_FAILURE;
+  }
+  return status;
+}
+
+/* ************************************************************************** */
+/*                                 BATCH MODE                                 */
+/* ************************************************************************** */
+
+/* The main thread reads the boards and hands them to a pool of workers. The
+ * boards in flight live in a window, a ring indexed by their sequence number,
+ * which is also the reorder buffer: the main thread writes the results in
+ * input order as soon as the oldest one is done, and only reads a new board
+ * when there is room in the window, so that memory stays bounded. */
+
+#define WINDOW_PER_THREAD 4
+/** beyond this, the window and the thread array sizes could overflow */
+#define MAX_THREADS 1024
+
+typedef struct {
+  game g;          /* the board, then its solution */
+  bool solved;     /* -s: a solution was found */
+  uint count;      /* -c: number of solutions */
+  double start;    /* time when the board was read */
+  double latency;  /* time from the read of the board to its result */
+  bool done;
+} batch_job;
+
+typedef struct {
+  bool count;          /* count the solutions instead of solving */
+  batch_job *window;
+  uint size;
+  uint64_t next_read;  /* sequence number of the next board read */
+  uint64_t next_job;   /* sequence number of the next board to process */
+  bool finished;       /* all the boards have been read */
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready;
+  pthread_cond_t result_ready;
+} batch;
+
+typedef struct {
+  game_reader *reader;
+  game_archive *archive;
+  uint64_t next_id;
+} batch_input;
+
+/* ************************************************************************** */
+
+static void *_batch_work(void *data) {
+  batch *b = data;
+  for (;;) {
+    pthread_mutex_lock(&b->lock);
+    while (b->next_job == b->next_read && !b->finished)
+      pthread_cond_wait(&b->job_ready, &b->lock);
+    if (b->next_job == b->next_read) {
+      pthread_mutex_unlock(&b->lock);
+      return NULL;
+    }
+    batch_job *job = &b->window[b->next_job++ % b->size];
+    pthread_mutex_unlock(&b->lock);
+
+    if (b->count)
+      job->count = game_nb_solutions(job->g);
+    else
+      job->solved = game_solve(job->g);
+
+    pthread_mutex_lock(&b->lock);
+    job->latency = _now() - job->start;
+    job->done = true;
+    pthread_cond_signal(&b->result_ready);
+    pthread_mutex_unlock(&b->lock);
+  }
+}
+
+/* ************************************************************************** */
+
+/** an archive starts with the magic "NETA", anything else is a text stream */
+static bool _batch_open(char *filename, batch_input *in) {
+  char magic[4];
+  FILE *file = strcmp(filename, "-") ? fopen(filename, "rb") : NULL;
+  bool archive = file && fread(magic, 1, 4, file) == 4 &&
+                 memcmp(magic, "NETA", 4) == 0;
+  if (file) fclose(file);
+  in->next_id = 0;
+  in->reader = archive ? NULL : game_reader_open(filename);
+  in->archive = archive ? game_archive_open(filename, false) : NULL;
+  return in->reader || in->archive;
+}
+
+static game _batch_read(batch_input *in) {
+  if (in->reader) return game_reader_next(in->reader);
+  if (in->next_id == game_archive_size(in->archive)) return NULL;
+  return game_archive_get(in->archive, in->next_id++);
+}
+
+static bool _batch_close(batch_input *in) {
+  bool ok = !in->reader || !game_reader_error(in->reader);
+  game_reader_close(in->reader);
+  game_archive_close(in->archive);
+  return ok;
+}
+
+/* ************************************************************************** */
+
+/** print the throughput and the latency percentiles */
+static void _batch_report(uint64_t nb_games, double seconds,
+                          double *latencies) {
+  fprintf(stderr, "%" PRIu64 " jeux en %.3f s (%.1f jeux/s)\n", nb_games,
+          seconds, nb_games / seconds);
+  if (nb_games == 0) return;
+  fprintf(stderr, "latence (ms) :");
+  _print_percentiles(stderr, latencies, nb_games, 1e3);
+  fprintf(stderr, "\n");
+}
+
+/* ************************************************************************** */
+
+static int _batch(char *input, char *output, uint nb_threads, bool count) {
+  if (output && strcmp(output, "-") == 0) output = NULL;
+  batch_input in;
+  if (!_batch_open(input, &in)) {
+    fprintf(stderr, "Erreur : impossible de lire %s\n", input);
+    return EXIT_FAILURE;
+  }
+  game_writer *writer = count ? NULL : game_writer_open(output);
+  FILE *counts = !count ? NULL : output ? fopen(output, "w") : stdout;
+  if (!writer && !counts) {
+    fprintf(stderr, "Erreur : impossible d'écrire dans %s\n", output);
+    _batch_close(&in);
+    return EXIT_FAILURE;
+  }
+
+  batch b = {.count = count, .size = WINDOW_PER_THREAD * nb_threads};
+  b.window = calloc(b.size, sizeof(batch_job));
+  pthread_t *threads = malloc(nb_threads * sizeof(pthread_t));
+  size_t capacity = 1024;
+  double *latencies = malloc(capacity * sizeof(double));
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.job_ready, NULL);
+  pthread_cond_init(&b.result_ready, NULL);
+  bool failed = !b.window || !threads || !latencies;
+  if (failed) fprintf(stderr, "Erreur d'allocation\n");
+  uint nb_started = 0;
+  for (; !failed && nb_started < nb_threads; nb_started++) {
+    if (pthread_create(&threads[nb_started], NULL, _batch_work, &b)) {
+      fprintf(stderr, "Erreur : impossible de créer un thread\n");
+      failed = true;
+      break;
+    }
+  }
+
+  double start = _now();
+  uint64_t next_write = 0, nb_unsolved = 0;
+  bool eof = failed, written = true;
+  for (;;) {
+    // fill the window with new boards
+    while (!eof && b.next_read - next_write < b.size) {
+      game g = _batch_read(&in);
+      if (!g) {
+        eof = true;
+        break;
+      }
+      batch_job *job = &b.window[b.next_read % b.size];
+      *job = (batch_job){.g = g, .start = _now()};
+      pthread_mutex_lock(&b.lock);
+      b.next_read++;
+      pthread_cond_signal(&b.job_ready);
+      pthread_mutex_unlock(&b.lock);
+    }
+    if (eof && next_write == b.next_read) break;
+
+    if (next_write == capacity) {
+      double *more = realloc(latencies, 2 * capacity * sizeof(double));
+      if (!more) {
+        fprintf(stderr, "Erreur d'allocation\n");
+        failed = true;
+        break;
+      }
+      latencies = more;
+      capacity *= 2;
+    }
+
+    // write the oldest result, once it is done
+    batch_job *job = &b.window[next_write % b.size];
+    pthread_mutex_lock(&b.lock);
+    while (!job->done) pthread_cond_wait(&b.result_ready, &b.lock);
+    pthread_mutex_unlock(&b.lock);
+    if (count) {
+      written &= fprintf(counts, "%u\n", job->count) > 0;
+    } else {
+      // an unsolved board is written unchanged, to keep the input order
+      if (!job->solved) {
+        fprintf(stderr, "Aucune solution trouvée pour le jeu %" PRIu64 ".\n",
+                next_write);
+        nb_unsolved++;
+      }
+      written &= game_writer_write(writer, job->g);
+    }
+    game_delete(job->g);
+    latencies[next_write++] = job->latency;
+  }
+  double seconds = _now() - start;
+
+  // the workers finish the boards already handed to them, then stop
+  pthread_mutex_lock(&b.lock);
+  b.finished = true;
+  pthread_cond_broadcast(&b.job_ready);
+  pthread_mutex_unlock(&b.lock);
+  for (uint k = 0; k < nb_started; k++) pthread_join(threads[k], NULL);
+  pthread_cond_destroy(&b.result_ready);
+  pthread_cond_destroy(&b.job_ready);
+  pthread_mutex_destroy(&b.lock);
+  for (uint64_t seq = next_write; seq < b.next_read; seq++)
+    game_delete(b.window[seq % b.size].g);
+
+  bool read = _batch_close(&in);
+  if (writer && !game_writer_close(writer)) written = false;
+  if (counts && counts != stdout && fclose(counts) != 0) written = false;
+  if (counts == stdout) fflush(stdout);
+  if (!written)
+    fprintf(stderr, "Erreur : impossible d'écrire dans %s\n",
+            output ? output : "la sortie standard");
+
+  if (!failed) _batch_report(next_write, seconds, latencies);
+  free(latencies);
+  free(threads);
+  free(b.window);
+  return !failed && read && written && nb_unsolved == 0 ? EXIT_SUCCESS
+                                                        : EXIT_FAILURE;
+}
+
+/** parse a number of threads, in [1, MAX_THREADS] */
+static bool _parse_threads(const char *s, uint *nb_threads) {
+  char *end;
+  errno = 0;
+  long n = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || errno || n < 1 || n > MAX_THREADS) {
+    fprintf(stderr, "Nombre de threads invalide : %s (1 à %d)\n", s,
+            MAX_THREADS);
+    return false;
+  }
+  *nb_threads = n;
+  return true;
+}
+
+/* ************************************************************************** */
+
+static void usage(char *argv[]) {
+  fprintf(stderr,
+          "Usage: %s <option> <input> [<output>]\n"
+          "  -s <input> [<output>]              solve the games of <input>\n"
+          "  -c <input> [<output>]              count their solutions\n"
+          "  -j <input> <jobfile> [<nb_fixed>]  split the counting into jobs\n"
+          "  -w <input> <jobfile> <results>     run a counting worker\n"
+          "  -m <jobfile> <results> [<output>]  merge the partial counts\n"
+          "  --batch <input> [--threads <n>] [--count] [<output>]\n"
+          "                                     solve (or count) the games of a\n"
+          "                                     stream or an archive in parallel\n",
+          argv[0]);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 3 && strcmp(argv[1], "--batch") == 0) {
+    uint nb_threads = 1;
+    bool count = false;
+    char *output = NULL;
+    for (int k = 3; k < argc; k++) {
+      if (strcmp(argv[k], "--threads") == 0 && k + 1 < argc) {
+        if (!_parse_threads(argv[++k], &nb_threads)) return EXIT_FAILURE;
+      } else if (strcmp(argv[k], "--count") == 0) {
+        count = true;
+      } else if (!output && (argv[k][0] != '-' || !argv[k][1])) {
+        output = argv[k];
+      } else {
+        usage(argv);
+        return EXIT_FAILURE;
+      }
+    }
+    return _batch(argv[2], output, nb_threads, count);
+  }
+
+  if (argc < 3 || argc > 5) {
+    usage(argv);
+    return EXIT_FAILURE;
+  }
+
+  char *option = argv[1];
+  if (strcmp(option, "-j") == 0 && argc >= 4) {
+    uint nb_fixed = (argc == 5) ? atoi(argv[4]) : DEFAULT_NB_FIXED;
+    return _split(argv[2], argv[3], nb_fixed);
+  } else if (strcmp(option, "-w") == 0 && argc == 5) {
+    return _work(argv[2], argv[3], argv[4]);
+  } else if (strcmp(option, "-m") == 0 && argc >= 4) {
+    return _merge(argv[2], argv[3], (argc == 5) ? argv[4] : NULL);
+  } else if (argc == 5) {
+    usage(argv);
+    return EXIT_FAILURE;
+  }
+
+  if (strcmp(option, "-s") != 0 && strcmp(option, "-c") != 0) {
+    fprintf(stderr, "Option invalide : %s\n", option);
+    return EXIT_FAILURE;
+  }
+  return _solve_stream(strcmp(option, "-s") == 0, argv[2],
+                       (argc == 4) ? argv[3] : NULL);
 }
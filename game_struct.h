@@ -8,18 +8,79 @@
 #ifndef __GAME_STRUCT__H__
 #define __GAME_STRUCT__H__
 
+#include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "game.h"
+#include "game_alloc.h"
 #include "game_aux.h"
+#include "game_ext.h"
 #include "queue.h"
 
 
 
+/* Nombre maximal de cases : les indices de case (et de demi-arête, case *
+ * NB_DIRS + d) doivent tenir dans un uint. */
+#define MAX_SQUARES (UINT_MAX / (2 * NB_DIRS))
+
+/* Table des cases adjacentes : next[case * NB_DIRS + d] est l'indice de la case
+ * voisine dans la direction d, ou NO_NEIGHBOUR si elle est hors de la grille.
+ * Une table est partagée (avec un compteur de références) entre un jeu et ses
+ * copies. */
+#define NO_NEIGHBOUR UINT_MAX
+
+typedef struct {
+    uint height;
+    uint width;
+    bool wrapping;
+    uint refcount;
+    game_allocator allocator;
+    uint next[];
+} neighbours;
+
 typedef struct{
     direction orientation;
     shape shape;
 } Acase;
 
+/* Grille persistante (voir game_snapshot) : les cases sont découpées en
+ * morceaux de SNAPSHOT_CHUNK cases avec un compteur de références, partagés
+ * entre un jeu et ses snapshots. Une écriture ne recopie que le morceau touché
+ * (et le tableau des morceaux) s'il est partagé. Une grille partagée n'est
+ * plus jamais modifiée. Comme un snapshot peut être restauré dans un autre jeu,
+ * chaque bloc garde l'allocateur du jeu qui l'a créé, pour se libérer avec. */
+#define SNAPSHOT_CHUNK 256
+
+typedef struct {
+    uint refcount;
+    game_allocator allocator;
+    Acase cases[SNAPSHOT_CHUNK];
+} grid_chunk;
+
+struct snapshot_s {
+    uint refcount;
+    game_allocator allocator;
+    uint height;
+    uint width;
+    bool wrapping;
+    uint64_t hash;  // hashs du jeu lors du snapshot, si hash_valid
+    uint64_t shape_hash;
+    bool hash_valid;
+    size_t nb_chunks;
+    grid_chunk* chunks[];
+};
+
+/* Un jeu est alloué en un seul bloc aligné sur une ligne de cache (voir
+ * _game_alloc) : l'en-tête, les deux files de l'historique puis les cases.
+ * do_queue et undo_queue pointent vers history, et cases vers inline_cases
+ * (ou vers un tableau de extra_capacity cases si game_copy_into a dû agrandir
+ * la grille). Toute la mémoire du jeu vient de allocator.
+ * Les hashs et la grille persistante sont mis à jour par les fonctions _set_*
+ * de game_private.h ; un code qui écrit directement dans cases doit appeler
+ * _game_invalidate_caches. */
+#define GAME_ALIGNMENT 64
+
 struct game_s{
     uint height;
     uint width;
@@ -27,9 +88,82 @@ struct game_s{
     bool isWrapping;
     queue* do_queue;
     queue* undo_queue;
+    neighbours* nbrs;
     //previous_move previous;
+    uint64_t hash;        // hash de Zobrist des pièces (voir game_hash)
+    uint64_t shape_hash;  // idem, sans les orientations
+    bool hash_valid;      // false : à recalculer au prochain game_hash
+    snapshot grid;        // grille persistante, ou NULL avant game_snapshot
+    game_allocator allocator;
+    size_t capacity;  // nombre de cases de inline_cases
+    size_t extra_capacity;
+    queue history[2];
+    Acase inline_cases[];
 };
 
+/* Glyphe de chaque pièce suivi d'un espace (en UTF-8, sans fin de chaîne),
+ * tel qu'affiché par game_print. */
+typedef struct {
+    char text[4];
+    uint8_t len;
+} glyph;
+
+extern const glyph GLYPHS[NB_SHAPES][NB_DIRS];
+
+/* Fonctions internes à la bibliothèque */
+
+/* Alloue un jeu de height x width cases (non initialisées) avec l'allocateur
+ * courant (voir game_get_allocator), avec un historique vide et sans table des
+ * cases adjacentes (NULL si la taille est trop grande ou si l'allocation
+ * échoue). Le jeu se libère avec game_delete. */
+game _game_alloc(uint height, uint width);
+
+/* Écrit une case dans la grille persistante du jeu (qui doit exister), en
+ * recopiant ce qui est partagé. */
+void _grid_write(game g, uint sq, Acase c);
+
+/* Libère une référence vers une grille persistante. */
+void _grid_release(snapshot s);
+
+/* Allocation avec un allocateur, comptée dans game_get_alloc_stats. */
+void* _game_malloc(const game_allocator* a, size_t size, size_t alignment);
+void _game_free(const game_allocator* a, void* ptr, size_t size);
+bool _allocator_equal(const game_allocator* a, const game_allocator* b);
+
+/* Comme game_is_connected, sans revérifier que les arêtes sont bien appariées
+ * (à appeler après game_is_well_paired). */
+bool _game_is_connected(cgame g);
+
+/* Construit la table des cases adjacentes d'une grille avec un allocateur
+ * (NULL si l'allocation échoue). */
+neighbours* _neighbours_new(uint height, uint width, bool wrapping,
+                            const game_allocator* a);
+
+/* Libère une référence vers une table. */
+void _neighbours_release(neighbours* t);
+
+/* Prend une référence supplémentaire vers une table. */
+neighbours* _neighbours_share(neighbours* t);
+
+/* Donne au jeu g la table des cases adjacentes de src : elle est partagée si
+ * les deux jeux ont le même allocateur, et reconstruite sinon (false si
+ * l'allocation échoue). L'ancienne table de g est libérée. */
+bool _game_share_neighbours(game g, cgame src);
+
+/* Reconstruit la table des cases adjacentes du jeu si elle ne correspond plus à
+ * sa taille ou à son mode wrapping : à appeler par toute fonction qui les
+ * modifie (false si l'allocation échoue, la table est alors inchangée). */
+bool _game_update_neighbours(game g);
+
+/* Table des cases adjacentes d'un jeu dont la taille ou le mode wrapping ont
+ * été modifiés directement, sans passer par la bibliothèque. Une lecture ne
+ * modifie pas le jeu : la table est construite dans un cache propre au thread
+ * appelant (voir _game_neighbours). */
+const uint* _neighbours_fallback(cgame g);
+
+/* L'allocateur de la bibliothèque standard. */
+game_allocator _game_std_allocator(void);
+
 
 
 
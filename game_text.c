@@ -1,29 +1,421 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "game.h"
 #include "game_aux.h"
 #include "game_ext.h"
 #include "game_struct.h"
+#include "game_timing.h"
 #include "game_tools.h"
 
+/* ************************************************************************** */
+/*                            AFFICHAGE INCRÉMENTAL                           */
+/* ************************************************************************** */
+
+/* Sur un terminal, le plateau est affiché une seule fois puis seules les cases
+ * modifiées par un coup, un undo ou un redo sont repeintes, avec les séquences
+ * ANSI de positionnement du curseur. Les messages s'affichent sous le plateau,
+ * dans une zone effacée à chaque commande. Sinon (sortie redirigée, plateau
+ * plus grand que le terminal ou option --full), le plateau est réimprimé en
+ * entier après chaque commande, comme avant. */
+
+/* lignes réservées sous le plateau pour les messages et la saisie */
+#define MESSAGE_LINES 12
+
+/* bit ajouté au code d'une pièce affichée en couleur (arête mal connectée) */
+#define MISMATCH_BIT 0x80
+
+typedef struct {
+  bool incremental; /* repeindre seulement les cases modifiées */
+  bool mismatch;    /* colorer les cases ayant une arête mal connectée */
+  uint height;
+  uint width;
+  uint8_t *shown;   /* code de la pièce affichée dans chaque case */
+  uint *changed;    /* cases modifiées depuis le dernier affichage */
+} view;
+
+/* ************************************************************************** */
+
+static uint8_t _piece_code(cgame g, uint i, uint j) {
+  return game_get_piece_shape(g, i, j) * NB_DIRS +
+         game_get_piece_orientation(g, i, j);
+}
+
+static bool _is_mismatched(cgame g, uint i, uint j) {
+  for (direction d = 0; d < NB_DIRS; d++)
+    if (game_check_edge(g, i, j, d) == MISMATCH) return true;
+  return false;
+}
+
+/** the terminal is large enough for the board and the messages below it, so
+ * that no line of game_print wraps */
+static bool _fits_terminal(cgame g) {
+  struct winsize ws;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0) return false;
+  uint rows = game_nb_rows(g), cols = game_nb_cols(g);
+  // en-tête : "   " puis "<j> " pour chaque colonne
+  size_t header = 3;
+  for (uint j = 0; j < cols && header <= ws.ws_col; j++)
+    header += snprintf(NULL, 0, "%u ", j);
+  // plus longue ligne : "<i> |" puis 2 colonnes par case et "|"
+  size_t line = snprintf(NULL, 0, "%u", rows - 1) + 3 + 2 * (size_t)cols;
+  return rows + 3 + MESSAGE_LINES <= ws.ws_row && header <= ws.ws_col &&
+         line <= ws.ws_col;
+}
+
+/* ************************************************************************** */
+
+/** repaint square (i,j) if its piece or its colour has changed */
+static void _view_refresh(view *v, cgame g, uint i, uint j) {
+  uint8_t code = _piece_code(g, i, j);
+  if (v->mismatch && _is_mismatched(g, i, j)) code |= MISMATCH_BIT;
+  uint sq = i * v->width + j;
+  if (code == v->shown[sq]) return;
+  v->shown[sq] = code;
+  uint8_t piece = code & ~MISMATCH_BIT;
+  const glyph *gl = &GLYPHS[piece / NB_DIRS][piece % NB_DIRS];
+  // la case (i,j) est sur la ligne i + 3, après "<i> |" et j cases ; son
+  // glyphe est repeint sans l'espace qui le suit
+  uint col = snprintf(NULL, 0, "%u", i) + 3 + 2 * j;
+  printf("\x1b[%u;%uH%s%.*s%s", i + 3, col,
+         (code & MISMATCH_BIT) ? "\x1b[31m" : "", gl->len - 1, gl->text,
+         (code & MISMATCH_BIT) ? "\x1b[0m" : "");
+}
+
+/** a piece has changed in square (i,j): its status and those of its
+ * neighbours are updated */
+static void _view_update(view *v, cgame g, uint i, uint j) {
+  _view_refresh(v, g, i, j);
+  if (!v->mismatch) return;
+  for (direction d = 0; d < NB_DIRS; d++) {
+    uint pi, pj;
+    if (game_get_ajacent_square(g, i, j, d, &pi, &pj))
+      _view_refresh(v, g, pi, pj);
+  }
+}
+
+/* ************************************************************************** */
+
+static bool _view_init(view *v, cgame g, bool full, bool mismatch) {
+  v->height = game_nb_rows(g);
+  v->width = game_nb_cols(g);
+  v->mismatch = mismatch;
+  v->incremental = !full && isatty(STDOUT_FILENO) && _fits_terminal(g);
+  v->shown = NULL;
+  v->changed = NULL;
+  if (!v->incremental) {
+    game_print(g);
+    return true;
+  }
+  size_t size = (size_t)v->height * v->width;
+  v->shown = malloc(size);
+  v->changed = malloc(size * sizeof(uint));
+  if (!v->shown || !v->changed) return false;
+  printf("\x1b[H\x1b[2J");
+  game_print(g);
+  for (uint i = 0; i < v->height; i++)
+    for (uint j = 0; j < v->width; j++) {
+      v->shown[i * v->width + j] = _piece_code(g, i, j);
+      if (mismatch) _view_refresh(v, g, i, j);
+    }
+  printf("\x1b[%u;1H", v->height + 4);
+  fflush(stdout);
+  return true;
+}
+
+static void _view_free(view *v) {
+  free(v->shown);
+  free(v->changed);
+}
+
+/** to call before printing the messages of a command: the message area below
+ * the board is cleared */
+static void _view_begin(view *v) {
+  if (v->incremental) printf("\x1b[%u;1H\x1b[J", v->height + 4);
+}
+
+/** to call after a move in square (i,j) */
+static void _view_move(view *v, cgame g, uint i, uint j) {
+  if (!v->incremental) {
+    game_print(g);
+    return;
+  }
+  printf("\x1b" "7");  // sauvegarde du curseur
+  _view_update(v, g, i, j);
+  printf("\x1b" "8");
+  fflush(stdout);
+}
+
+/** to call after an undo, a redo or a restart: as the changed squares are not
+ * known, the board is compared with the displayed one (but only the changed
+ * squares are repainted) */
+static void _view_redraw(view *v, cgame g) {
+  if (!v->incremental) {
+    game_print(g);
+    return;
+  }
+  // les cases modifiées sont relevées avant d'en repeindre aucune, car
+  // repeindre une case met aussi à jour l'affichage de ses voisines
+  uint nb_changed = 0;
+  for (uint i = 0; i < v->height; i++)
+    for (uint j = 0; j < v->width; j++) {
+      uint sq = i * v->width + j;
+      if ((v->shown[sq] & ~MISMATCH_BIT) != _piece_code(g, i, j))
+        v->changed[nb_changed++] = sq;
+    }
+  printf("\x1b" "7");
+  for (uint k = 0; k < nb_changed; k++)
+    _view_update(v, g, v->changed[k] / v->width, v->changed[k] % v->width);
+  printf("\x1b" "8");
+  fflush(stdout);
+}
+
+/* ************************************************************************** */
+/*                                MODE SCRIPT                                 */
+/* ************************************************************************** */
+
+/* Avec --script, les commandes sont lues sur l'entrée standard, une par ligne,
+ * sans aucun affichage du plateau :
+ *   play <i> <j> [<nb_quarter_turns>]   (1 par défaut, négatif pour tourner
+ *                                        dans le sens anti-horaire)
+ *   undo
+ *   redo
+ *   restart
+ * Les lignes vides et celles qui commencent par '#' sont ignorées. À la fin,
+ * le nombre de commandes par seconde et les percentiles de la durée de
+ * game_won (appelé après chaque commande) sont affichés. L'entrée est lue par
+ * blocs et découpée à la main, pour que la lecture ne masque pas le coût des
+ * fonctions mesurées. */
+
+#define SCRIPT_BUFFER (1 << 16)
+
+typedef struct {
+  char buf[SCRIPT_BUFFER];
+  size_t pos; /* début de la prochaine ligne */
+  size_t len; /* octets lus dans buf */
+  bool eof;
+} script_reader;
+
+/** next line of the input, without its '\n' (NULL at the end or if a line is
+ * longer than the buffer) */
+static char *_script_line(script_reader *r, size_t *line_len) {
+  for (;;) {
+    char *start = r->buf + r->pos;
+    char *end = memchr(start, '\n', r->len - r->pos);
+    if (end) {
+      *line_len = end - start;
+      r->pos += *line_len + 1;
+      return start;
+    }
+    if (r->eof) {
+      if (r->pos == r->len) return NULL;
+      *line_len = r->len - r->pos;  // dernière ligne sans '\n'
+      r->pos = r->len;
+      return start;
+    }
+    // la ligne est incomplète : elle est ramenée au début du tampon
+    if (r->pos == 0 && r->len == SCRIPT_BUFFER) return NULL;
+    memmove(r->buf, start, r->len - r->pos);
+    r->len -= r->pos;
+    r->pos = 0;
+    ssize_t n = read(STDIN_FILENO, r->buf + r->len, SCRIPT_BUFFER - r->len);
+    if (n <= 0)
+      r->eof = true;
+    else
+      r->len += n;
+  }
+}
+
+static const char *_skip_blanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+/** parse an integer, returns NULL if there is none */
+static const char *_script_int(const char *p, const char *end, long *value) {
+  p = _skip_blanks(p, end);
+  bool negative = p < end && *p == '-';
+  if (negative) p++;
+  if (p == end || *p < '0' || *p > '9') return NULL;
+  long v = 0;
+  while (p < end && *p >= '0' && *p <= '9' && v < 1000000000)
+    v = v * 10 + (*p++ - '0');
+  *value = negative ? -v : v;
+  return p;
+}
+
+/** the word at p is w, followed by a blank or the end of the line */
+static bool _is_word(const char *p, const char *end, const char *w) {
+  size_t n = strlen(w);
+  return (size_t)(end - p) >= n && memcmp(p, w, n) == 0 &&
+         (p + n == end || p[n] == ' ' || p[n] == '\t' || p[n] == '\r');
+}
+
+/** run a command, returns false if it is invalid */
+static bool _script_command(game g, const char *p, const char *end) {
+  if (_is_word(p, end, "play")) {
+    long i, j, turns = 1;
+    p += 4;
+    if (!(p = _script_int(p, end, &i)) || !(p = _script_int(p, end, &j)))
+      return false;
+    const char *q = _script_int(p, end, &turns);
+    if (q) p = q;
+    if (_skip_blanks(p, end) != end || i < 0 || j < 0 ||
+        (unsigned long)i >= game_nb_rows(g) ||
+        (unsigned long)j >= game_nb_cols(g))
+      return false;
+    game_play_move(g, i, j, turns % NB_DIRS);
+  } else if (_is_word(p, end, "undo")) {
+    if (_skip_blanks(p + 4, end) != end) return false;
+    game_undo(g);
+  } else if (_is_word(p, end, "redo")) {
+    if (_skip_blanks(p + 4, end) != end) return false;
+    game_redo(g);
+  } else if (_is_word(p, end, "restart")) {
+    if (_skip_blanks(p + 7, end) != end) return false;
+    game_shuffle_orientation(g);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/* ************************************************************************** */
+
+/** print the throughput and the percentiles of the game_won latency */
+static void _script_report(uint64_t nb_commands, double seconds,
+                           double *latencies, uint64_t nb_won) {
+  printf("%" PRIu64 " commandes en %.3f s (%.0f commandes/s)\n", nb_commands,
+         seconds, nb_commands / seconds);
+  if (nb_commands == 0) return;
+  printf("game_won (us) :");
+  _print_percentiles(stdout, latencies, nb_commands, 1e6);
+  printf("\n%" PRIu64 " positions gagnantes\n", nb_won);
+}
+
+static int _script(game g) {
+  script_reader *r = malloc(sizeof(script_reader));
+  uint64_t cap = 1 << 16, nb_commands = 0, nb_won = 0, line_no = 0;
+  double *latencies = malloc(cap * sizeof(double));
+  if (!r || !latencies) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    free(r);
+    free(latencies);
+    return EXIT_FAILURE;
+  }
+  r->pos = r->len = 0;
+  r->eof = false;
+
+  bool ok = true;
+  double start = _now();
+  char *line;
+  size_t len;
+  while (ok && (line = _script_line(r, &len))) {
+    line_no++;
+    const char *end = line + len;
+    const char *p = _skip_blanks(line, end);
+    if (p == end || *p == '#') continue;
+    if (!_script_command(g, p, end)) {
+      fprintf(stderr, "Erreur : commande invalide ligne %" PRIu64 "\n",
+              line_no);
+      ok = false;
+      break;
+    }
+    if (nb_commands == cap) {
+      double *bigger = realloc(latencies, 2 * cap * sizeof(double));
+      if (!bigger) {
+        fprintf(stderr, "Error: NULL pointer detected.\n");
+        ok = false;
+        break;
+      }
+      latencies = bigger;
+      cap *= 2;
+    }
+    double t = _now();
+    bool won = game_won(g);
+    latencies[nb_commands++] = _now() - t;
+    nb_won += won;
+  }
+  if (ok && r->pos != r->len) {
+    fprintf(stderr, "Erreur : ligne %" PRIu64 " trop longue\n", line_no + 1);
+    ok = false;
+  }
+  double seconds = _now() - start;
+
+  if (ok) _script_report(nb_commands, seconds, latencies, nb_won);
+  free(latencies);
+  free(r);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ************************************************************************** */
+
+static void usage(char *argv[]) {
+  fprintf(stderr,
+          "Usage: %s [--full] [--mismatch] [--script] [<file>]\n"
+          "  --full       print the whole board after each command\n"
+          "  --mismatch   show the squares with a mismatched edge in red\n"
+          "               (only when the board is redrawn incrementally)\n"
+          "  --script     run the commands read on stdin without display\n"
+          "               (play <i> <j> [<n>], undo, redo, restart) and\n"
+          "               report the throughput\n",
+          argv[0]);
+}
+
 int main(int argc, char *argv[]) {
   game g;
+  bool full = false, mismatch = false, script = false;
+  char *input = NULL;
+
+  for (int k = 1; k < argc; k++) {
+    if (strcmp(argv[k], "--full") == 0) {
+      full = true;
+    } else if (strcmp(argv[k], "--mismatch") == 0) {
+      mismatch = true;
+    } else if (strcmp(argv[k], "--script") == 0) {
+      script = true;
+    } else if (argv[k][0] != '-' && !input) {
+      input = argv[k];
+    } else {
+      usage(argv);
+      return EXIT_FAILURE;
+    }
+  }
 
   // Charger un fichier si un argument est passé, sinon charger le jeu par
   // défaut
-  if (argc > 1) {
-    g = game_load(argv[1]);
+  if (input) {
+    g = game_load(input);
     if (!g) {
-      fprintf(stderr, "Error: Unable to load game from file %s.\n", argv[1]);
+      fprintf(stderr, "Error: Unable to load game from file %s.\n", input);
       return EXIT_FAILURE;
     }
   } else {
     g = game_default();
   }
 
-  game_print(g);
+  if (script) {
+    int status = _script(g);
+    game_delete(g);
+    return status;
+  }
+
+  view v;
+  if (!_view_init(&v, g, full, mismatch)) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    _view_free(&v);
+    game_delete(g);
+    return EXIT_FAILURE;
+  }
 
   while (!game_won(g)) {
     char player_choice;
@@ -31,7 +423,9 @@ int main(int argc, char *argv[]) {
     char filename[100];
 
     printf("> ? [ h for help ]\n");
-    scanf(" %c", &player_choice);
+    fflush(stdout);
+    if (scanf(" %c", &player_choice) != 1) break;
+    _view_begin(&v);
 
     if (player_choice == 'q') {
       printf("action: quit\nwhat a sham, you gave up :-(\n");
@@ -43,46 +437,47 @@ int main(int argc, char *argv[]) {
           "in square (i,j)\n - press 'r' to shuffle game\n - press 'q' to "
           "quit\n"
           " - press 's <filename>' to save the current state of the game\n");
-      game_print(g);
-
-    } else if (player_choice == 'c') {
-      scanf("%d %d", &i, &j);
-      printf("action: play move 'c' into (%d,%d) square\n", i, j);
-      game_play_move(g, i, j, 1);
-      game_print(g);
+      if (!v.incremental) game_print(g);
 
-    } else if (player_choice == 'a') {
-      scanf("%d %d", &i, &j);
-      printf("action: play move 'a' into (%d,%d) square\n", i, j);
-      game_play_move(g, i, j, -1);
-      game_print(g);
+    } else if (player_choice == 'c' || player_choice == 'a') {
+      if (scanf("%d %d", &i, &j) != 2 || i < 0 || j < 0 ||
+          (uint)i >= v.height || (uint)j >= v.width) {
+        printf("invalid square\n");
+        continue;
+      }
+      printf("action: play move '%c' into (%d,%d) square\n", player_choice, i,
+             j);
+      game_play_move(g, i, j, player_choice == 'c' ? 1 : -1);
+      _view_move(&v, g, i, j);
 
     } else if (player_choice == 'r') {
       printf("action: restart\n");
       game_shuffle_orientation(g);
-      game_print(g);
+      _view_redraw(&v, g);
 
     } else if (player_choice == 'z') {
       game_undo(g);
-      game_print(g);
+      _view_redraw(&v, g);
 
     } else if (player_choice == 'y') {
       game_redo(g);
-      game_print(g);
+      _view_redraw(&v, g);
 
     } else if (player_choice == 's') {
-      scanf("%s", filename);
+      if (scanf("%99s", filename) != 1) break;
       game_save(g, filename);
       printf("Game successfully saved in %s\n", filename);
     }
 
     if (game_won(g)) {
       printf("Congratulations!!\n");
+      _view_free(&v);
       game_delete(g);
       return EXIT_SUCCESS;
     }
   }
 
+  _view_free(&v);
   game_delete(g);
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,50 @@
+/**
+ * @file game_timing.h
+ * @brief Internal Timing Helpers.
+ * @details Clock and latency percentiles shared by the measuring programs
+ * (game_text, game_solve and game_bench). The including file must request
+ * POSIX.1-2008 (_POSIX_C_SOURCE) for clock_gettime.
+ * @copyright University of Bordeaux. All rights reserved, 2024.
+ **/
+
+#ifndef __GAME_TIMING_H__
+#define __GAME_TIMING_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** monotonic time in seconds */
+static inline double _now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static inline int _compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Prints the median, p90, p99 and maximum of a series of durations.
+ * @details The series is sorted in place; the values (in seconds) are
+ * multiplied by @p scale before printing, as " p50 <value> p90 ...", without
+ * a trailing newline.
+ * @param out the output stream
+ * @param samples the durations, in seconds
+ * @param nb_samples their number, at least 1
+ * @param scale unit conversion (1e3 for milliseconds, 1e6 for microseconds)
+ **/
+static inline void _print_percentiles(FILE *out, double *samples,
+                                      uint64_t nb_samples, double scale) {
+  qsort(samples, nb_samples, sizeof(double), _compare_double);
+  const double percentiles[] = {50, 90, 99, 100};
+  for (unsigned k = 0; k < 4; k++) {
+    uint64_t rank = (uint64_t)(percentiles[k] / 100 * (nb_samples - 1) + 0.5);
+    fprintf(out, " p%g %.3f", percentiles[k], samples[rank] * scale);
+  }
+}
+
+#endif  // __GAME_TIMING_H__
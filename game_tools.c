@@ -1,38 +1,32 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "game_tools.h"
 
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "game.h"
 #include "game_aux.h"
 #include "game_ext.h"
+#include "game_private.h"
 #include "game_struct.h"
 
 // @copyright University of Bordeaux. All rights reserved, 2024.
 
 /* ************************************************************************** */
 
-/** @brief Hard-coding of pieces (shape & orientation) in an integer array.
- * @details The 4 least significant bits encode the presence of an half-edge in
- * the N-E-S-W directions (in that order). Thus, binary coding 1100 represents
- * the piece "└" (a corner in north orientation).
- */
-static uint _code[NB_SHAPES][NB_DIRS] = {
-    {0b0000, 0b0000, 0b0000, 0b0000},  // EMPTY {" ", " ", " ", " "}
-    {0b1000, 0b0100, 0b0010, 0b0001},  // ENDPOINT {"^", ">", "v", "<"},
-    {0b1010, 0b0101, 0b1010, 0b0101},  // SEGMENT {"|", "-", "|", "-"},
-    {0b1100, 0b0110, 0b0011, 0b1001},  // CORNER {"└", "┌", "┐", "┘"}
-    {0b1101, 0b1110, 0b0111, 0b1011},  // TEE {"┴", "├", "┬", "┤"}
-    {0b1111, 0b1111, 0b1111, 0b1111}   // CROSS {"+", "+", "+", "+"}
-};
-
-/* ************************************************************************** */
-
-/** encode a shape and an orientation into an integer code */
-static uint _encode_shape(shape s, direction o) { return _code[s][o]; }
+/** encode a shape and an orientation into an integer code (see HALF_EDGES) */
+static uint _encode_shape(shape s, direction o) { return HALF_EDGES[s][o]; }
 
 /* ************************************************************************** */
 
@@ -43,7 +37,7 @@ static bool _decode_shape(uint code, shape *s, direction *o) {
   assert(o);
   for (int i = 0; i < NB_SHAPES; i++)
     for (int j = 0; j < NB_DIRS; j++)
-      if (code == _code[i][j]) {
+      if (code == HALF_EDGES[i][j]) {
         *s = i;
         *o = j;
         return true;
@@ -53,25 +47,20 @@ static bool _decode_shape(uint code, shape *s, direction *o) {
 
 /* ************************************************************************** */
 
-/** add an half-edge in the direction d */
-static void _add_half_edge(game g, uint i, uint j, direction d) {
+/** add an half-edge in the direction d to square sq */
+static void _add_half_edge(game g, uint sq, direction d) {
   assert(g);
-  assert(i < game_nb_rows(g));
-  assert(j < game_nb_cols(g));
   assert(d < NB_DIRS);
 
-  shape s = game_get_piece_shape(g, i, j);
-  direction o = game_get_piece_orientation(g, i, j);
-  uint code = _encode_shape(s, o);
-  uint mask = 0b1000 >> d;     // mask with half-edge in the direction d
+  uint code = _half_edges(g->cases[sq]);
+  uint mask = HALF_EDGE_BIT(d);  // mask with half-edge in the direction d
   assert((code & mask) == 0);  // check there is no half-edge in the direction d
   uint newcode = code | mask;  // add the half-edge in the direction d
   shape news;
   direction newo;
   bool ok = _decode_shape(newcode, &news, &newo);
   assert(ok);
-  game_set_piece_shape(g, i, j, news);
-  game_set_piece_orientation(g, i, j, newo);
+  _set_square(g, sq, news, newo);
 }
 
 /* ************************************************************************** */
@@ -100,103 +89,312 @@ static bool _add_edge(game g, uint i, uint j, direction d) {
   assert(j < game_nb_cols(g));
   assert(d < NB_DIRS);
 
-  uint nexti, nextj;
-  bool next = game_get_ajacent_square(g, i, j, d, &nexti, &nextj);
-  if (!next) return false;
+  uint sq = _index(g, i, j);
+  uint next = _game_neighbours(g)[sq * NB_DIRS + d];
+  if (next == NO_NEIGHBOUR) return false;
 
   // check if the two half-edges are free
-  bool he = game_has_half_edge(g, i, j, d);
-  if (he) return false;
-  bool next_he = game_has_half_edge(g, nexti, nextj, OPPOSITE_DIR(d));
-  if (next_he) return false;
+  if (_has_half_edge(g->cases[sq], d)) return false;
+  if (_has_half_edge(g->cases[next], OPPOSITE_DIR(d))) return false;
+
+  _add_half_edge(g, sq, d);
+  _add_half_edge(g, next, OPPOSITE_DIR(d));
+
+  return true;
+}
+
+/* ************************************************************************** */
+
+/** xorshift64* generator, used where a reentrant generator is needed */
+static uint64_t _xorshift(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+/* ************************************************************************** */
+
+/** random number from a given generator, or from rand() if rng is NULL */
+static uint _random(uint64_t *rng) {
+  if (rng == NULL) return rand();
+  return _xorshift(rng) >> 33;
+}
+
+/* ************************************************************************** */
+
+/* ************************************************************************** */
+/*                               TEXT FORMAT                                  */
+/* ************************************************************************** */
+
+/** letter of each shape and orientation (plus one, 0 meaning invalid) */
+static const uint8_t CHAR2SHAPE[256] = {
+    ['E'] = EMPTY + 1, ['N'] = ENDPOINT + 1, ['S'] = SEGMENT + 1,
+    ['C'] = CORNER + 1, ['T'] = TEE + 1, ['X'] = CROSS + 1};
+static const uint8_t CHAR2DIR[256] = {['N'] = NORTH + 1, ['E'] = EAST + 1,
+                                      ['S'] = SOUTH + 1, ['W'] = WEST + 1};
+
+/** white spaces, as skipped by a space in a scanf format */
+static const bool IS_SPACE[256] = {[' '] = true,  ['\t'] = true, ['\n'] = true,
+                                   ['\v'] = true, ['\f'] = true, ['\r'] = true};
+
+/* ************************************************************************** */
+
+/** print a parse error with its line and column, buf[0] being at the start
+ * of line first_line */
+static void _parse_error(const char *buf, size_t pos, const char *what,
+                         uint first_line) {
+  uint line = first_line, col = 1;
+  for (size_t k = 0; k < pos; k++) {
+    if (buf[k] == '\n') {
+      line++;
+      col = 1;
+    } else {
+      col++;
+    }
+  }
+  fprintf(stderr, "Error: %s at line %u, column %u.\n", what, line, col);
+}
+
+/* ************************************************************************** */
+
+static size_t _skip_spaces(const char *buf, size_t len, size_t pos) {
+  while (pos < len && IS_SPACE[(uint8_t)buf[pos]]) pos++;
+  return pos;
+}
 
-  _add_half_edge(g, i, j, d);
-  _add_half_edge(g, nexti, nextj, OPPOSITE_DIR(d));
+/* ************************************************************************** */
 
+/** parse an unsigned integer at *pos, after optional white spaces */
+static bool _parse_uint(const char *buf, size_t len, size_t *pos, uint *value) {
+  size_t k = _skip_spaces(buf, len, *pos);
+  *pos = k;  // position of the number, for the error messages
+  uint64_t v = 0;
+  while (k < len && buf[k] >= '0' && buf[k] <= '9') {
+    v = v * 10 + (buf[k++] - '0');
+    if (v > UINT_MAX) return false;
+  }
+  if (k == *pos) return false;
+  *pos = k;
+  *value = v;
   return true;
 }
 
 /* ************************************************************************** */
 
+/**
+ * @brief Parses a game in the text format of game_save.
+ * @details The game starts at @p *pos, which is updated to the first
+ * character after the game (and its trailing white spaces). On error, @p *pos
+ * is the position of the error, which is @p len if the game is truncated.
+ * @return the game, or NULL on error (with its description in @p *error)
+ */
+static game _parse_game(const char *buf, size_t len, size_t *pos,
+                        const char **error) {
+  uint height, width, wrapping;
+  size_t k = *pos;
+  if (!_parse_uint(buf, len, &k, &height) ||
+      !_parse_uint(buf, len, &k, &width) ||
+      !_parse_uint(buf, len, &k, &wrapping)) {
+    *error = k < len ? "invalid number" : "unexpected end of file";
+    *pos = k;
+    return NULL;
+  }
+  if (height < 1 || width < 1 || height > MAX_SQUARES / width) {
+    *error = "invalid size";
+    *pos = _skip_spaces(buf, len, *pos);
+    return NULL;
+  }
+
+  game g = game_new_empty_ext(height, width, wrapping != 0);
+  if (g == NULL) {
+    *error = "allocation failure";
+    return NULL;
+  }
+
+  size_t nb_squares = (size_t)height * width;
+  for (size_t sq = 0; sq < nb_squares; sq++) {
+    k = _skip_spaces(buf, len, k);
+    uint8_t s = k < len ? CHAR2SHAPE[(uint8_t)buf[k]] : 0;
+    uint8_t o = k + 1 < len ? CHAR2DIR[(uint8_t)buf[k + 1]] : 0;
+    if (s == 0 || o == 0) {
+      game_delete(g);
+      *pos = (s == 0) ? k : k + 1;
+      *error = *pos == len       ? "unexpected end of file"
+               : s == 0 ? "invalid shape"
+                        : "invalid orientation";
+      return NULL;
+    }
+    g->cases[sq].shape = s - 1;
+    g->cases[sq].orientation = o - 1;
+    k += 2;
+  }
+  *pos = _skip_spaces(buf, len, k);
+  return g;
+}
+
+/* ************************************************************************** */
+
+/** read a whole file descriptor into a buffer, to be freed by the caller */
+static char *_read_all(int fd, size_t *len) {
+  size_t capacity = 4096;
+  char *buf = malloc(capacity);
+  *len = 0;
+  while (buf) {
+    if (*len == capacity) {
+      char *bigger = realloc(buf, 2 * capacity);
+      if (!bigger) break;
+      buf = bigger;
+      capacity *= 2;
+    }
+    ssize_t n = read(fd, buf + *len, capacity - *len);
+    if (n == 0) return buf;
+    if (n < 0) break;
+    *len += n;
+  }
+  free(buf);
+  return NULL;
+}
+
+/* ************************************************************************** */
+
+game game_load_mem(const char *buf, size_t len) {
+  if (buf == NULL && len > 0) return NULL;
+  size_t pos = 0;
+  const char *error;
+  game g = _parse_game(buf, len, &pos, &error);
+  if (g == NULL) _parse_error(buf, pos, error, 1);
+  return g;
+}
+
+/* ************************************************************************** */
+
+game game_load_fd(int fd) {
+  size_t len;
+  char *buf = _read_all(fd, &len);
+  if (buf == NULL) {
+    fprintf(stderr, "Error: unable to read the game.\n");
+    return NULL;
+  }
+  game g = game_load_mem(buf, len);
+  free(buf);
+  return g;
+}
+
+/* ************************************************************************** */
+
 game game_load(char *filename) {
   if (filename == NULL) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
 
-  FILE *file = fopen(filename, "r");
-
-  if (file == NULL) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
 
-  uint height, width, wrapp;
-  bool isWrapping;
+  // a regular file is parsed in place, anything else is read in a buffer
+  struct stat st;
+  game g;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map != MAP_FAILED) {
+    g = game_load_mem(map, st.st_size);
+    munmap(map, st.st_size);
+  } else {
+    g = game_load_fd(fd);
+  }
+  close(fd);
+  return g;
+}
+
+/** text of each piece, as written by game_save */
+static const char PIECE2TEXT[NB_SHAPES][NB_DIRS][2] = {
+    {"EN", "EE", "ES", "EW"}, {"NN", "NE", "NS", "NW"},
+    {"SN", "SE", "SS", "SW"}, {"CN", "CE", "CS", "CW"},
+    {"TN", "TE", "TS", "TW"}, {"XN", "XE", "XS", "XW"}};
 
-  fscanf(file, "%d %d %d\n", &height, &width, &wrapp);
+/* ************************************************************************** */
+
+/** write the header line of a game; return its length */
+static size_t _text_header(cgame g, char header[32]) {
+  return snprintf(header, 32, "%u %u %d\n", g->height, g->width,
+                  g->isWrapping);
+}
+
+/* ************************************************************************** */
+
+/** write the squares [first, last) of a game, with the row ends; return the
+ * end of the written text */
+static char *_text_squares(cgame g, size_t first, size_t last, char *out) {
+  for (size_t sq = first; sq < last; sq++) {
+    Acase c = g->cases[sq];
+    assert(c.shape < NB_SHAPES && c.orientation < NB_DIRS);
+    memcpy(out, PIECE2TEXT[c.shape][c.orientation], 2);
+    out[2] = ' ';
+    out += 3;
+    if ((sq + 1) % g->width == 0) *out++ = '\n';
+  }
+  return out;
+}
 
-  isWrapping = (wrapp == 0) ? false : true;
+/* ************************************************************************** */
 
-  game g = game_new_empty_ext(height, width, isWrapping);
+size_t game_save_mem(cgame g, char *buf, size_t cap) {
   if (g == NULL) {
-    fprintf(stderr, "Error : NULL pointer detected.\n");
+    fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
+  char header[32];
+  size_t header_len = _text_header(g, header);
+  size_t len = header_len + (size_t)g->height * (3 * (size_t)g->width + 1);
+  if (len > cap) return len;
+  memcpy(buf, header, header_len);
+  _text_squares(g, 0, (size_t)g->height * g->width, buf + header_len);
+  return len;
+}
 
-  for (int i = 0; i < height; i++) {
-    for (int j = 0; j < width; j++) {
-      char shape, orientation;
-      fscanf(file, "%c%c ", &shape, &orientation);
-
-      switch (shape) {
-        case 'E':
-          g->cases[i * g->width + j].shape = EMPTY;
-          break;
-        case 'N':
-          g->cases[i * g->width + j].shape = ENDPOINT;
-          break;
-        case 'S':
-          g->cases[i * g->width + j].shape = SEGMENT;
-          break;
-        case 'C':
-          g->cases[i * g->width + j].shape = CORNER;
-          break;
-        case 'T':
-          g->cases[i * g->width + j].shape = TEE;
-          break;
-        case 'X':
-          g->cases[i * g->width + j].shape = CROSS;
-          break;
-        default:
-          fprintf(stderr, "Error: Invalid shape detected.\n");
-          break;
-      }
+/* ************************************************************************** */
 
-      switch (orientation) {
-        case 'N':
-          g->cases[i * g->width + j].orientation = NORTH;
-          break;
-        case 'S':
-          g->cases[i * g->width + j].orientation = SOUTH;
-          break;
-        case 'E':
-          g->cases[i * g->width + j].orientation = EAST;
-          break;
-        case 'W':
-          g->cases[i * g->width + j].orientation = WEST;
-          break;
-        default:
-          fprintf(stderr, "Error: Invalid orientation detected.\n");
-          break;
-      }
-    }
-    fscanf(file, "\n");
+static bool _write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
   }
-  fclose(file);
-  return g;
+  return true;
+}
+
+/* ************************************************************************** */
+
+/** number of squares serialised at once by game_save_fd */
+#define SAVE_CHUNK 4096
+
+bool game_save_fd(cgame g, int fd) {
+  if (g == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  // at most 4 characters per square, with its row end
+  char buf[4 * SAVE_CHUNK];
+  size_t len = _text_header(g, buf);
+  if (!_write_all(fd, buf, len)) return false;
+  size_t nb_squares = (size_t)g->height * g->width;
+  for (size_t first = 0; first < nb_squares; first += SAVE_CHUNK) {
+    size_t last = first + SAVE_CHUNK < nb_squares ? first + SAVE_CHUNK
+                                                  : nb_squares;
+    char *end = _text_squares(g, first, last, buf);
+    if (!_write_all(fd, buf, end - buf)) return false;
+  }
+  return true;
 }
 
+/* ************************************************************************** */
+
 void game_save(cgame g, char *filename) {
   if (g == NULL) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
@@ -208,69 +406,219 @@ void game_save(cgame g, char *filename) {
     exit(EXIT_FAILURE);
   }
 
-  FILE *file = fopen(filename, "w");
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 
-  if (file == NULL) {
+  if (fd < 0) {
     fprintf(stderr, "Error: NULL pointer detected.\n");
     exit(EXIT_FAILURE);
   }
 
-  fprintf(file, "%d %d %d\n", g->height, g->width, g->isWrapping);
-
-  for (int i = 0; i < g->height; i++) {
-    for (int j = 0; j < g->width; j++) {
-      switch (g->cases[i * g->width + j].shape) {
-        case EMPTY:
-          fprintf(file, "E");
-          break;
-        case ENDPOINT:
-          fprintf(file, "N");
-          break;
-        case SEGMENT:
-          fprintf(file, "S");
-          break;
-        case CORNER:
-          fprintf(file, "C");
-          break;
-        case TEE:
-          fprintf(file, "T");
-          break;
-        case CROSS:
-          fprintf(file, "X");
-          break;
-        default:
-          fprintf(stderr, "Error: Invalid shape detected.\n");
-          break;
-      }
+  if (!game_save_fd(g, fd)) {
+    fprintf(stderr, "Error: unable to write the game in %s.\n", filename);
+  }
+  close(fd);
+}
+
+/* ************************************************************************** */
+/*                              STREAMS OF GAMES                              */
+/* ************************************************************************** */
+
+/** size of the buffers of the readers and writers */
+#define STREAM_BUFFER (64 * 1024)
+
+struct game_reader_s {
+  int fd;
+  bool owned;       // fd was opened by game_reader_open
+  char *buf;
+  size_t capacity;
+  size_t pos, len;  // unread data buf[pos..len)
+  uint line;        // line number of buf[0], for the error messages
+  bool eof;
+  bool error;
+};
+
+struct game_writer_s {
+  int fd;
+  bool owned;  // fd was opened by game_writer_open
+  char *buf;
+  size_t len;
+  bool error;
+};
+
+/* ************************************************************************** */
+
+/** drop the data already parsed, then read until at least target bytes are
+ * available or the end of the file is reached */
+static bool _reader_fill(game_reader *r, size_t target) {
+  const char *nl = r->buf;
+  while ((nl = memchr(nl, '\n', r->buf + r->pos - nl)) != NULL) {
+    r->line++;
+    nl++;
+  }
+  memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+  r->len -= r->pos;
+  r->pos = 0;
+  if (target > r->capacity) {
+    size_t capacity = 2 * r->capacity > target ? 2 * r->capacity : target;
+    char *buf = realloc(r->buf, capacity);
+    if (buf == NULL) return false;
+    r->buf = buf;
+    r->capacity = capacity;
+  }
+  while (!r->eof && r->len < target) {
+    ssize_t n = read(r->fd, r->buf + r->len, r->capacity - r->len);
+    if (n < 0) return false;
+    if (n == 0) r->eof = true;
+    r->len += n;
+  }
+  return true;
+}
+
+/* ************************************************************************** */
+
+game_reader *game_reader_open(const char *filename) {
+  bool std = filename == NULL || strcmp(filename, "-") == 0;
+  int fd = std ? STDIN_FILENO : open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+  game_reader *r = malloc(sizeof(game_reader));
+  char *buf = malloc(STREAM_BUFFER);
+  if (r == NULL || buf == NULL) {
+    free(r);
+    free(buf);
+    if (!std) close(fd);
+    return NULL;
+  }
+  *r = (game_reader){.fd = fd, .owned = !std, .buf = buf,
+                     .capacity = STREAM_BUFFER, .line = 1};
+  return r;
+}
+
+/* ************************************************************************** */
 
-      switch (g->cases[i * g->width + j].orientation) {
-        case NORTH:
-          fprintf(file, "N");
-          break;
-        case SOUTH:
-          fprintf(file, "S");
-          break;
-        case EAST:
-          fprintf(file, "E");
-          break;
-        case WEST:
-          fprintf(file, "W");
-          break;
-        default:
-          fprintf(stderr, "Error: Invalid orientation detected.\n");
-          break;
+game game_reader_next(game_reader *r) {
+  if (r == NULL || r->error) return NULL;
+  for (;;) {
+    r->pos = _skip_spaces(r->buf, r->len, r->pos);
+    size_t avail = r->len - r->pos;
+    if (avail > 0) {
+      size_t pos = r->pos;
+      const char *error;
+      game g = _parse_game(r->buf, r->len, &pos, &error);
+      if (g) {
+        r->pos = pos;
+        return g;
+      }
+      if (pos < r->len || r->eof) {
+        _parse_error(r->buf, pos, error, r->line);
+        r->error = true;
+        return NULL;
       }
+    } else if (r->eof) {
+      return NULL;
+    }
+    // truncated game: read at least twice as much before parsing it again
+    if (!_reader_fill(r, avail > 0 ? 2 * avail : 1)) {
+      fprintf(stderr, "Error: unable to read the games.\n");
+      r->error = true;
+      return NULL;
+    }
+  }
+}
+
+/* ************************************************************************** */
+
+bool game_reader_error(const game_reader *r) {
+  assert(r);
+  return r->error;
+}
+
+/* ************************************************************************** */
+
+void game_reader_close(game_reader *r) {
+  if (r == NULL) return;
+  if (r->owned) close(r->fd);
+  free(r->buf);
+  free(r);
+}
+
+/* ************************************************************************** */
+
+game_writer *game_writer_open(const char *filename) {
+  bool std = filename == NULL || strcmp(filename, "-") == 0;
+  int fd = std ? STDOUT_FILENO : open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return NULL;
+  game_writer *w = malloc(sizeof(game_writer));
+  char *buf = malloc(STREAM_BUFFER);
+  if (w == NULL || buf == NULL) {
+    free(w);
+    free(buf);
+    if (!std) close(fd);
+    return NULL;
+  }
+  *w = (game_writer){.fd = fd, .owned = !std, .buf = buf};
+  return w;
+}
+
+/* ************************************************************************** */
+
+static bool _writer_flush(game_writer *w) {
+  if (!w->error && !_write_all(w->fd, w->buf, w->len)) w->error = true;
+  w->len = 0;
+  return !w->error;
+}
 
-      fprintf(file, " ");
+/* ************************************************************************** */
+
+bool game_writer_write(game_writer *w, cgame g) {
+  if (w == NULL || g == NULL || w->error) return false;
+  size_t len = game_save_mem(g, w->buf + w->len, STREAM_BUFFER - w->len);
+  if (len <= STREAM_BUFFER - w->len) {
+    w->len += len;
+    return true;
+  }
+  if (!_writer_flush(w)) return false;
+  if (len <= STREAM_BUFFER) {
+    w->len = game_save_mem(g, w->buf, STREAM_BUFFER);
+    return true;
+  }
+  // larger than the buffer: written directly
+  if (!game_save_fd(g, w->fd)) w->error = true;
+  return !w->error;
+}
+
+/* ************************************************************************** */
+
+bool game_writer_close(game_writer *w) {
+  if (w == NULL) return true;
+  bool ok = _writer_flush(w);
+  if (w->owned && close(w->fd) != 0) ok = false;
+  free(w->buf);
+  free(w);
+  return ok;
+}
+
+/* ************************************************************************** */
+
+/** push the candidate edges from a square towards its empty neighbours (a
+ * candidate is the index sq * NB_DIRS + d of the neighbour table) */
+static size_t _push_frontier(cgame g, const uint *nbrs, uint *frontier,
+                             size_t nb_candidates, uint sq) {
+  for (direction d = 0; d < NB_DIRS; d++) {
+    uint next = nbrs[sq * NB_DIRS + d];
+    if (next != NO_NEIGHBOUR && g->cases[next].shape == EMPTY) {
+      frontier[nb_candidates++] = sq * NB_DIRS + d;
     }
-    fprintf(file, "\n");
   }
-  fclose(file);
+  return nb_candidates;
 }
 
-game game_random(uint nb_rows, uint nb_cols, bool wrapping, uint nb_empty,
-                 uint nb_extra) {
-  if (nb_cols * nb_rows < 2 || nb_empty > nb_cols * nb_rows - 2) {
+/* ************************************************************************** */
+
+/** generate a random game solution, drawing from a given generator */
+static game _random_game(uint64_t *rng, uint nb_rows, uint nb_cols,
+                         bool wrapping, uint nb_empty, uint nb_extra) {
+  size_t nb_squares = (size_t)nb_rows * nb_cols;
+  if (nb_squares < 2 || nb_empty > nb_squares - 2) {
     return NULL;
   }
 
@@ -279,45 +627,63 @@ game game_random(uint nb_rows, uint nb_cols, bool wrapping, uint nb_empty,
     return NULL;
   }
 
-  uint i1 = rand() % nb_rows;
-  uint j1 = rand() % nb_cols;
-  direction d = rand() % NB_DIRS;
+  /* The tree grows from a frontier of candidate edges (from a piece towards an
+   * empty square). Drawing a candidate at random, and dropping the ones whose
+   * target has been filled meanwhile, gives the same distribution as drawing
+   * random squares and directions over the whole grid, but in linear time. */
+  const uint *nbrs = _game_neighbours(g);
+  uint *frontier = malloc(nb_squares * NB_DIRS * sizeof(uint));
+  if (frontier == NULL) {
+    game_delete(g);
+    return NULL;
+  }
+  size_t nb_candidates = 0;
+
+  uint i1 = _random(rng) % nb_rows;
+  uint j1 = _random(rng) % nb_cols;
+  direction d = _random(rng) % NB_DIRS;
 
   do {
     // Placer un jeu solution à 2 pièces (soit horizontalement, soit
     // verticalement)
-    i1 = rand() % nb_rows;
-    j1 = rand() % nb_cols;
-    d = rand() % NB_DIRS;
+    i1 = _random(rng) % nb_rows;
+    j1 = _random(rng) % nb_cols;
+    d = _random(rng) % NB_DIRS;
 
   } while (!_add_edge(g, i1, j1, d));  // les deux premières pièces
 
-  int nbPieces = nb_rows * nb_cols - nb_empty - 2;
-  uint i2, j2;
+  uint sq = i1 * nb_cols + j1;
+  nb_candidates = _push_frontier(g, nbrs, frontier, nb_candidates, sq);
+  nb_candidates =
+      _push_frontier(g, nbrs, frontier, nb_candidates, nbrs[sq * NB_DIRS + d]);
+
+  size_t nbPieces = nb_squares - nb_empty - 2;
 
   while (nbPieces > 0) {
-    i1 = rand() % nb_rows;
-    j1 = rand() % nb_cols;
-    d = rand() % NB_DIRS;
+    assert(nb_candidates > 0);
+    size_t k = _random(rng) % nb_candidates;
+    uint candidate = frontier[k];
+    frontier[k] = frontier[--nb_candidates];
 
-    if (game_get_piece_shape(g, i1, j1) != EMPTY &&
-        game_get_ajacent_square(g, i1, j1, d, &i2, &j2) &&
-        game_get_piece_shape(g, i2, j2) == EMPTY) {
-      if (_add_edge(g, i1, j1, d)) {
-        nbPieces--;
-      }
-    }
+    uint next = nbrs[candidate];
+    if (g->cases[next].shape != EMPTY) continue;
+
+    sq = candidate / NB_DIRS;
+    _add_edge(g, sq / nb_cols, sq % nb_cols, candidate % NB_DIRS);
+    nb_candidates = _push_frontier(g, nbrs, frontier, nb_candidates, next);
+    nbPieces--;
   }
+  free(frontier);
 
   while (nb_extra > 0) {
-    i1 = rand() % nb_rows;
-    j1 = rand() % nb_cols;
-    d = rand() % NB_DIRS;
-
-    if (game_get_piece_shape(g, i1, j1) != EMPTY &&
-        game_get_ajacent_square(g, i1, j1, d, &i2, &j2) &&
-        game_get_piece_shape(g, i2, j2) != EMPTY &&
-        game_check_edge(g, i1, j1, d) != MATCH) {
+    i1 = _random(rng) % nb_rows;
+    j1 = _random(rng) % nb_cols;
+    d = _random(rng) % NB_DIRS;
+
+    sq = _index(g, i1, j1);
+    uint next = nbrs[sq * NB_DIRS + d];
+    if (g->cases[sq].shape != EMPTY && next != NO_NEIGHBOUR &&
+        g->cases[next].shape != EMPTY && _check_edge(g, sq, d) != MATCH) {
       if (_add_edge(g, i1, j1, d)) {
         nb_extra--;
       }
@@ -327,54 +693,1598 @@ game game_random(uint nb_rows, uint nb_cols, bool wrapping, uint nb_empty,
   return g;
 }
 
-void recSolve(game g, uint index, uint *count, bool trouverPremier) {
-  if (game_won(g)) {
-    (*count)++;
-    if (trouverPremier)
-      return;  // Arrêter dès qu'on trouve une solution choisi par l'utilisateur
+/* ************************************************************************** */
+
+game game_random(uint nb_rows, uint nb_cols, bool wrapping, uint nb_empty,
+                 uint nb_extra) {
+  return _random_game(NULL, nb_rows, nb_cols, wrapping, nb_empty, nb_extra);
+}
+
+/* ************************************************************************** */
+
+/* ************************************************************************** */
+/*                                  SOLVER                                    */
+/* ************************************************************************** */
+
+/* The solver is a depth-first search over the orientation of each square, with
+ * forward checking on the edges between adjacent squares. Each square holds a
+ * domain (bit o is set if orientation o is still allowed). A square whose
+ * domain becomes a singleton is assigned by propagation, and the next square to
+ * decide is one with the smallest domain, the most recently reduced one first
+ * so that the search stays local. To find it without scanning the grid, the
+ * squares are kept in one pending stack per domain size, which is updated
+ * lazily: a square is pushed again each time its domain changes, and the stale
+ * entries are dropped when they are met.
+ *
+ * The assigned squares are grouped in connected components by a union-find
+ * (without path compression, so that it can be rolled back), which counts the
+ * half-edges of each component leading to unassigned squares. A component that
+ * gets closed before it holds all the pieces can never be part of a solution,
+ * so the branch is cut at once instead of at the leaves.
+ *
+ * When looking for a single solution, the search is restarted following the
+ * Luby sequence, so that one bad early branch cannot dominate the solve time.
+ * Before each restart, the values refuted close to the root are recorded as
+ * small nogoods (forbidden partial assignments) which remain valid across
+ * restarts. */
+
+#define NO_SQUARE NO_NEIGHBOUR /* also the off-grid value of the neighbours */
+#define UNASSIGNED 0xFF
+#define LUBY_UNIT 32          /* min nb of failures per unit of the Luby seq. */
+#define NOGOOD_MAX_SIZE 4     /* max nb of squares in a nogood */
+#define NOGOOD_MAX_COUNT 4096 /* max nb of recorded nogoods */
+
+#define HAS_HALF_EDGE(code, d) (((code) >> (NB_DIRS - 1 - (d))) & 1)
+
+/** a square with a given orientation */
+typedef struct {
+  uint sq;
+  uint8_t o;
+} literal;
+
+/** a forbidden partial assignment */
+typedef struct {
+  uint size;
+  literal lits[NOGOOD_MAX_SIZE];
+} nogood;
+
+/** the state of a square before it was modified, used to backtrack */
+typedef struct {
+  uint sq;
+  uint uf_mark; /* length of the union-find trail when sq was assigned */
+  uint8_t dom;
+  uint8_t val;
+} trail_entry;
+
+/** a merge of two components (or the closing of a cycle if child is
+ * NO_SQUARE), used to roll back the union-find */
+typedef struct {
+  uint child;
+  uint root;
+  uint open; /* nb of open half-edges of root before the merge */
+} uf_entry;
+
+/** a branching point of the search */
+typedef struct {
+  uint sq;       /* decided square */
+  uint mark;     /* trail length before the decision */
+  uint8_t dom;   /* domain of the square when the decision was taken */
+  uint8_t tried; /* orientations already tried */
+  uint8_t cur;   /* orientation under exploration (or UNASSIGNED) */
+} decision;
+
+typedef struct {
+  uint nb_squares;
+  uint nb_assigned;
+  const uint *nbr; /* adjacent square in each direction (or NO_SQUARE) */
+  uint8_t *code; /* half-edge code of each square in each orientation */
+  uint8_t *dom;  /* current domain of each square */
+  uint8_t *val;  /* assigned orientation of each square (or UNASSIGNED) */
+  trail_entry *trail;
+  uint trail_len;
+  uint *prop; /* squares waiting to be assigned by propagation */
+  uint prop_len;
+  decision *stack;
+  uint depth;
+  uint nb_pieces;
+  bool tree; /* no solution can contain a cycle */
+  uint *uf_parent; /* union-find over the edges between assigned squares */
+  uint *uf_size;   /* nb of squares of a component (at its root) */
+  uint *uf_open;   /* nb of half-edges of a component towards the others */
+  uf_entry *uf_trail;
+  uint uf_len;
+  uint *pending[NB_DIRS + 1]; /* squares by domain size (lazily updated) */
+  uint pending_len[NB_DIRS + 1];
+  uint *bfs; /* work buffers of the connectivity check */
+  uint *seen;
+  uint stamp;
+  nogood *nogoods;
+  uint nb_nogoods;
+  uint *ng_head; /* first nogood literal involving each square */
+  uint *ng_next; /* next nogood literal involving the same square */
+  uint64_t rng;
+  uint64_t nb_fails;
+} solver;
+
+static const uint8_t _popcount[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                      1, 2, 2, 3, 2, 3, 3, 4};
+
+/* ************************************************************************** */
+
+static void *_solver_alloc(size_t size) {
+  void *p = malloc(size);
+  if (p == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
   }
+  return p;
+}
+
+/* ************************************************************************** */
+
+/** random number local to the solver, to keep it reentrant */
+static uint64_t _solver_random(solver *s) { return _xorshift(&s->rng); }
+
+/* ************************************************************************** */
 
-  if (index == g->width * g->height) {
-    return;
+/** i-th term (starting at 1) of the Luby sequence: 1 1 2 1 1 2 4 1 1 2 ... */
+static uint64_t _luby(uint64_t i) {
+  for (;;) {
+    uint k = 1;
+    while (((UINT64_C(1) << k) - 1) < i) k++;
+    if (((UINT64_C(1) << k) - 1) == i) return UINT64_C(1) << (k - 1);
+    i -= (UINT64_C(1) << (k - 1)) - 1;
   }
+}
 
-  direction original_orientation = g->cases[index].orientation;
+/* ************************************************************************** */
 
-  // Liste des orientations possibles en fonction de la forme de la pièce
-  direction orientations[4] = {NORTH, EAST, SOUTH, WEST};
-  int num_orientations = (g->cases[index].shape == SEGMENT) ? 2
-                         : (g->cases[index].shape == CROSS) ? 1
-                                                            : 4;
+/** smallest orientation giving the same half-edges as o for shape s */
+static direction _canonical_orientation(shape s, direction o) {
+  for (direction c = 0; c < o; c++)
+    if (HALF_EDGES[s][c] == HALF_EDGES[s][o]) return c;
+  return o;
+}
 
-  // Essayer toutes les orientations possibles
-  for (int i = 0; i < num_orientations; i++) {
-    g->cases[index].orientation = orientations[i];
-    if (game_check_edge(g, index / game_nb_rows(g), index % game_nb_cols(g),
-                        NORTH) != MISMATCH &&
-        game_check_edge(g, index / game_nb_rows(g), index % game_nb_cols(g),
-                        WEST) != MISMATCH) {
-      recSolve(g, index + 1, count, trouverPremier);
-    }
+/* ************************************************************************** */
+
+/** orientations worth trying for a given shape: one per distinct set of
+ * half-edges, so that symmetric solutions (SEGMENT, CROSS, EMPTY) are only
+ * explored and counted once */
+static uint8_t _initial_domain(shape s) {
+  uint8_t dom = 0;
+  for (direction o = 0; o < NB_DIRS; o++)
+    if (_canonical_orientation(s, o) == o) dom |= 1 << o;
+  return dom;
+}
+
+/* ************************************************************************** */
+
+static void _solver_free(solver *s) {
+  free(s->code);
+  free(s->dom);
+  free(s->val);
+  free(s->trail);
+  free(s->prop);
+  free(s->stack);
+  free(s->pending[2]);
+  free(s->uf_parent);
+  free(s->uf_size);
+  free(s->uf_open);
+  free(s->uf_trail);
+  free(s->bfs);
+  free(s->seen);
+  free(s->nogoods);
+  free(s->ng_head);
+  free(s->ng_next);
+}
+
+/* ************************************************************************** */
 
-    if (trouverPremier && *count > 0)
-      return;  // Sortir dès qu'on trouve une solution
+/** drop the stale and duplicate entries of the pending stack of a size */
+static void _solver_compact(solver *s, uint size) {
+  if (++s->stamp == 0) {
+    memset(s->seen, 0, s->nb_squares * sizeof(uint));
+    s->stamp = 1;
+  }
+  uint *list = s->pending[size], len = 0;
+  for (uint k = 0; k < s->pending_len[size]; k++) {
+    uint sq = list[k];
+    if (s->val[sq] != UNASSIGNED || _popcount[s->dom[sq]] != size ||
+        s->seen[sq] == s->stamp)
+      continue;
+    s->seen[sq] = s->stamp;
+    list[len++] = sq;
   }
-  //  Restaurer l'orientation initiale avant de revenir
-  g->cases[index].orientation = original_orientation;
+  s->pending_len[size] = len;
 }
 
-bool game_solve(game g) {
-  uint count = 0;
-  recSolve(g, 0, &count, true);
-  if (count == 0) return false;
+/* ************************************************************************** */
 
-  return true;
+/** push a square whose domain has changed on the pending stack of its size */
+static void _solver_pending(solver *s, uint sq) {
+  uint size = _popcount[s->dom[sq]];
+  if (size < 2) return;
+  if (s->pending_len[size] == 2 * s->nb_squares) _solver_compact(s, size);
+  s->pending[size][s->pending_len[size]++] = sq;
 }
 
-uint game_nb_solutions(cgame g) {
-  uint count = 0;
+/* ************************************************************************** */
 
-  recSolve(g, 0, &count, false);
+/** save the state of a square on the trail before modifying it */
+static void _solver_save(solver *s, uint sq) {
+  trail_entry *e = &s->trail[s->trail_len++];
+  e->sq = sq;
+  e->uf_mark = s->uf_len;
+  e->dom = s->dom[sq];
+  e->val = s->val[sq];
+}
 
-  return count;
-}
\ No newline at end of file
+/* ************************************************************************** */
+
+/** root of the component of an assigned square */
+static uint _solver_find(solver *s, uint sq) {
+  while (s->uf_parent[sq] != sq) sq = s->uf_parent[sq];
+  return sq;
+}
+
+/* ************************************************************************** */
+
+/** join two assigned squares by a matched edge, return false if they were
+ * already connected (the edge closes a cycle) */
+static bool _solver_union(solver *s, uint sq1, uint sq2) {
+  uint r1 = _solver_find(s, sq1), r2 = _solver_find(s, sq2);
+  if (s->uf_size[r1] < s->uf_size[r2]) {
+    uint tmp = r1;
+    r1 = r2;
+    r2 = tmp;
+  }
+  uf_entry *e = &s->uf_trail[s->uf_len++];
+  e->child = (r1 == r2) ? NO_SQUARE : r2;
+  e->root = r1;
+  e->open = s->uf_open[r1];
+  if (r1 != r2) {
+    s->uf_parent[r2] = r1;
+    s->uf_size[r1] += s->uf_size[r2];
+    s->uf_open[r1] += s->uf_open[r2];
+  }
+  s->uf_open[r1] -= 2; /* both half-edges of the new edge are now closed */
+  return r1 != r2;
+}
+
+/* ************************************************************************** */
+
+/** roll back the union-find to a given trail length */
+static void _solver_uf_undo(solver *s, uint mark) {
+  while (s->uf_len > mark) {
+    uf_entry *e = &s->uf_trail[--s->uf_len];
+    if (e->child != NO_SQUARE) {
+      s->uf_parent[e->child] = e->child;
+      s->uf_size[e->root] -= s->uf_size[e->child];
+    }
+    s->uf_open[e->root] = e->open;
+  }
+}
+
+/* ************************************************************************** */
+
+/** backtrack to a given trail length */
+static void _solver_undo(solver *s, uint mark) {
+  while (s->trail_len > mark) {
+    trail_entry *e = &s->trail[--s->trail_len];
+    if (e->val == UNASSIGNED && s->val[e->sq] != UNASSIGNED) {
+      s->nb_assigned--;
+      _solver_uf_undo(s, e->uf_mark);
+    }
+    s->dom[e->sq] = e->dom;
+    s->val[e->sq] = e->val;
+    if (e->val == UNASSIGNED) _solver_pending(s, e->sq);
+  }
+  s->prop_len = 0;
+}
+
+/* ************************************************************************** */
+
+/** check if assigning orientation o to square sq completes a nogood */
+static bool _solver_violates_nogood(solver *s, uint sq, uint8_t o) {
+  for (uint e = s->ng_head[sq]; e != NO_SQUARE; e = s->ng_next[e]) {
+    nogood *ng = &s->nogoods[e / NOGOOD_MAX_SIZE];
+    uint k = e % NOGOOD_MAX_SIZE;
+    if (ng->lits[k].o != o) continue;
+    bool complete = true;
+    for (uint l = 0; l < ng->size && complete; l++)
+      if (l != k && s->val[ng->lits[l].sq] != ng->lits[l].o) complete = false;
+    if (complete) return true;
+  }
+  return false;
+}
+
+/* ************************************************************************** */
+
+/** check that orientation o of the unassigned square sq neither closes a
+ * component too early nor (when solutions are trees) closes a cycle */
+static bool _solver_fits(solver *s, uint sq, uint8_t o) {
+  uint8_t code = s->code[sq * NB_DIRS + o];
+  if (code == 0) return true;
+  uint roots[NB_DIRS], nb_roots = 0;
+  uint size = 1, open = _popcount[code];
+  for (direction d = 0; d < NB_DIRS; d++) {
+    if (!HAS_HALF_EDGE(code, d)) continue;
+    uint n = s->nbr[sq * NB_DIRS + d];
+    if (n == sq) open--; /* edge to itself, checked by init */
+    if (n == sq || s->val[n] == UNASSIGNED) continue;
+    uint root = _solver_find(s, n);
+    open -= 2;
+    bool seen = false;
+    for (uint k = 0; k < nb_roots; k++)
+      if (roots[k] == root) seen = true;
+    if (seen) {
+      if (s->tree) return false;
+      continue;
+    }
+    roots[nb_roots++] = root;
+    size += s->uf_size[root];
+    open += s->uf_open[root];
+  }
+  return open > 0 || size == s->nb_pieces;
+}
+
+/* ************************************************************************** */
+
+/** assign a square and filter the domains of its neighbours */
+static bool _solver_assign(solver *s, uint sq, uint8_t o) {
+  assert(s->val[sq] == UNASSIGNED);
+  if (s->nb_nogoods > 0 && _solver_violates_nogood(s, sq, o)) return false;
+
+  _solver_save(s, sq);
+  s->val[sq] = o;
+  s->dom[sq] = 1 << o;
+  s->nb_assigned++;
+
+  /* join the assigned neighbours */
+  uint8_t code = s->code[sq * NB_DIRS + o];
+  s->uf_parent[sq] = sq;
+  s->uf_size[sq] = 1;
+  s->uf_open[sq] = _popcount[code];
+  for (direction d = 0; d < NB_DIRS; d++) {
+    uint n = s->nbr[sq * NB_DIRS + d];
+    uint he = HAS_HALF_EDGE(code, d);
+    if (n == sq) s->uf_open[sq] -= he; /* edge to itself, checked by init */
+    if (n == NO_SQUARE || n == sq || s->val[n] == UNASSIGNED) continue;
+    if (HAS_HALF_EDGE(s->code[n * NB_DIRS + s->val[n]], OPPOSITE_DIR(d)) != he)
+      return false;
+    if (he && !_solver_union(s, sq, n) && s->tree) return false;
+  }
+
+  /* a closed component must hold all the pieces */
+  if (code != 0) {
+    uint root = _solver_find(s, sq);
+    if (s->uf_open[root] == 0 && s->uf_size[root] < s->nb_pieces) return false;
+  }
+
+  /* filter the unassigned neighbours */
+  for (direction d = 0; d < NB_DIRS; d++) {
+    uint n = s->nbr[sq * NB_DIRS + d];
+    if (n == NO_SQUARE || n == sq || s->val[n] != UNASSIGNED) continue;
+    uint he = HAS_HALF_EDGE(code, d);
+    direction od = OPPOSITE_DIR(d);
+    uint8_t dom = 0;
+    for (uint8_t no = 0; no < NB_DIRS; no++)
+      if ((s->dom[n] & (1 << no)) &&
+          HAS_HALF_EDGE(s->code[n * NB_DIRS + no], od) == he &&
+          _solver_fits(s, n, no))
+        dom |= 1 << no;
+    if (dom == 0) return false;
+    if (dom != s->dom[n]) {
+      _solver_save(s, n);
+      s->dom[n] = dom;
+      if (_popcount[dom] == 1)
+        s->prop[s->prop_len++] = n;
+      else
+        _solver_pending(s, n);
+    }
+  }
+  return true;
+}
+
+/* ************************************************************************** */
+
+/** assign all the squares whose domain is a singleton */
+static bool _solver_propagate(solver *s) {
+  while (s->prop_len > 0) {
+    uint sq = s->prop[--s->prop_len];
+    if (s->val[sq] != UNASSIGNED) continue;
+    uint8_t o = 0;
+    while (!(s->dom[sq] & (1 << o))) o++;
+    if (!_solver_assign(s, sq, o)) {
+      s->prop_len = 0;
+      return false;
+    }
+  }
+  return true;
+}
+
+/* ************************************************************************** */
+
+/** check that a fully assigned grid forms a connected graph */
+static bool _solver_connected(solver *s) {
+  if (++s->stamp == 0) {
+    memset(s->seen, 0, s->nb_squares * sizeof(uint));
+    s->stamp = 1;
+  }
+  uint start = NO_SQUARE, nb_pieces = 0;
+  for (uint sq = 0; sq < s->nb_squares; sq++)
+    if (s->code[sq * NB_DIRS + s->val[sq]] != 0) {
+      if (start == NO_SQUARE) start = sq;
+      nb_pieces++;
+    }
+  if (nb_pieces == 0) return true;
+
+  uint head = 0, tail = 0;
+  s->bfs[tail++] = start;
+  s->seen[start] = s->stamp;
+  while (head < tail) {
+    uint sq = s->bfs[head++];
+    uint8_t code = s->code[sq * NB_DIRS + s->val[sq]];
+    for (direction d = 0; d < NB_DIRS; d++) {
+      if (!HAS_HALF_EDGE(code, d)) continue;
+      uint n = s->nbr[sq * NB_DIRS + d];
+      if (s->seen[n] == s->stamp) continue;
+      s->seen[n] = s->stamp;
+      s->bfs[tail++] = n;
+    }
+  }
+  return tail == nb_pieces;
+}
+
+/* ************************************************************************** */
+
+/** choose (and remove from its pending stack) an unassigned square with the
+ * smallest domain */
+static uint _solver_select(solver *s) {
+  for (uint size = 2; size <= NB_DIRS; size++) {
+    uint *list = s->pending[size];
+    while (s->pending_len[size] > 0) {
+      uint sq = list[--s->pending_len[size]];
+      if (s->val[sq] == UNASSIGNED && _popcount[s->dom[sq]] == size) return sq;
+    }
+  }
+  return NO_SQUARE;
+}
+
+/* ************************************************************************** */
+
+/** choose an orientation among the remaining ones, from a random start */
+static uint8_t _solver_pick(solver *s, uint8_t remaining) {
+  uint8_t start = _solver_random(s) % NB_DIRS;
+  for (uint8_t k = 0; k < NB_DIRS; k++) {
+    uint8_t o = (start + k) % NB_DIRS;
+    if (remaining & (1 << o)) return o;
+  }
+  assert(false);
+  return NORTH;
+}
+
+/* ************************************************************************** */
+
+/** record the values refuted in the first levels of the search as nogoods */
+static void _solver_record_nogoods(solver *s) {
+  for (uint lvl = 0; lvl < s->depth && lvl < NOGOOD_MAX_SIZE; lvl++) {
+    decision *dc = &s->stack[lvl];
+    uint8_t refuted = dc->tried;
+    if (dc->cur != UNASSIGNED) refuted &= ~(1 << dc->cur);
+    for (uint8_t o = 0; o < NB_DIRS; o++) {
+      if (!(refuted & (1 << o))) continue;
+      if (s->nb_nogoods == NOGOOD_MAX_COUNT) return;
+      uint id = s->nb_nogoods++;
+      nogood *ng = &s->nogoods[id];
+      ng->size = lvl + 1;
+      for (uint k = 0; k < lvl; k++) {
+        ng->lits[k].sq = s->stack[k].sq;
+        ng->lits[k].o = s->stack[k].cur;
+      }
+      ng->lits[lvl].sq = dc->sq;
+      ng->lits[lvl].o = o;
+      for (uint k = 0; k < ng->size; k++) {
+        uint e = id * NOGOOD_MAX_SIZE + k;
+        s->ng_next[e] = s->ng_head[ng->lits[k].sq];
+        s->ng_head[ng->lits[k].sq] = e;
+      }
+    }
+  }
+}
+
+/* ************************************************************************** */
+
+/**
+ * @brief Explores the search tree from the current (propagated) state.
+ * @param s the solver
+ * @param first stop at the first solution
+ * @param fail_limit abort after this number of failures (0 for no limit)
+ * @param[out] aborted set to true if the search was aborted
+ * @return the number of solutions found
+ */
+static uint64_t _solver_search(solver *s, bool first, uint64_t fail_limit,
+                               bool *aborted) {
+  uint64_t count = 0;
+  bool descend = true;
+  *aborted = false;
+  s->depth = 0;
+
+  for (;;) {
+    if (descend) {
+      descend = false;
+      if (s->nb_assigned == s->nb_squares) {
+        if (_solver_connected(s)) {
+          count++;
+          if (first) return count;
+        } else {
+          s->nb_fails++;
+        }
+      } else {
+        decision *dc = &s->stack[s->depth++];
+        dc->sq = _solver_select(s);
+        assert(dc->sq != NO_SQUARE);
+        dc->mark = s->trail_len;
+        dc->dom = s->dom[dc->sq];
+        dc->tried = 0;
+        dc->cur = UNASSIGNED;
+      }
+    }
+
+    /* try the next orientation of the last decision */
+    if (s->depth == 0) return count;
+    decision *dc = &s->stack[s->depth - 1];
+    _solver_undo(s, dc->mark);
+    dc->cur = UNASSIGNED;
+    uint8_t remaining = dc->dom & ~dc->tried;
+    if (remaining == 0) {
+      _solver_pending(s, dc->sq); /* popped from its stack by the selection */
+      s->depth--;
+      continue;
+    }
+    if (fail_limit > 0 && s->nb_fails >= fail_limit) {
+      /* the square was popped by the selection, and the undo only pushes it
+       * back if the last attempt got past the nogood check */
+      _solver_pending(s, dc->sq);
+      *aborted = true;
+      return count;
+    }
+    dc->cur = _solver_pick(s, remaining);
+    dc->tried |= 1 << dc->cur;
+    if (_solver_assign(s, dc->sq, dc->cur) && _solver_propagate(s))
+      descend = true;
+    else
+      s->nb_fails++;
+  }
+}
+
+/* ************************************************************************** */
+
+/** compute the half-edge codes of all squares in all orientations */
+static void _build_codes(cgame g, uint8_t *code) {
+  uint nb_squares = game_nb_rows(g) * game_nb_cols(g);
+  for (uint sq = 0; sq < nb_squares; sq++)
+    for (direction d = 0; d < NB_DIRS; d++)
+      code[sq * NB_DIRS + d] = _encode_shape(g->cases[sq].shape, d);
+}
+
+/* ************************************************************************** */
+
+/** build the solver for a game and propagate the initial constraints */
+static bool _solver_init(solver *s, cgame g) {
+  uint nb_rows = game_nb_rows(g), nb_cols = game_nb_cols(g);
+  uint n = nb_rows * nb_cols;
+
+  s->nb_squares = n;
+  s->nb_assigned = 0;
+  s->nbr = _game_neighbours(g);
+  s->code = _solver_alloc(n * NB_DIRS * sizeof(uint8_t));
+  s->dom = _solver_alloc(n * sizeof(uint8_t));
+  s->val = _solver_alloc(n * sizeof(uint8_t));
+  s->trail = _solver_alloc((NB_DIRS + 1) * n * sizeof(trail_entry));
+  s->trail_len = 0;
+  s->prop = _solver_alloc(n * sizeof(uint));
+  s->prop_len = 0;
+  s->stack = _solver_alloc(n * sizeof(decision));
+  s->depth = 0;
+  s->uf_parent = _solver_alloc(n * sizeof(uint));
+  s->uf_size = _solver_alloc(n * sizeof(uint));
+  s->uf_open = _solver_alloc(n * sizeof(uint));
+  s->uf_trail = _solver_alloc(NB_DIRS * (size_t)n * sizeof(uf_entry));
+  s->uf_len = 0;
+  s->pending[0] = s->pending[1] = NULL;
+  s->pending[2] = _solver_alloc((NB_DIRS - 1) * 2 * (size_t)n * sizeof(uint));
+  for (uint size = 2; size <= NB_DIRS; size++) {
+    s->pending[size] = s->pending[2] + (size - 2) * 2 * (size_t)n;
+    s->pending_len[size] = 0;
+  }
+  s->bfs = _solver_alloc(n * sizeof(uint));
+  s->seen = calloc(n, sizeof(uint));
+  s->stamp = 0;
+  s->nogoods = _solver_alloc(NOGOOD_MAX_COUNT * sizeof(nogood));
+  s->nb_nogoods = 0;
+  s->ng_head = _solver_alloc(n * sizeof(uint));
+  s->ng_next = _solver_alloc(NOGOOD_MAX_COUNT * NOGOOD_MAX_SIZE * sizeof(uint));
+  s->rng = UINT64_C(0x9E3779B97F4A7C15) ^ n;
+  s->nb_fails = 0;
+  if (s->seen == NULL) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  _build_codes(g, s->code);
+  s->nb_pieces = 0;
+  size_t nb_half_edges = 0;
+  for (uint sq = 0; sq < n; sq++) {
+    s->ng_head[sq] = NO_SQUARE;
+    s->val[sq] = UNASSIGNED;
+    if (s->code[sq * NB_DIRS] != 0) s->nb_pieces++;
+    nb_half_edges += _popcount[s->code[sq * NB_DIRS]];
+  }
+  s->tree = (nb_half_edges + 2 == 2 * (size_t)s->nb_pieces);
+
+  /* remove the orientations that cannot match the border of the grid, or the
+   * square itself when it is its own neighbour (wrapping on a single row) */
+  for (uint sq = 0; sq < n; sq++) {
+    s->dom[sq] = _initial_domain(g->cases[sq].shape);
+    for (uint8_t o = 0; o < NB_DIRS; o++) {
+      uint8_t code = s->code[sq * NB_DIRS + o];
+      for (direction d = 0; d < NB_DIRS; d++) {
+        uint nb = s->nbr[sq * NB_DIRS + d];
+        if ((nb == NO_SQUARE && HAS_HALF_EDGE(code, d)) ||
+            (nb == sq &&
+             HAS_HALF_EDGE(code, d) != HAS_HALF_EDGE(code, OPPOSITE_DIR(d))))
+          s->dom[sq] &= ~(1 << o);
+      }
+    }
+    if (s->dom[sq] == 0) return false;
+    if (_popcount[s->dom[sq]] == 1)
+      s->prop[s->prop_len++] = sq;
+    else
+      _solver_pending(s, sq);
+  }
+
+  return _solver_propagate(s);
+}
+
+/* ************************************************************************** */
+
+/** fix the first squares of the grid to their orientation in the game */
+static bool _solver_fix(solver *s, cgame g, uint nb_fixed) {
+  for (uint sq = 0; sq < nb_fixed && sq < s->nb_squares; sq++) {
+    uint8_t o =
+        _canonical_orientation(g->cases[sq].shape, g->cases[sq].orientation);
+    if (s->val[sq] != UNASSIGNED) {
+      if (s->val[sq] != o) return false;
+      continue;
+    }
+    if (!(s->dom[sq] & (1 << o))) return false;
+    if (!_solver_assign(s, sq, o) || !_solver_propagate(s)) return false;
+  }
+  return true;
+}
+
+/* ************************************************************************** */
+
+/** enumerate the consistent orientations of the squares sq..nb_fixed-1 */
+static uint _solver_split(solver *s, uint sq, uint nb_fixed, game work,
+                          void (*fn)(cgame job, void *data), void *data) {
+  if (sq == nb_fixed) {
+    for (uint k = 0; k < nb_fixed; k++)
+      _set_square(work, k, work->cases[k].shape, s->val[k]);
+    fn(work, data);
+    return 1;
+  }
+  if (s->val[sq] != UNASSIGNED)
+    return _solver_split(s, sq + 1, nb_fixed, work, fn, data);
+
+  uint nb_jobs = 0, mark = s->trail_len;
+  uint8_t dom = s->dom[sq];
+  for (uint8_t o = 0; o < NB_DIRS; o++) {
+    if (!(dom & (1 << o))) continue;
+    if (_solver_assign(s, sq, o) && _solver_propagate(s))
+      nb_jobs += _solver_split(s, sq + 1, nb_fixed, work, fn, data);
+    _solver_undo(s, mark);
+  }
+  return nb_jobs;
+}
+
+/* ************************************************************************** */
+
+/** run the solver, with restarts if only the first solution is needed (stats
+ * may be NULL) */
+static uint64_t _solver_run(solver *s, bool first, solve_stats *stats) {
+  bool aborted;
+  if (stats) *stats = (solve_stats){.nb_fails = 0};
+  if (!first) {
+    uint64_t count = _solver_search(s, false, 0, &aborted);
+    if (stats) stats->nb_fails = s->nb_fails;
+    return count;
+  }
+
+  /* a restart throws away work proportional to the grid, so the unit grows
+   * with it to keep large grids from restarting every few thousand squares */
+  uint64_t unit = LUBY_UNIT + s->nb_squares / 64;
+  uint root = s->trail_len;
+  for (uint64_t run = 1;; run++) {
+    s->nb_fails = 0;
+    uint64_t count = _solver_search(s, true, _luby(run) * unit, &aborted);
+    if (stats) stats->nb_fails += s->nb_fails;
+    if (!aborted) {
+      if (stats) stats->nb_nogoods = s->nb_nogoods;
+      return count;
+    }
+    _solver_record_nogoods(s);
+    _solver_undo(s, root);
+    if (stats) stats->nb_restarts++;
+  }
+}
+
+/* ************************************************************************** */
+
+bool game_solve(game g) { return game_solve_stats(g, NULL); }
+
+/* ************************************************************************** */
+
+bool game_solve_stats(game g, solve_stats *stats) {
+  assert(g);
+  solver s;
+  if (stats) *stats = (solve_stats){.nb_fails = 0};
+  bool found = _solver_init(&s, g) && _solver_run(&s, true, stats) > 0;
+  if (found)
+    for (uint sq = 0; sq < s.nb_squares; sq++)
+      _set_square(g, sq, g->cases[sq].shape, s.val[sq]);
+  _solver_free(&s);
+  return found;
+}
+
+/* ************************************************************************** */
+
+uint game_nb_solutions(cgame g) {
+  assert(g);
+  solver s;
+  uint64_t count = 0;
+  if (_solver_init(&s, g)) count = _solver_run(&s, false, NULL);
+  _solver_free(&s);
+  return count;
+}
+
+/* ************************************************************************** */
+
+uint game_split_solutions(cgame g, uint nb_fixed,
+                          void (*fn)(cgame job, void *data), void *data) {
+  assert(g);
+  assert(fn);
+  solver s;
+  uint nb_jobs = 0;
+  if (_solver_init(&s, g)) {
+    game work = game_copy(g);
+    if (nb_fixed > s.nb_squares) nb_fixed = s.nb_squares;
+    nb_jobs = _solver_split(&s, 0, nb_fixed, work, fn, data);
+    game_delete(work);
+  }
+  _solver_free(&s);
+  return nb_jobs;
+}
+
+/* ************************************************************************** */
+
+uint64_t game_nb_solutions_fixed(cgame g, uint nb_fixed) {
+  assert(g);
+  solver s;
+  uint64_t count = 0;
+  if (_solver_init(&s, g) && _solver_fix(&s, g, nb_fixed))
+    count = _solver_run(&s, false, NULL);
+  _solver_free(&s);
+  return count;
+}
+
+/* ************************************************************************** */
+/*                             DIFFICULTY RATING                              */
+/* ************************************************************************** */
+
+/* The rater solves a game with deductions only, never guessing. A square is
+ * determined when its domain is a singleton. Each round applies the easiest
+ * rule of the ladder that removes at least one orientation from a domain, and
+ * the difficulty of the game is the hardest rule that was needed. Loop
+ * avoidance is only sound when no solution can contain a cycle, that is when
+ * the number of edges (half of the number of half-edges, which does not depend
+ * on the orientations) is the number of pieces minus one. */
+
+typedef struct {
+  uint nb_squares;
+  uint nb_pieces;
+  bool tree;     /* no solution can contain a cycle */
+  const uint *nbr; /* adjacent square in each direction (or NO_SQUARE) */
+  uint *parent;  /* union-find over the edges between determined squares */
+  uint *bfs;     /* work buffers of the dead-end check */
+  uint *seen;
+  uint stamp;
+  uint8_t *code; /* half-edge code of each square in each orientation */
+  uint8_t *dom;  /* domain of each square */
+  uint8_t *bfs_code;
+} rater;
+
+static const uint8_t _lowest_bit[16] = {0, 0, 1, 0, 2, 0, 1, 0,
+                                        3, 0, 1, 0, 2, 0, 1, 0};
+
+#define DETERMINED(r, sq) (_popcount[(r)->dom[sq]] == 1)
+#define RATER_CODE(r, sq) \
+  ((r)->code[(sq) * NB_DIRS + _lowest_bit[(r)->dom[sq]]])
+
+/* ************************************************************************** */
+
+static void _rater_init(rater *r, cgame g) {
+  uint n = game_nb_rows(g) * game_nb_cols(g);
+  r->nb_squares = n;
+  uint *buf = _solver_alloc(n * 3 * sizeof(uint) +
+                            n * (NB_DIRS + 2) * sizeof(uint8_t));
+  r->nbr = _game_neighbours(g);
+  r->parent = buf;
+  r->bfs = r->parent + n;
+  r->seen = r->bfs + n;
+  r->code = (uint8_t *)(r->seen + n);
+  r->dom = r->code + n * NB_DIRS;
+  r->bfs_code = r->dom + n;
+  memset(r->seen, 0, n * sizeof(uint));
+  r->stamp = 0;
+  _build_codes(g, r->code);
+
+  uint nb_half_edges = 0;
+  r->nb_pieces = 0;
+  for (uint sq = 0; sq < n; sq++) {
+    shape s = g->cases[sq].shape;
+    r->dom[sq] = _initial_domain(s);
+    nb_half_edges += _popcount[r->code[sq * NB_DIRS]];
+    if (s != EMPTY) r->nb_pieces++;
+  }
+  r->tree = (r->nb_pieces > 0 && nb_half_edges == 2 * (r->nb_pieces - 1));
+}
+
+/* ************************************************************************** */
+
+static void _rater_free(rater *r) { free(r->parent); }
+
+/* ************************************************************************** */
+
+static uint _rater_find(rater *r, uint x) {
+  while (r->parent[x] != x) {
+    r->parent[x] = r->parent[r->parent[x]];
+    x = r->parent[x];
+  }
+  return x;
+}
+
+/* ************************************************************************** */
+
+/** half-edges present in all the orientations of the domain of a square */
+static uint8_t _rater_must(rater *r, uint sq) {
+  uint8_t must = 0b1111;
+  for (uint8_t o = 0; o < NB_DIRS; o++)
+    if (r->dom[sq] & (1 << o)) must &= r->code[sq * NB_DIRS + o];
+  return must;
+}
+
+/* ************************************************************************** */
+
+/** an edge is known when both squares have the half-edge in all orientations */
+static bool _rater_known_edge(rater *r, uint sq, direction d) {
+  uint y = r->nbr[sq * NB_DIRS + d];
+  return y != NO_SQUARE && HAS_HALF_EDGE(_rater_must(r, sq), d) &&
+         HAS_HALF_EDGE(_rater_must(r, y), OPPOSITE_DIR(d));
+}
+
+/* ************************************************************************** */
+
+/** build the components formed by the known edges */
+static void _rater_union_known(rater *r) {
+  for (uint sq = 0; sq < r->nb_squares; sq++) r->parent[sq] = sq;
+  for (uint sq = 0; sq < r->nb_squares; sq++)
+    for (direction d = 0; d < NB_DIRS; d++)
+      if (_rater_known_edge(r, sq, d)) {
+        uint a = _rater_find(r, sq);
+        uint b = _rater_find(r, r->nbr[sq * NB_DIRS + d]);
+        if (a != b) r->parent[a] = b;
+      }
+}
+
+/* ************************************************************************** */
+
+/** orientations of the domain of square y having a half-edge in direction d */
+static uint8_t _rater_with_edge(rater *r, uint y, uint8_t dom, direction d) {
+  uint8_t keep = 0;
+  for (uint8_t o = 0; o < NB_DIRS; o++)
+    if ((dom & (1 << o)) && HAS_HALF_EDGE(r->code[y * NB_DIRS + o], d))
+      keep |= 1 << o;
+  return keep;
+}
+
+/* ************************************************************************** */
+
+/** check if square sq in orientation o, and square sq2 in orientation o2 (or
+ * NO_SQUARE), close a component which does not contain all the pieces. The
+ * component follows the squares whose orientation is forced by the half-edge
+ * they receive, and is open as soon as it reaches a square with a choice. */
+static bool _rater_closes(rater *r, uint sq, uint8_t o, uint sq2, uint8_t o2) {
+  if (++r->stamp == 0) {
+    memset(r->seen, 0, r->nb_squares * sizeof(uint));
+    r->stamp = 1;
+  }
+  uint head = 0, tail = 0;
+  r->bfs[tail] = sq;
+  r->bfs_code[tail++] = r->code[sq * NB_DIRS + o];
+  r->seen[sq] = r->stamp;
+  while (head < tail) {
+    uint8_t code = r->bfs_code[head];
+    uint x = r->bfs[head++];
+    for (direction d = 0; d < NB_DIRS; d++) {
+      uint y = r->nbr[x * NB_DIRS + d];
+      if (!HAS_HALF_EDGE(code, d) || y == NO_SQUARE || r->seen[y] == r->stamp)
+        continue;
+      uint8_t dom = (y == sq2) ? (1 << o2) : r->dom[y];
+      uint8_t keep = _rater_with_edge(r, y, dom, OPPOSITE_DIR(d));
+      if (keep == 0) return true; /* no orientation can match */
+      if (_popcount[keep] > 1) return false; /* the component is open */
+      r->seen[y] = r->stamp;
+      r->bfs[tail] = y;
+      r->bfs_code[tail++] = r->code[y * NB_DIRS + _lowest_bit[keep]];
+    }
+  }
+  return tail < r->nb_pieces;
+}
+
+/* ************************************************************************** */
+
+/** small union-find over the component roots met by a few new edges */
+typedef struct {
+  uint root[4 * NB_DIRS];
+  uint up[4 * NB_DIRS];
+  uint nb;
+} local_union;
+
+static uint _local_find(local_union *u, uint root) {
+  for (uint k = 0; k < u->nb; k++)
+    if (u->root[k] == root) {
+      while (u->up[k] != k) k = u->up[k];
+      return k;
+    }
+  u->root[u->nb] = root;
+  u->up[u->nb] = u->nb;
+  return u->nb++;
+}
+
+/* ************************************************************************** */
+
+/** check if square sq in orientation o, and square sq2 in orientation o2 (or
+ * NO_SQUARE), add an edge between two squares already linked by known edges */
+static bool _rater_loops(rater *r, uint sq, uint8_t o, uint sq2, uint8_t o2) {
+  local_union u;
+  u.nb = 0;
+  for (uint k = 0; k < 2; k++) {
+    uint x = (k == 0) ? sq : sq2;
+    if (x == NO_SQUARE) break;
+    uint8_t code = r->code[x * NB_DIRS + ((k == 0) ? o : o2)];
+    for (direction d = 0; d < NB_DIRS; d++) {
+      uint y = r->nbr[x * NB_DIRS + d];
+      if (!HAS_HALF_EDGE(code, d) || y == NO_SQUARE) continue;
+      if (_rater_known_edge(r, x, d)) continue;  /* already in the union */
+      if (k == 1 && y == sq) continue;           /* already added by sq */
+      uint a = _local_find(&u, _rater_find(r, x));
+      uint b = _local_find(&u, _rater_find(r, y));
+      if (a == b) return true;
+      u.up[a] = b;
+    }
+  }
+  return false;
+}
+
+/* ************************************************************************** */
+
+/** rule 1: a half-edge must face a half-edge, and a border must face none */
+static int _rate_edge_matching(rater *r) {
+  bool progress = false;
+  for (uint sq = 0; sq < r->nb_squares; sq++) {
+    uint8_t dom = r->dom[sq];
+    for (direction d = 0; d < NB_DIRS; d++) {
+      uint y = r->nbr[sq * NB_DIRS + d];
+      direction od = OPPOSITE_DIR(d);
+      uint8_t may = 0, must = 0b1111;
+      if (y != NO_SQUARE && y != sq)
+        for (uint8_t o = 0; o < NB_DIRS; o++)
+          if (r->dom[y] & (1 << o)) {
+            may |= r->code[y * NB_DIRS + o];
+            must &= r->code[y * NB_DIRS + o];
+          }
+      for (uint8_t o = 0; o < NB_DIRS; o++) {
+        if (!(dom & (1 << o))) continue;
+        uint8_t code = r->code[sq * NB_DIRS + o];
+        bool ok;
+        if (y == NO_SQUARE)
+          ok = !HAS_HALF_EDGE(code, d);
+        else if (y == sq)
+          ok = HAS_HALF_EDGE(code, d) == HAS_HALF_EDGE(code, od);
+        else
+          ok = HAS_HALF_EDGE(code, d) ? HAS_HALF_EDGE(may, od)
+                                      : !HAS_HALF_EDGE(must, od);
+        if (!ok) dom &= ~(1 << o);
+      }
+    }
+    if (dom == 0) return -1;
+    if (dom != r->dom[sq]) {
+      r->dom[sq] = dom;
+      progress = true;
+    }
+  }
+  return progress;
+}
+
+/* ************************************************************************** */
+
+/** rules 2 and 3: a square must not close a component too early, nor a cycle
+ * when the solution is a tree */
+static int _rate_single(rater *r, difficulty rule) {
+  bool progress = false;
+  if (rule == LOOP_AVOIDANCE) _rater_union_known(r);
+  for (uint sq = 0; sq < r->nb_squares; sq++) {
+    if (DETERMINED(r, sq)) continue;
+    uint8_t dom = r->dom[sq];
+    for (uint8_t o = 0; o < NB_DIRS; o++) {
+      if (!(dom & (1 << o))) continue;
+      if (rule == DEAD_END ? _rater_closes(r, sq, o, NO_SQUARE, 0)
+                           : _rater_loops(r, sq, o, NO_SQUARE, 0))
+        dom &= ~(1 << o);
+    }
+    if (dom == 0) return -1;
+    if (dom != r->dom[sq]) {
+      r->dom[sq] = dom;
+      progress = true;
+    }
+  }
+  return progress;
+}
+
+/* ************************************************************************** */
+
+/** rule 4: an orientation needs, in each undetermined neighbour, an
+ * orientation such that the pair matches, closes no component too early and
+ * no cycle when the solution is a tree */
+static int _rate_lookahead(rater *r) {
+  bool progress = false;
+  if (r->tree) _rater_union_known(r);
+  for (uint sq = 0; sq < r->nb_squares; sq++) {
+    if (DETERMINED(r, sq)) continue;
+    uint8_t dom = r->dom[sq];
+    for (uint8_t o = 0; o < NB_DIRS; o++) {
+      if (!(dom & (1 << o))) continue;
+      uint8_t code = r->code[sq * NB_DIRS + o];
+      bool ok = true;
+      for (direction d = 0; d < NB_DIRS && ok; d++) {
+        uint y = r->nbr[sq * NB_DIRS + d];
+        if (y == NO_SQUARE || y == sq || DETERMINED(r, y)) continue;
+        bool supported = false;
+        for (uint8_t o2 = 0; o2 < NB_DIRS && !supported; o2++) {
+          if (!(r->dom[y] & (1 << o2))) continue;
+          uint8_t code2 = r->code[y * NB_DIRS + o2];
+          bool match = true;
+          for (direction d2 = 0; d2 < NB_DIRS; d2++)
+            if (r->nbr[y * NB_DIRS + d2] == sq &&
+                HAS_HALF_EDGE(code2, d2) !=
+                    HAS_HALF_EDGE(code, OPPOSITE_DIR(d2)))
+              match = false;
+          supported = match && !_rater_closes(r, sq, o, y, o2) &&
+                      !(r->tree && _rater_loops(r, sq, o, y, o2));
+        }
+        ok = supported;
+      }
+      if (!ok) dom &= ~(1 << o);
+    }
+    if (dom == 0) return -1;
+    if (dom != r->dom[sq]) {
+      r->dom[sq] = dom;
+      progress = true;
+    }
+  }
+  return progress;
+}
+
+/* ************************************************************************** */
+
+/** check that the determined grid is connected */
+static bool _rater_connected(rater *r) {
+  for (uint sq = 0; sq < r->nb_squares; sq++)
+    if (RATER_CODE(r, sq) != 0)
+      return !_rater_closes(r, sq, _lowest_bit[r->dom[sq]], NO_SQUARE, 0);
+  return true;
+}
+
+/* ************************************************************************** */
+
+rating game_rate_difficulty(cgame g) {
+  assert(g);
+  rating res = {UNRATED, 0};
+  difficulty hardest = TRIVIAL;
+  rater r;
+  _rater_init(&r, g);
+
+  for (;;) {
+    int progress = 0;
+    difficulty rule;
+    for (rule = EDGE_MATCHING; rule < UNRATED; rule++) {
+      if (rule == EDGE_MATCHING)
+        progress = _rate_edge_matching(&r);
+      else if (rule == LOOKAHEAD)
+        progress = _rate_lookahead(&r);
+      else if (rule == DEAD_END || r.tree)
+        progress = _rate_single(&r, rule);
+      if (progress != 0) break;
+    }
+    if (progress < 0) break; /* no solution */
+    if (progress == 0) {
+      bool solved = true;
+      for (uint sq = 0; sq < r.nb_squares && solved; sq++)
+        solved = DETERMINED(&r, sq);
+      if (solved && _rater_connected(&r)) res.level = hardest;
+      break;
+    }
+    res.nb_rounds++;
+    if (rule > hardest) hardest = rule;
+  }
+
+  _rater_free(&r);
+  return res;
+}
+
+/* ************************************************************************** */
+/*                       DIFFICULTY-TARGETED GENERATOR                        */
+/* ************************************************************************** */
+
+/* Each worker thread runs its own generate, shuffle, rate and filter pipeline
+ * with its own random generator, and pushes the accepted games into a bounded
+ * queue, from which the calling thread hands them over in order of arrival. */
+
+#define TARGET_QUEUE_SIZE 64
+#define TARGET_MAX_ATTEMPTS 100000 /* rejected games in a row before giving up */
+
+typedef struct {
+  uint nb_rows, nb_cols;
+  bool wrapping;
+  difficulty level;
+  bool uniqueness;
+  uint n;           /* number of games to produce */
+  uint nb_accepted; /* number of games accepted so far */
+  uint nb_rejected; /* number of games rejected since the last accepted one */
+  bool give_up;     /* level out of reach, or out of memory */
+  game queue[TARGET_QUEUE_SIZE];
+  uint head, len;
+  pthread_mutex_t lock;
+  pthread_cond_t not_full;
+  pthread_cond_t not_empty;
+} target;
+
+typedef struct {
+  target *t;
+  uint64_t rng;
+  pthread_t thread;
+} target_worker;
+
+/* ************************************************************************** */
+
+/** shuffle the orientations of a game, drawing from a given generator */
+static void _shuffle(game g, uint64_t *rng) {
+  for (uint sq = 0; sq < g->height * g->width; sq++)
+    _set_square(g, sq, g->cases[sq].shape, _random(rng) % NB_DIRS);
+}
+
+/* ************************************************************************** */
+
+static bool _target_match(target *t, cgame g) {
+  rating r = game_rate_difficulty(g);
+  if (r.level != t->level) return false;
+  /* a game rated by deductions only has a unique solution */
+  return !t->uniqueness || r.level != UNRATED || game_nb_solutions(g) == 1;
+}
+
+/* ************************************************************************** */
+
+static void *_target_work(void *arg) {
+  target_worker *w = arg;
+  target *t = w->t;
+  for (;;) {
+    pthread_mutex_lock(&t->lock);
+    bool done = t->nb_accepted >= t->n || t->give_up;
+    pthread_mutex_unlock(&t->lock);
+    if (done) break;
+
+    game g = _random_game(&w->rng, t->nb_rows, t->nb_cols, t->wrapping, 0, 0);
+    if (g) _shuffle(g, &w->rng);
+    if (!g || !_target_match(t, g)) {
+      game_delete(g);
+      pthread_mutex_lock(&t->lock);
+      if (!g || ++t->nb_rejected >= TARGET_MAX_ATTEMPTS) {
+        t->give_up = true;
+        pthread_cond_signal(&t->not_empty);
+      }
+      pthread_mutex_unlock(&t->lock);
+      continue;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    if (t->nb_accepted >= t->n || t->give_up) {
+      pthread_mutex_unlock(&t->lock);
+      game_delete(g);
+      break;
+    }
+    t->nb_accepted++;
+    t->nb_rejected = 0;
+    while (t->len == TARGET_QUEUE_SIZE) pthread_cond_wait(&t->not_full, &t->lock);
+    t->queue[(t->head + t->len++) % TARGET_QUEUE_SIZE] = g;
+    pthread_cond_signal(&t->not_empty);
+    pthread_mutex_unlock(&t->lock);
+  }
+  return NULL;
+}
+
+/* ************************************************************************** */
+
+uint game_random_target_stream(uint nb_rows, uint nb_cols, bool wrapping,
+                               difficulty level, bool uniqueness, uint n,
+                               uint nb_threads, void (*fn)(game g, void *data),
+                               void *data) {
+  assert(fn);
+  /* a generated tree has endpoints, which are never determined without any
+   * deduction: trivial games cannot be reached */
+  if ((size_t)nb_rows * nb_cols < 2 || level == TRIVIAL ||
+      level >= NB_DIFFICULTIES || n == 0)
+    return 0;
+  game probe = game_new_empty_ext(nb_rows, nb_cols, wrapping);
+  if (!probe) return 0;
+  game_delete(probe);
+  if (nb_threads == 0) nb_threads = 1;
+
+  target t = {.nb_rows = nb_rows,
+              .nb_cols = nb_cols,
+              .wrapping = wrapping,
+              .level = level,
+              .uniqueness = uniqueness,
+              .n = n};
+  pthread_mutex_init(&t.lock, NULL);
+  pthread_cond_init(&t.not_full, NULL);
+  pthread_cond_init(&t.not_empty, NULL);
+
+  target_worker *workers = _solver_alloc(nb_threads * sizeof(target_worker));
+  for (uint k = 0; k < nb_threads; k++) {
+    workers[k].t = &t;
+    workers[k].rng = ((uint64_t)rand() << 31) ^ (uint64_t)rand() ^
+                     ((k + 1) * UINT64_C(0x9E3779B97F4A7C15));
+    if (workers[k].rng == 0) workers[k].rng = 1;
+    if (pthread_create(&workers[k].thread, NULL, _target_work, &workers[k])) {
+      fprintf(stderr, "Error: unable to create a thread.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  uint nb_games = 0;
+  for (; nb_games < n; nb_games++) {
+    pthread_mutex_lock(&t.lock);
+    while (t.len == 0 && !t.give_up)
+      pthread_cond_wait(&t.not_empty, &t.lock);
+    if (t.len == 0) {
+      pthread_mutex_unlock(&t.lock);
+      break;
+    }
+    game g = t.queue[t.head];
+    t.head = (t.head + 1) % TARGET_QUEUE_SIZE;
+    t.len--;
+    pthread_cond_signal(&t.not_full);
+    pthread_mutex_unlock(&t.lock);
+    fn(g, data);
+  }
+
+  for (uint k = 0; k < nb_threads; k++) pthread_join(workers[k].thread, NULL);
+  free(workers);
+  pthread_cond_destroy(&t.not_empty);
+  pthread_cond_destroy(&t.not_full);
+  pthread_mutex_destroy(&t.lock);
+  return nb_games;
+}
+
+/* ************************************************************************** */
+
+static void _collect(game g, void *data) {
+  game **next = data;
+  *(*next)++ = g;
+}
+
+/* ************************************************************************** */
+
+game *game_random_target(uint nb_rows, uint nb_cols, bool wrapping,
+                         difficulty level, bool uniqueness, uint n,
+                         uint nb_threads) {
+  game *games = malloc(n * sizeof(game));
+  if (!games) return NULL;
+  game *next = games;
+  if (game_random_target_stream(nb_rows, nb_cols, wrapping, level, uniqueness,
+                                n, nb_threads, _collect, &next) != n) {
+    while (next > games) game_delete(*--next);
+    free(games);
+    return NULL;
+  }
+  return games;
+}
+
+/* ************************************************************************** */
+/*                                 SYMMETRIES                                 */
+/* ************************************************************************** */
+
+/** size of a game after a transform */
+static void _transform_size(cgame g, game_transform t, uint *height,
+                            uint *width) {
+  bool swap = t.nb_quarter_turns % 2;
+  *height = swap ? g->width : g->height;
+  *width = swap ? g->height : g->width;
+}
+
+/** square of g that goes to (i,j) after the mirror and the rotation of t */
+static uint _transform_source(cgame g, game_transform t, uint i, uint j) {
+  for (uint r = t.nb_quarter_turns; r > 0; r--) {
+    // one clockwise turn moves (h-1-j, i) to (i, j), for a grid of h rows
+    uint h = (r - 1) % 2 ? g->width : g->height;
+    uint ii = h - 1 - j;
+    j = i;
+    i = ii;
+  }
+  if (t.mirror) j = g->width - 1 - j;
+  return i * g->width + j;
+}
+
+/** orientation of a piece after the mirror and the rotation of t */
+static direction _transform_orientation(Acase c, game_transform t) {
+  direction o = c.orientation;
+  if (t.mirror) {
+    // exchange the east and west half-edges
+    uint code = HALF_EDGES[c.shape][o];
+    uint mirrored = (code & 0b1010) | (code & 0b0100) >> 2 | (code & 0b0001) << 2;
+    direction same = (o == EAST || o == WEST) ? (o + 2) % NB_DIRS : o;
+    if (HALF_EDGES[c.shape][same] == mirrored)
+      o = same;
+    else
+      for (direction d = 0; d < NB_DIRS; d++)
+        if (HALF_EDGES[c.shape][d] == mirrored) o = d;
+  }
+  return (o + t.nb_quarter_turns) % NB_DIRS;
+}
+
+/* ************************************************************************** */
+
+game game_transform_apply(cgame g, game_transform t) {
+  assert(g);
+  uint height, width;
+  _transform_size(g, t, &height, &width);
+  if (t.nb_quarter_turns >= NB_DIRS || t.row_shift >= height ||
+      t.col_shift >= width)
+    return NULL;
+  game res = game_new_empty_ext(height, width, g->isWrapping);
+  if (!res) return NULL;
+  for (uint i = 0; i < height; i++)
+    for (uint j = 0; j < width; j++) {
+      Acase c = g->cases[_transform_source(g, t, (i + t.row_shift) % height,
+                                           (j + t.col_shift) % width)];
+      res->cases[i * width + j].shape = c.shape;
+      res->cases[i * width + j].orientation = _transform_orientation(c, t);
+    }
+  return res;
+}
+
+/* ************************************************************************** */
+
+/* Polynomial hashes modulo the Mersenne prime 2^61-1. */
+#define HASH_MOD ((1ULL << 61) - 1)
+
+static uint64_t _mulmod(uint64_t a, uint64_t b) {
+  unsigned __int128 p = (unsigned __int128)a * b;
+  uint64_t r = (uint64_t)(p & HASH_MOD) + (uint64_t)(p >> 61);
+  return r >= HASH_MOD ? r - HASH_MOD : r;
+}
+
+static uint64_t _submod(uint64_t a, uint64_t b) {
+  return a >= b ? a - b : a + HASH_MOD - b;
+}
+
+/** prefix hashes of all the translations of a grid of shapes on the torus */
+typedef struct {
+  const uint8_t *cells; // shapes + 1, in row-major order
+  uint height, width;
+  uint64_t *row;        // row[i * (2w+1) + k]: hash of the k first cells of
+                        // row i repeated twice
+  uint64_t *rows;       // rows[dj * (2h+1) + t]: hash of the t first rows
+                        // shifted by dj, repeated twice
+  uint64_t *pow_cell, *pow_row;
+} torus_hash;
+
+#define HASH_CELL_BASE 1000003ULL
+#define HASH_ROW_BASE 998244353ULL
+
+/** hash of the r first cells of row i shifted by dj */
+static uint64_t _row_hash(const torus_hash *th, uint i, uint dj, uint r) {
+  const uint64_t *p = th->row + (size_t)i * (2 * th->width + 1);
+  return _submod(p[dj + r], _mulmod(p[dj], th->pow_cell[r]));
+}
+
+static bool _torus_hash_init(torus_hash *th, const uint8_t *cells, uint height,
+                             uint width) {
+  th->cells = cells;
+  th->height = height;
+  th->width = width;
+  th->row = malloc((size_t)height * (2 * width + 1) * sizeof(uint64_t));
+  th->rows = malloc((size_t)width * (2 * height + 1) * sizeof(uint64_t));
+  th->pow_cell = malloc((2 * (size_t)width + 1) * sizeof(uint64_t));
+  th->pow_row = malloc((2 * (size_t)height + 1) * sizeof(uint64_t));
+  if (!th->row || !th->rows || !th->pow_cell || !th->pow_row) return false;
+
+  th->pow_cell[0] = th->pow_row[0] = 1;
+  for (uint k = 1; k <= 2 * width; k++)
+    th->pow_cell[k] = _mulmod(th->pow_cell[k - 1], HASH_CELL_BASE);
+  for (uint k = 1; k <= 2 * height; k++)
+    th->pow_row[k] = _mulmod(th->pow_row[k - 1], HASH_ROW_BASE);
+  for (uint i = 0; i < height; i++) {
+    uint64_t *p = th->row + (size_t)i * (2 * width + 1);
+    p[0] = 0;
+    for (uint k = 0; k < 2 * width; k++)
+      p[k + 1] = (_mulmod(p[k], HASH_CELL_BASE) +
+                  cells[(size_t)i * width + k % width]) % HASH_MOD;
+  }
+  for (uint dj = 0; dj < width; dj++) {
+    uint64_t *q = th->rows + (size_t)dj * (2 * height + 1);
+    q[0] = 0;
+    for (uint t = 0; t < 2 * height; t++)
+      q[t + 1] = (_mulmod(q[t], HASH_ROW_BASE) +
+                  _row_hash(th, t % height, dj, width)) % HASH_MOD;
+  }
+  return true;
+}
+
+static void _torus_hash_free(torus_hash *th) {
+  free(th->row);
+  free(th->rows);
+  free(th->pow_cell);
+  free(th->pow_row);
+}
+
+/** cell k (in row-major order) of the grid translated by (di, dj) */
+static uint8_t _torus_cell(const torus_hash *th, uint di, uint dj, size_t k) {
+  uint i = (di + k / th->width) % th->height;
+  uint j = (dj + k % th->width) % th->width;
+  return th->cells[(size_t)i * th->width + j];
+}
+
+/** do the translations (di1, dj1) and (di2, dj2) have the same k first cells */
+static bool _torus_prefix_equal(const torus_hash *th, uint di1, uint dj1,
+                                uint di2, uint dj2, size_t k) {
+  uint q = k / th->width, r = k % th->width;
+  const uint64_t *q1 = th->rows + (size_t)dj1 * (2 * th->height + 1);
+  const uint64_t *q2 = th->rows + (size_t)dj2 * (2 * th->height + 1);
+  uint64_t h1 = _submod(q1[di1 + q], _mulmod(q1[di1], th->pow_row[q]));
+  uint64_t h2 = _submod(q2[di2 + q], _mulmod(q2[di2], th->pow_row[q]));
+  return h1 == h2 && _row_hash(th, (di1 + q) % th->height, dj1, r) ==
+                         _row_hash(th, (di2 + q) % th->height, dj2, r);
+}
+
+/** lexicographic comparison of two translations, in O(log n) */
+static int _torus_compare(const torus_hash *th, uint di1, uint dj1, uint di2,
+                          uint dj2) {
+  // longest common prefix, by binary search
+  size_t lo = 0, hi = (size_t)th->height * th->width;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo + 1) / 2;
+    if (_torus_prefix_equal(th, di1, dj1, di2, dj2, mid))
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  if (lo == (size_t)th->height * th->width) return 0;
+  return (int)_torus_cell(th, di1, dj1, lo) - _torus_cell(th, di2, dj2, lo);
+}
+
+/* ************************************************************************** */
+
+/** shapes (plus one) of g after a transform, in row-major order */
+static void _transform_cells(cgame g, game_transform t, uint8_t *cells) {
+  uint height, width;
+  _transform_size(g, t, &height, &width);
+  for (uint i = 0; i < height; i++)
+    for (uint j = 0; j < width; j++)
+      cells[(size_t)i * width + j] =
+          g->cases[_transform_source(g, t, (i + t.row_shift) % height,
+                                     (j + t.col_shift) % width)]
+              .shape +
+          1;
+}
+
+/** smallest translation of a grid on the torus */
+static bool _torus_minimum(const uint8_t *cells, uint height, uint width,
+                           uint *row_shift, uint *col_shift) {
+  torus_hash th;
+  if (!_torus_hash_init(&th, cells, height, width)) {
+    _torus_hash_free(&th);
+    return false;
+  }
+  // the first cell of the minimum is the smallest shape of the grid
+  size_t nb_squares = (size_t)height * width;
+  uint8_t first = UINT8_MAX;
+  for (size_t k = 0; k < nb_squares; k++)
+    if (cells[k] < first) first = cells[k];
+  bool found = false;
+  for (uint di = 0; di < height; di++)
+    for (uint dj = 0; dj < width; dj++) {
+      if (cells[(size_t)di * width + dj] != first) continue;
+      if (!found || _torus_compare(&th, di, dj, *row_shift, *col_shift) < 0) {
+        *row_shift = di;
+        *col_shift = dj;
+        found = true;
+      }
+    }
+  _torus_hash_free(&th);
+  return true;
+}
+
+/* ************************************************************************** */
+
+game_transform game_canonicalize(cgame g) {
+  assert(g);
+  size_t nb_squares = (size_t)g->height * g->width;
+  uint8_t *best_cells = malloc(nb_squares);
+  uint8_t *cells = malloc(nb_squares);
+  game_transform best = {false, 0, 0, 0};
+  uint best_height = 0, best_width = 0;
+  if (!best_cells || !cells) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint m = 0; m < 2; m++)
+    for (uint r = 0; r < NB_DIRS; r++) {
+      game_transform t = {m, r, 0, 0};
+      uint height, width;
+      _transform_size(g, t, &height, &width);
+      if (best_height && (height > best_height ||
+                          (height == best_height && width > best_width)))
+        continue;
+      if (g->isWrapping) {
+        // the smallest translation of this rotation, found with the hashes
+        _transform_cells(g, t, cells);
+        if (!_torus_minimum(cells, height, width, &t.row_shift,
+                            &t.col_shift)) {
+          fprintf(stderr, "Error: NULL pointer detected.\n");
+          exit(EXIT_FAILURE);
+        }
+      }
+      _transform_cells(g, t, cells);
+      if (!best_height || height < best_height || width < best_width ||
+          memcmp(cells, best_cells, nb_squares) < 0) {
+        best = t;
+        best_height = height;
+        best_width = width;
+        uint8_t *tmp = best_cells;
+        best_cells = cells;
+        cells = tmp;
+      }
+    }
+  free(cells);
+  free(best_cells);
+  return best;
+}
+
+/* ************************************************************************** */
+
+uint64_t game_canonical_hash(cgame g) {
+  assert(g);
+  game c = game_transform_apply(g, game_canonicalize(g));
+  if (!c) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  uint64_t h = game_hash(c, true);
+  game_delete(c);
+  return h;
+}
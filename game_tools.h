@@ -9,6 +9,7 @@
 #ifndef __GAME_TOOLS_H__
 #define __GAME_TOOLS_H__
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "game.h"
@@ -21,12 +22,32 @@
 
 /**
  * @brief Creates a game by loading its description from a text file.
- * @details See details in the file format description.
+ * @details See details in the file format description. On a syntax error, a
+ * message with the line and column of the error is printed on stderr.
  * @param filename input file
- * @return the loaded game
+ * @return the loaded game, or NULL if the file is not a valid game
  **/
 game game_load(char *filename);
 
+/**
+ * @brief Creates a game from its text description in a memory buffer.
+ * @details See @ref game_load. The buffer does not need to be null-terminated,
+ * and anything after the game is ignored.
+ * @param buf input buffer
+ * @param len size of the input buffer
+ * @return the loaded game, or NULL if the buffer is not a valid game
+ **/
+game game_load_mem(const char *buf, size_t len);
+
+/**
+ * @brief Creates a game by reading its text description from a file
+ * descriptor (a file, a pipe or a socket) until its end.
+ * @details See @ref game_load. The file descriptor is not closed.
+ * @param fd input file descriptor
+ * @return the loaded game, or NULL on error
+ **/
+game game_load_fd(int fd);
+
 /**
  * @brief Saves a game in a text file.
  * @details See details the file format description.
@@ -35,6 +56,94 @@ game game_load(char *filename);
  **/
 void game_save(cgame g, char *filename);
 
+/**
+ * @brief Writes a game in a memory buffer, in the text format of game_save.
+ * @details The text is the same as the content of the file written by
+ * @ref game_save. No null character is added.
+ * @param g game to save
+ * @param buf output buffer (may be NULL if @p cap is 0)
+ * @param cap size of the output buffer
+ * @return the length of the text; nothing is written if it is larger than
+ * @p cap
+ **/
+size_t game_save_mem(cgame g, char *buf, size_t cap);
+
+/**
+ * @brief Writes a game to a file descriptor, in the text format of game_save.
+ * @details The game is serialised by chunks in a fixed-size buffer. The file
+ * descriptor is not closed.
+ * @param g game to save
+ * @param fd output file descriptor
+ * @return true on success, false on a write error
+ **/
+bool game_save_fd(cgame g, int fd);
+
+/**
+ * @brief Reader of a stream of games.
+ * @details A stream is a sequence of games in the text format of
+ * @ref game_save, simply concatenated. Games are read one at a time, with a
+ * buffer of the size of the largest game.
+ **/
+typedef struct game_reader_s game_reader;
+
+/**
+ * @brief Writer of a stream of games (see @ref game_reader).
+ **/
+typedef struct game_writer_s game_writer;
+
+/**
+ * @brief Opens a stream of games for reading.
+ * @param filename input file, or NULL or "-" for the standard input
+ * @return the reader, or NULL if the file cannot be opened
+ **/
+game_reader *game_reader_open(const char *filename);
+
+/**
+ * @brief Reads the next game of a stream.
+ * @param r the reader
+ * @return the game, or NULL at the end of the stream or on error (see
+ * @ref game_reader_error)
+ **/
+game game_reader_next(game_reader *r);
+
+/**
+ * @brief Tells whether a reader stopped on an error.
+ * @param r the reader
+ * @return true if a read or syntax error occurred (it is printed on stderr)
+ **/
+bool game_reader_error(const game_reader *r);
+
+/**
+ * @brief Closes a reader (the standard input is not closed).
+ * @param r the reader (or NULL)
+ **/
+void game_reader_close(game_reader *r);
+
+/**
+ * @brief Opens a stream of games for writing.
+ * @param filename output file (truncated), or NULL or "-" for the standard
+ * output
+ * @return the writer, or NULL if the file cannot be opened
+ **/
+game_writer *game_writer_open(const char *filename);
+
+/**
+ * @brief Appends a game to a stream.
+ * @details Games are buffered, and written when the buffer is full or when
+ * the writer is closed.
+ * @param w the writer
+ * @param g the game
+ * @return true on success, false on a write error
+ **/
+bool game_writer_write(game_writer *w, cgame g);
+
+/**
+ * @brief Flushes and closes a writer (the standard output is not closed).
+ * @param w the writer (or NULL)
+ * @return true if all the games were written, false otherwise
+ **/
+bool game_writer_close(game_writer *w);
+
 /**
  * @brief Creates a random game solution with a given size and options.
  * @param nb_rows number of rows in game
@@ -60,6 +169,24 @@ game game_random(uint nb_rows, uint nb_cols, bool wrapping, uint nb_empty,
  */
 bool game_solve(game g);
 
+/**
+ * @brief Statistics of a search, see @ref game_solve_stats.
+ **/
+typedef struct {
+  uint64_t nb_fails;   /**< dead ends met, over all the runs */
+  uint nb_restarts;    /**< restarts following the Luby sequence */
+  uint nb_nogoods;     /**< nogoods recorded before the restarts */
+} solve_stats;
+
+/**
+ * @brief Computes the solution of a given game, as @ref game_solve, and
+ * reports how the search went.
+ * @param g the game to solve
+ * @param stats statistics of the search (output, may be NULL)
+ * @return true if a solution is found, false otherwise
+ */
+bool game_solve_stats(game g, solve_stats *stats);
+
 /**
  * @brief Computes the total number of solutions of a given game.
  * @param g the game
@@ -70,6 +197,156 @@ bool game_solve(game g);
  */
 
 uint game_nb_solutions(cgame g);
+
+/**
+ * @brief Splits the counting of solutions into independent jobs.
+ * @param g the game
+ * @param nb_fixed number of squares (in row-major order) fixed by each job
+ * @param fn function called once per job
+ * @param data user data passed to @p fn
+ * @details Enumerates the orientations of the first @p nb_fixed squares that
+ * may lead to a solution. For each of them, @p fn is called with a game where
+ * these squares are oriented accordingly (this game is reused between calls).
+ * Summing @ref game_nb_solutions_fixed over all the jobs gives the total number
+ * of solutions.
+ * @post The game @p g must be unchanged.
+ * @return the number of jobs
+ */
+uint game_split_solutions(cgame g, uint nb_fixed,
+                          void (*fn)(cgame job, void *data), void *data);
+
+/**
+ * @brief Computes the number of solutions of a game with its first squares
+ * fixed.
+ * @param g the game
+ * @param nb_fixed number of squares (in row-major order) that keep their
+ * current orientation
+ * @details This is the partial count of one job built by
+ * @ref game_split_solutions.
+ * @post The game @p g must be unchanged.
+ * @return the number of solutions
+ */
+uint64_t game_nb_solutions_fixed(cgame g, uint nb_fixed);
+
+/**
+ * @brief Deduction rules used to rate the difficulty of a game, from the
+ * easiest to the hardest.
+ **/
+typedef enum {
+  TRIVIAL = 0,    /**< no deduction needed */
+  EDGE_MATCHING,  /**< local edge matching, including the grid borders */
+  DEAD_END,       /**< no component closed before connecting all pieces */
+  LOOP_AVOIDANCE, /**< no cycle, when no solution can contain one */
+  LOOKAHEAD,      /**< two-square lookahead combining the previous rules */
+  UNRATED,        /**< not solvable by deductions alone */
+  NB_DIFFICULTIES /**< nb of difficulties */
+} difficulty;
+
+/**
+ * @brief Result of the difficulty rating of a game.
+ **/
+typedef struct {
+  difficulty level; /**< hardest rule needed to solve the game */
+  uint nb_rounds;   /**< number of deduction rounds */
+} rating;
+
+/**
+ * @brief Rates the difficulty of a game.
+ * @param g the game
+ * @details The game is solved using only the deduction rules of
+ * @ref difficulty, without any guess: each round applies the easiest rule that
+ * makes progress. A game which has several solutions, or none, is @ref UNRATED.
+ * @post The game @p g must be unchanged.
+ * @return the hardest rule needed and the number of deduction rounds
+ */
+rating game_rate_difficulty(cgame g);
+
+/**
+ * @brief Creates random shuffled games of a given difficulty.
+ * @param nb_rows number of rows in game
+ * @param nb_cols number of columns in game
+ * @param wrapping wrapping option
+ * @param level required difficulty, as rated by @ref game_rate_difficulty
+ * @param uniqueness if true, only games with a unique solution are kept
+ * @param n number of games to create
+ * @param nb_threads number of worker threads
+ * @details Each worker thread generates a game solution with
+ * @ref game_random (without empty squares nor extra edges), shuffles it, rates
+ * it and keeps it if it meets the requirements. Workers have their own random
+ * generator, seeded from rand(). Such games are never @ref TRIVIAL, and some
+ * levels may be out of reach on small grids: the generation gives up after
+ * 100000 games in a row are rejected.
+ * @pre nb_cols * nb_rows >= 2
+ * @return an array of @p n games, to be freed by the caller along with each
+ * game (or NULL in case of error, if @p level is @ref TRIVIAL or if the
+ * generation gives up)
+ */
+game *game_random_target(uint nb_rows, uint nb_cols, bool wrapping,
+                         difficulty level, bool uniqueness, uint n,
+                         uint nb_threads);
+
+/**
+ * @brief Creates random shuffled games of a given difficulty, handing them
+ * over one at a time.
+ * @details Same as @ref game_random_target, except that @p fn is called from
+ * the calling thread as soon as each game is accepted, so that memory does not
+ * grow with @p n. The workers stop when the bounded output queue is full.
+ * @param fn function taking the ownership of each game
+ * @param data user data passed to @p fn
+ * @return the number of games created: @p n, fewer if the generation gives up
+ * (see @ref game_random_target), or 0 in case of error
+ */
+uint game_random_target_stream(uint nb_rows, uint nb_cols, bool wrapping,
+                               difficulty level, bool uniqueness, uint n,
+                               uint nb_threads, void (*fn)(game g, void *data),
+                               void *data);
+
+/**
+ * @brief Grid symmetry: a mirror, then a rotation, then a translation.
+ * @details The mirror exchanges the columns j and nb_cols-1-j. The rotation
+ * turns the grid (and each piece) clockwise. The translation, only used on
+ * wrapping games, moves the square (row_shift, col_shift) of the rotated grid
+ * to (0, 0).
+ **/
+typedef struct {
+  bool mirror;           /**< horizontal mirror, applied first */
+  uint nb_quarter_turns; /**< clockwise rotation, from 0 to 3 */
+  uint row_shift;        /**< translation on the torus (rows) */
+  uint col_shift;        /**< translation on the torus (columns) */
+} game_transform;
+
+/**
+ * @brief Computes the canonical form of a game under the grid symmetries.
+ * @details Among the 8 rotations and mirrors of the grid, and all their
+ * translations when the game is wrapping, finds the one with the smallest
+ * size (nb_rows, then nb_cols) and then the lexicographically smallest shapes
+ * in row-major order. The orientations are ignored. Translations are compared
+ * with rolling hashes, so that this is O(n log n) for a grid of n squares.
+ * Games that are the same puzzle up to a symmetry have the same canonical form.
+ * @param g the game
+ * @return the transform that gives the canonical form (see
+ * @ref game_transform_apply); the first one found if several do
+ */
+game_transform game_canonicalize(cgame g);
+
+/**
+ * @brief Applies a grid symmetry to a game.
+ * @param g the game
+ * @param t the transform
+ * @return a new game, with an empty history (or NULL in case of error)
+ */
+game game_transform_apply(cgame g, game_transform t);
+
+/**
+ * @brief Computes a hash of the canonical form of a game.
+ * @details Two games that are the same puzzle up to a symmetry (see
+ * @ref game_canonicalize) have the same hash, so that duplicates can be found
+ * with a hash table lookup.
+ * @param g the game
+ * @return the hash of the shapes of the canonical form (see @ref game_hash)
+ */
+uint64_t game_canonical_hash(cgame g);
+
 /**
  * @}
  */
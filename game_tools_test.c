@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "game_tools.h"
 
 #include <assert.h>
@@ -5,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "game.h"
 #include "game_aux.h"
@@ -77,6 +80,61 @@ bool test_game_load() {
   return true;
 }
 
+bool test_game_load_mem() {
+  // même contenu que test_game_load, sans fin de chaîne
+  const char text[] =
+      "5 5 0\nCW NN NW CN NS\nTS TW TN TE TE\nNE NN TW NW SE\n"
+      "NS TS TN CW SN\nNE TW NS NE NS\n";
+  char *buf = malloc(sizeof(text) - 1);
+  memcpy(buf, text, sizeof(text) - 1);
+  game g = game_load_mem(buf, sizeof(text) - 1);
+  bool ok = g && game_nb_rows(g) == 5 && !game_is_wrapping(g) &&
+            game_get_piece_shape(g, 4, 1) == TEE &&
+            game_get_piece_orientation(g, 4, 1) == WEST &&
+            game_get_piece_shape(g, 4, 4) == ENDPOINT &&
+            game_get_piece_orientation(g, 4, 4) == SOUTH;
+  free(buf);
+
+  // les erreurs donnent NULL au lieu d'un jeu incomplet
+  const char *invalid[] = {"",
+                           "2 2",
+                           "2 x 1\nCW NN\nTS TW\n",
+                           "0 2 1\n",
+                           "2 2 1\nCW NN\nTS",
+                           "2 2 1\nCW NN\nQS TW\n",
+                           "2 2 1\nCW NN\nTS T \n",
+                           "99999999999 2 1\n"};
+  for (uint k = 0; k < sizeof(invalid) / sizeof(invalid[0]); k++) {
+    game bad = game_load_mem(invalid[k], strlen(invalid[k]));
+    if (bad) ok = false;
+    game_delete(bad);
+  }
+
+  // depuis un tube, sans retour à la ligne final ni espaces
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  const char *small = " 2 3  1 CWNNXE\r\n\tTSTWES";
+  ok = ok && write(fds[1], small, strlen(small)) == (ssize_t)strlen(small);
+  close(fds[1]);
+  game p = game_load_fd(fds[0]);
+  close(fds[0]);
+  ok = ok && p && game_nb_cols(p) == 3 && game_is_wrapping(p) &&
+       game_get_piece_shape(p, 0, 2) == CROSS &&
+       game_get_piece_orientation(p, 1, 2) == SOUTH;
+
+  // même résultat que game_save puis game_load
+  if (g && p) {
+    game_save(g, "test_game_load_mem.txt");
+    game h = game_load("test_game_load_mem.txt");
+    ok = ok && h && game_equal(g, h, false);
+    game_delete(h);
+    remove("test_game_load_mem.txt");
+  }
+  game_delete(p);
+  game_delete(g);
+  return ok;
+}
+
 bool test_game_save() {
   game g = game_new_empty_ext(5, 5, false);
   g->cases[0].shape = CORNER;
@@ -117,6 +175,368 @@ bool test_game_save() {
   return true;
 }
 
+bool test_game_save_mem() {
+  game g = game_new_empty_ext(2, 3, true);
+  game_set_piece_shape(g, 0, 0, CORNER);
+  game_set_piece_orientation(g, 0, 0, WEST);
+  game_set_piece_shape(g, 1, 2, CROSS);
+  game_set_piece_orientation(g, 1, 1, SOUTH);
+  const char *expected = "2 3 1\nCW EN EN \nEN ES XN \n";
+  char buf[64];
+  size_t len = game_save_mem(g, buf, sizeof(buf));
+  bool ok = len == strlen(expected) && memcmp(buf, expected, len) == 0;
+  // tampon trop petit : rien n'est écrit
+  buf[0] = '?';
+  if (game_save_mem(g, buf, len - 1) != len || buf[0] != '?') ok = false;
+  game_delete(g);
+
+  // même texte que game_save, sur plusieurs morceaux de game_save_fd
+  g = game_random(90, 70, false, 10, 5);
+  char *text = malloc(game_save_mem(g, NULL, 0));
+  len = game_save_mem(g, text, game_save_mem(g, NULL, 0));
+  game_save(g, "test_game_save_mem.txt");
+  FILE *file = fopen("test_game_save_mem.txt", "r");
+  char *saved = malloc(len + 1);
+  ok = ok && file && fread(saved, 1, len + 1, file) == len &&
+       memcmp(saved, text, len) == 0;
+  if (file) fclose(file);
+  remove("test_game_save_mem.txt");
+  game h = game_load_mem(text, len);
+  ok = ok && h && game_equal(g, h, false);
+  game_delete(h);
+  free(saved);
+  free(text);
+  game_delete(g);
+  return ok;
+}
+
+bool test_game_reader() {
+  const char *filename = "test_game_reader.txt";
+  // assez de jeux pour remplir plusieurs tampons, dont un plus grand qu'eux
+  uint n = 300;
+  game *games = malloc(n * sizeof(game));
+  game_writer *w = game_writer_open(filename);
+  bool ok = w != NULL;
+  for (uint k = 0; k < n; k++) {
+    uint size = (k == n / 2) ? 200 : 2 + k % 17;
+    games[k] = game_random(size, 3 + k % 5, k % 2, 0, 0);
+    ok = ok && game_writer_write(w, games[k]);
+  }
+  ok = ok && game_writer_close(w);
+
+  game_reader *r = game_reader_open(filename);
+  ok = ok && r != NULL;
+  for (uint k = 0; ok && k < n; k++) {
+    game g = game_reader_next(r);
+    ok = g && game_equal(g, games[k], false) &&
+         game_is_wrapping(g) == game_is_wrapping(games[k]);
+    game_delete(g);
+  }
+  ok = ok && game_reader_next(r) == NULL && !game_reader_error(r);
+  game_reader_close(r);
+  for (uint k = 0; k < n; k++) game_delete(games[k]);
+  free(games);
+
+  // une erreur arrête la lecture
+  FILE *file = fopen(filename, "w");
+  fprintf(file, "1 2 0\nCW NN\n\n1 2 0\nCW QN\n1 1 0\nEN\n");
+  fclose(file);
+  r = game_reader_open(filename);
+  game g = game_reader_next(r);
+  ok = ok && g && game_reader_next(r) == NULL && game_reader_error(r) &&
+       game_reader_next(r) == NULL;
+  game_delete(g);
+  game_reader_close(r);
+
+  // flux vide
+  fclose(fopen(filename, "w"));
+  r = game_reader_open(filename);
+  ok = ok && game_reader_next(r) == NULL && !game_reader_error(r);
+  game_reader_close(r);
+  remove(filename);
+  return ok && game_reader_open("test_game_reader.missing") == NULL;
+}
+
+bool test_game_solve() {
+  // Le jeu par défaut mélangé doit être résolu
+  game g = game_default();
+  if (!game_solve(g) || !game_won(g)) {
+    game_delete(g);
+    return false;
+  }
+  game_delete(g);
+
+  // Plusieurs jeux aléatoires, avec et sans wrapping
+  srand(42);
+  for (uint k = 0; k < 20; k++) {
+    game r = game_random(6, 7, k % 2, 3, k % 3);
+    if (!r) return false;
+    game_shuffle_orientation(r);
+    if (!game_solve(r) || !game_won(r)) {
+      game_delete(r);
+      return false;
+    }
+    game_delete(r);
+  }
+
+  // Un jeu sans solution doit rester inchangé
+  game u = game_new_empty_ext(2, 2, false);
+  game_set_piece_shape(u, 0, 0, ENDPOINT);
+  game_set_piece_orientation(u, 0, 0, WEST);
+  game c = game_copy(u);
+  bool solved = game_solve(u);
+  bool unchanged = game_equal(u, c, false);
+  game_delete(u);
+  game_delete(c);
+  return !solved && unchanged;
+}
+
+bool test_game_solve_restarts() {
+  // grille trouvée par game_random (10x10, avec wrapping) : la recherche
+  // dépasse sa limite d'échecs et repart au moins une fois
+  const char *text =
+      "10 10 1\n"
+      "NS CE NN NN NS CN TN TN CW TW \n"
+      "NE TW TE NE NS TN TW CS SN NW \n"
+      "NS TE TS SW TN XN TS NW TW NE \n"
+      "NS CS TS SS SS CN NS CS CE NS \n"
+      "TE TS TE NS TW SW NS NS NS TS \n"
+      "NE NN TN CN TW NN NN NE NN NN \n"
+      "CW NS TS TE CE CN TS CW CS TW \n"
+      "TE TW TE TW SE TN TS CN NW CN \n"
+      "TS NN SN NS NN CW CW NE NE XW \n"
+      "NE TN TE TW TE NS SW NW NS TE \n";
+  game g = game_load_mem(text, strlen(text));
+  if (!g) return false;
+  solve_stats stats;
+  bool ok = game_solve_stats(g, &stats) && game_won(g);
+  ok = ok && stats.nb_restarts >= 1 && stats.nb_nogoods >= 1 &&
+       stats.nb_fails > 0;
+  game_delete(g);
+
+  // sans restart, aucun nogood n'est enregistré
+  g = game_default();
+  ok = ok && game_solve_stats(g, &stats) && stats.nb_restarts == 0 &&
+       stats.nb_nogoods == 0;
+  game_delete(g);
+  return ok;
+}
+
+bool test_game_nb_solutions() {
+  game g = game_default();
+  game c = game_copy(g);
+  uint nb = game_nb_solutions(g);
+  bool unchanged = game_equal(g, c, false);
+  game_delete(g);
+  game_delete(c);
+  if (nb != 2 || !unchanged) return false;
+
+  // Deux extrémités face à face : une seule solution
+  game e = game_new_empty_ext(1, 2, false);
+  game_set_piece_shape(e, 0, 0, ENDPOINT);
+  game_set_piece_shape(e, 0, 1, ENDPOINT);
+  nb = game_nb_solutions(e);
+  game_delete(e);
+  if (nb != 1) return false;
+
+  // Les orientations symétriques (SEGMENT, CROSS, EMPTY) comptent une fois
+  shape shapes[] = {EMPTY,    ENDPOINT, EMPTY,    ENDPOINT, CROSS,
+                    ENDPOINT, EMPTY,    ENDPOINT, EMPTY};
+  game x = game_new_ext(3, 3, shapes, NULL, false);
+  nb = game_nb_solutions(x);
+  game_delete(x);
+  if (nb != 1) return false;
+
+  shape line[] = {ENDPOINT, SEGMENT, SEGMENT, ENDPOINT};
+  game l = game_new_ext(1, 4, line, NULL, false);
+  nb = game_nb_solutions(l);
+  game_delete(l);
+  if (nb != 1) return false;
+
+  game v = game_new_empty_ext(3, 3, true);
+  nb = game_nb_solutions(v);
+  game_delete(v);
+  return nb == 1;
+}
+
+static void sum_job(cgame job, void *data) {
+  uint64_t *sum = data;
+  *sum += game_nb_solutions_fixed(job, 6);
+}
+
+bool test_game_split_solutions() {
+  srand(7);
+  for (uint k = 0; k < 5; k++) {
+    game g = game_random(4, 5, k % 2, 6, 1);
+    if (!g) return false;
+    game_shuffle_orientation(g);
+    uint64_t sum = 0;
+    uint nb_jobs = game_split_solutions(g, 6, sum_job, &sum);
+    uint nb = game_nb_solutions(g);
+    game_delete(g);
+    if (nb_jobs == 0 || sum != nb) return false;
+  }
+  return true;
+}
+
+bool test_game_rate_difficulty() {
+  // Grille vide : aucune déduction nécessaire
+  game v = game_new_empty_ext(4, 4, false);
+  rating r = game_rate_difficulty(v);
+  game_delete(v);
+  if (r.level != TRIVIAL || r.nb_rounds != 0) return false;
+
+  // Deux extrémités : la correspondance des arêtes suffit
+  game e = game_new_empty_ext(1, 2, false);
+  game_set_piece_shape(e, 0, 0, ENDPOINT);
+  game_set_piece_shape(e, 0, 1, ENDPOINT);
+  r = game_rate_difficulty(e);
+  game_delete(e);
+  if (r.level != EDGE_MATCHING || r.nb_rounds == 0) return false;
+
+  // Le jeu par défaut a deux solutions : il ne peut pas être déduit
+  game g = game_default();
+  r = game_rate_difficulty(g);
+  game_delete(g);
+  if (r.level != UNRATED) return false;
+
+  // Un jeu résolu par déduction a une unique solution
+  srand(3);
+  for (uint k = 0; k < 50; k++) {
+    game x = game_random(5, 5, k % 2, 0, 0);
+    game_shuffle_orientation(x);
+    r = game_rate_difficulty(x);
+    uint nb = game_nb_solutions(x);
+    game_delete(x);
+    if (r.level != UNRATED && nb != 1) return false;
+  }
+  return true;
+}
+
+bool test_game_random_target() {
+  srand(11);
+  uint n = 20;
+  game *games = game_random_target(5, 5, true, DEAD_END, true, n, 3);
+  if (!games) return false;
+  bool ok = true;
+  for (uint k = 0; k < n; k++) {
+    rating r = game_rate_difficulty(games[k]);
+    if (r.level != DEAD_END || game_nb_rows(games[k]) != 5 ||
+        !game_is_wrapping(games[k]) || game_nb_solutions(games[k]) != 1)
+      ok = false;
+    game_delete(games[k]);
+  }
+  free(games);
+
+  // Taille invalide
+  if (game_random_target(1, 1, false, TRIVIAL, false, 1, 1) != NULL)
+    return false;
+  // Niveaux hors d'atteinte : rejeté d'emblée, ou abandon après trop d'essais
+  if (game_random_target(5, 5, false, TRIVIAL, true, 3, 2) != NULL)
+    return false;
+  if (game_random_target(1, 2, false, LOOKAHEAD, false, 2, 2) != NULL)
+    return false;
+  return ok;
+}
+
+/* Compare les formes de deux jeux : taille, puis ordre lexicographique. */
+static int compare_shapes(cgame g1, cgame g2) {
+  if (game_nb_rows(g1) != game_nb_rows(g2))
+    return (int)game_nb_rows(g1) - (int)game_nb_rows(g2);
+  if (game_nb_cols(g1) != game_nb_cols(g2))
+    return (int)game_nb_cols(g1) - (int)game_nb_cols(g2);
+  for (uint i = 0; i < game_nb_rows(g1); i++)
+    for (uint j = 0; j < game_nb_cols(g1); j++)
+      if (game_get_piece_shape(g1, i, j) != game_get_piece_shape(g2, i, j))
+        return (int)game_get_piece_shape(g1, i, j) -
+               (int)game_get_piece_shape(g2, i, j);
+  return 0;
+}
+
+bool test_game_canonicalize() {
+  srand(5);
+  uint sizes[][2] = {{4, 4}, {3, 5}, {1, 6}, {6, 6}};
+  bool ok = true;
+  for (uint k = 0; k < 8; k++) {
+    game g = game_random(sizes[k % 4][0], sizes[k % 4][1], k / 4, 1, 0);
+    if (!g) return false;
+    game_transform c = game_canonicalize(g);
+    game canon = game_transform_apply(g, c);
+    uint64_t h = game_canonical_hash(g);
+
+    for (uint m = 0; m < 2; m++)
+      for (uint r = 0; r < NB_DIRS; r++) {
+        game_transform t = {m, r, 0, 0};
+        if (game_is_wrapping(g)) {
+          t.row_shift = rand() % (r % 2 ? game_nb_cols(g) : game_nb_rows(g));
+          t.col_shift = rand() % (r % 2 ? game_nb_rows(g) : game_nb_cols(g));
+        }
+        game g2 = game_transform_apply(g, t);
+        // une symétrie garde la solution, et la forme canonique
+        if (!g2 || !game_won(g2)) ok = false;
+        if (compare_shapes(canon, g2) > 0) ok = false;
+        game canon2 = game_transform_apply(g2, game_canonicalize(g2));
+        if (compare_shapes(canon, canon2) != 0 || game_canonical_hash(g2) != h)
+          ok = false;
+        game_delete(canon2);
+        game_delete(g2);
+      }
+
+    // minimalité, par force brute sur toutes les translations
+    for (uint m = 0; m < 2 && game_is_wrapping(g); m++)
+      for (uint r = 0; r < NB_DIRS; r++)
+        for (uint di = 0; di < game_nb_rows(g); di++)
+          for (uint dj = 0; dj < game_nb_cols(g); dj++) {
+            game_transform t = {m, r, di, dj};
+            game g2 = game_transform_apply(g, t);
+            if (g2 && compare_shapes(canon, g2) > 0) ok = false;
+            game_delete(g2);
+          }
+    game_delete(canon);
+    game_delete(g);
+  }
+  return ok;
+}
+
+/* ************************************************************************** */
+/*                              GRANDES GRILLES                               */
+/* ************************************************************************** */
+
+bool test_large_game_random() {
+  srand(31);
+  game g = game_random(1000, 1000, true, 0, 0);
+  if (!g) return false;
+  bool ok = game_nb_rows(g) == 1000 && game_won(g);
+
+  // Aller-retour par un fichier
+  const char *filename = "test_large.txt";
+  game_save(g, (char *)filename);
+  game g2 = game_load((char *)filename);
+  remove(filename);
+  if (!game_equal(g, g2, false) || !game_is_wrapping(g2)) ok = false;
+  game_delete(g2);
+  game_delete(g);
+
+  // Avec des cases vides et des arêtes en plus
+  g = game_random(300, 500, false, 1000, 50);
+  if (!g || !game_is_well_paired(g) || !game_is_connected(g)) ok = false;
+  game_delete(g);
+  return ok;
+}
+
+bool test_large_game_solve() {
+  srand(32);
+  bool ok = true;
+  for (uint wrapping = 0; wrapping < 2; wrapping++) {
+    game g = game_random(200, 200, wrapping, 0, 0);
+    if (!g) return false;
+    game_shuffle_orientation(g);
+    if (!game_solve(g) || !game_won(g)) ok = false;
+    game_delete(g);
+  }
+  return ok;
+}
+
 void usage(int argc, char *argv[]) {
   fprintf(stderr, "Usage: %s <testname> [<...>]\n", argv[0]);
   exit(EXIT_FAILURE);
@@ -132,8 +552,32 @@ int main(int argc, char *argv[]) {
 
   if (strcmp("game_load", argv[1]) == 0) {
     etat = test_game_load();
+  } else if (strcmp("game_load_mem", argv[1]) == 0) {
+    etat = test_game_load_mem();
   } else if (strcmp("game_save", argv[1]) == 0) {
     etat = test_game_save();
+  } else if (strcmp("game_save_mem", argv[1]) == 0) {
+    etat = test_game_save_mem();
+  } else if (strcmp("game_reader", argv[1]) == 0) {
+    etat = test_game_reader();
+  } else if (strcmp("game_solve", argv[1]) == 0) {
+    etat = test_game_solve();
+  } else if (strcmp("game_solve_restarts", argv[1]) == 0) {
+    etat = test_game_solve_restarts();
+  } else if (strcmp("game_nb_solutions", argv[1]) == 0) {
+    etat = test_game_nb_solutions();
+  } else if (strcmp("game_split_solutions", argv[1]) == 0) {
+    etat = test_game_split_solutions();
+  } else if (strcmp("game_rate_difficulty", argv[1]) == 0) {
+    etat = test_game_rate_difficulty();
+  } else if (strcmp("game_random_target", argv[1]) == 0) {
+    etat = test_game_random_target();
+  } else if (strcmp("game_canonicalize", argv[1]) == 0) {
+    etat = test_game_canonicalize();
+  } else if (strcmp("large_game_random", argv[1]) == 0) {
+    etat = test_large_game_random();
+  } else if (strcmp("large_game_solve", argv[1]) == 0) {
+    etat = test_large_game_solve();
   } else {
     fprintf(stderr, "Test \"%s\" finished: FAILURE\n", argv[1]);
     return EXIT_FAILURE;
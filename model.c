@@ -5,9 +5,11 @@
 #include <SDL.h>
 #include <SDL_image.h>  // required to load transparent texture from PNG
 #include <SDL_ttf.h>    // required to use TTF fonts
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "game.h"
 #include "game_aux.h"
@@ -29,6 +31,21 @@
 #define BACKGROUND "res/BACKGROUND.png"
 
 #define FONT "res/SuperPeace.ttf"
+
+// SDL_RenderGeometry est apparu dans SDL 2.0.18
+#if !SDL_VERSION_ATLEAST(2, 0, 18)
+#error "SDL 2.0.18 or later is required (SDL_RenderGeometry)"
+#endif
+
+/* Atlas : toutes les cases possibles (fond "en cours" ou "gagné", avec chaque
+ * pièce dans chaque orientation) sont dessinées une fois pour toutes dans une
+ * seule texture. La grille est ensuite affichée par un seul appel à
+ * SDL_RenderGeometry, avec deux triangles par case dont seules les
+ * coordonnées de texture des cases modifiées sont réécrites. */
+#define NB_TILES (2 * NB_SHAPES * NB_DIRS)
+#define ATLAS_COLS 8
+#define ATLAS_ROWS ((NB_TILES + ATLAS_COLS - 1) / ATLAS_COLS)
+#define NO_TILE 0xFF
 /* **************************************************************** */
 
 struct Env_t {
@@ -42,10 +59,147 @@ struct Env_t {
   SDL_Texture *textTexture;
 
   bool messageShown;
+
+  SDL_Texture *atlas;    // toutes les cases pré-dessinées
+  SDL_Vertex *vertices;  // 4 sommets par case
+  int *indices;          // 6 indices par case (deux triangles)
+  Uint8 *tiles;          // tuile de l'atlas affichée dans chaque case
+  int gridX, gridY;      // position de la grille dans les sommets
+
+  bool dirty;          // l'état a changé depuis le dernier affichage
+  bool input_pending;  // une entrée n'est pas encore affichée
+  Uint32 input_time;   // date de la première de ces entrées
+  Uint32 last_latency;
+  Uint32 max_latency;
+  Uint64 sum_latency;
+  Uint32 nb_latencies;
 };
 
 /* **************************************************************** */
 
+static int tile_index(int game_state, shape s, direction o) {
+  int background = (game_state == 1) ? 1 : 0;  // vert si gagné, bleu sinon
+  return (background * NB_SHAPES + s) * NB_DIRS + o;
+}
+
+static SDL_Rect tile_rect(int tile) {
+  SDL_Rect rect = {(tile % ATLAS_COLS) * CELLULE_SIZE,
+                   (tile / ATLAS_COLS) * CELLULE_SIZE, CELLULE_SIZE,
+                   CELLULE_SIZE};
+  return rect;
+}
+
+/* dessiner toutes les cases dans l'atlas (à refaire si le contenu des
+ * textures cibles est perdu) */
+static void bake_atlas(SDL_Renderer *ren, Env *env) {
+  if (!env->atlas) {
+    env->atlas = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGBA8888,
+                                   SDL_TEXTUREACCESS_TARGET,
+                                   ATLAS_COLS * CELLULE_SIZE,
+                                   ATLAS_ROWS * CELLULE_SIZE);
+    if (!env->atlas) {
+      fprintf(stderr, "Erreur création de l'atlas: %s\n", SDL_GetError());
+      exit(EXIT_FAILURE);
+    }
+    SDL_SetTextureBlendMode(env->atlas, SDL_BLENDMODE_BLEND);
+  }
+  if (SDL_SetRenderTarget(ren, env->atlas) != 0) {
+    fprintf(stderr, "Erreur dessin de l'atlas: %s\n", SDL_GetError());
+    exit(EXIT_FAILURE);
+  }
+  SDL_SetRenderDrawColor(ren, 0, 0, 0, 0);
+  SDL_RenderClear(ren);
+
+  for (int state = 0; state < 2; state++) {
+    for (shape s = 0; s < NB_SHAPES; s++) {
+      for (direction o = 0; o < NB_DIRS; o++) {
+        SDL_Rect rect = tile_rect(tile_index(state, s, o));
+        if (state == 1) {
+          SDL_SetRenderDrawColor(ren, 0, 255, 0, 255);  // Vert
+        } else {
+          SDL_SetRenderDrawColor(ren, 135, 206, 235,
+                                 255);  // Bleu ciel (Sky Blue)
+        }
+        SDL_RenderFillRect(ren, &rect);
+        SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+        SDL_RenderDrawRect(ren, &rect);  // bordure noire
+
+        // la pièce occupe toute la case, tournée autour de son centre
+        if (s != EMPTY) {
+          SDL_Point center = {CELLULE_SIZE / 2, CELLULE_SIZE / 2};
+          SDL_RenderCopyEx(ren, env->piece_textures[s - 1], NULL, &rect,
+                           o * 90.0, &center, SDL_FLIP_NONE);
+        }
+      }
+    }
+  }
+  SDL_SetRenderTarget(ren, NULL);
+}
+
+/* sommets et triangles de la grille, avec des coordonnées de texture à
+ * remplir par update_geometry() */
+static void init_geometry(Env *env) {
+  int nb_cells = env->g->height * env->g->width;
+  env->vertices = malloc(4 * nb_cells * sizeof(SDL_Vertex));
+  env->indices = malloc(6 * nb_cells * sizeof(int));
+  env->tiles = malloc(nb_cells);
+  if (!env->vertices || !env->indices || !env->tiles) {
+    fprintf(stderr, "Error: NULL pointer detected.\n");
+    exit(EXIT_FAILURE);
+  }
+  SDL_Color white = {255, 255, 255, 255};  // la texture n'est pas teintée
+  for (int k = 0; k < nb_cells; k++) {
+    for (int v = 0; v < 4; v++) {
+      env->vertices[4 * k + v].color = white;
+    }
+    const int triangles[6] = {0, 1, 2, 0, 2, 3};
+    for (int v = 0; v < 6; v++) {
+      env->indices[6 * k + v] = 4 * k + triangles[v];
+    }
+  }
+  env->gridX = env->gridY = INT_MIN;  // pas encore placée
+  memset(env->tiles, NO_TILE, nb_cells);
+}
+
+/* positionner la grille en (gridX, gridY) et mettre à jour les cases dont la
+ * pièce ou le fond ont changé */
+static void update_geometry(Env *env, int gridX, int gridY) {
+  int width = env->g->width;
+  int nb_cells = env->g->height * width;
+  bool moved = gridX != env->gridX || gridY != env->gridY;
+  env->gridX = gridX;
+  env->gridY = gridY;
+
+  for (int k = 0; k < nb_cells; k++) {
+    SDL_Vertex *v = &env->vertices[4 * k];
+    if (moved) {
+      // coins dans l'ordre : haut-gauche, haut-droit, bas-droit, bas-gauche
+      float x0 = gridX + (k % width) * CELLULE_SIZE;
+      float y0 = gridY + (k / width) * CELLULE_SIZE;
+      v[0].position.x = v[3].position.x = x0;
+      v[1].position.x = v[2].position.x = x0 + CELLULE_SIZE;
+      v[0].position.y = v[1].position.y = y0;
+      v[2].position.y = v[3].position.y = y0 + CELLULE_SIZE;
+    }
+
+    Uint8 tile = tile_index(env->game_state, env->g->cases[k].shape,
+                            env->g->cases[k].orientation);
+    if (tile == env->tiles[k]) continue;
+    env->tiles[k] = tile;
+    SDL_Rect rect = tile_rect(tile);
+    float u0 = (float)rect.x / (ATLAS_COLS * CELLULE_SIZE);
+    float v0 = (float)rect.y / (ATLAS_ROWS * CELLULE_SIZE);
+    float u1 = (float)(rect.x + rect.w) / (ATLAS_COLS * CELLULE_SIZE);
+    float v1 = (float)(rect.y + rect.h) / (ATLAS_ROWS * CELLULE_SIZE);
+    v[0].tex_coord.x = v[3].tex_coord.x = u0;
+    v[1].tex_coord.x = v[2].tex_coord.x = u1;
+    v[0].tex_coord.y = v[1].tex_coord.y = v0;
+    v[2].tex_coord.y = v[3].tex_coord.y = v1;
+  }
+}
+
+/* **************************************************************** */
+
 Env *init(SDL_Window *win, SDL_Renderer *ren, int argc, char *argv[]) {
   Env *env = malloc(sizeof(struct Env_t));
 
@@ -118,6 +272,18 @@ Env *init(SDL_Window *win, SDL_Renderer *ren, int argc, char *argv[]) {
   env->game_state = 0;  // Jeu en cours
   env->messageShown = false;
 
+  // Préparer l'atlas et la géométrie de la grille
+  env->atlas = NULL;
+  init_geometry(env);
+  bake_atlas(ren, env);
+
+  env->dirty = true;  // première image
+  env->input_pending = false;
+  env->input_time = 0;
+  env->last_latency = env->max_latency = 0;
+  env->sum_latency = 0;
+  env->nb_latencies = 0;
+
   return env;
 }
 
@@ -142,10 +308,6 @@ void render(SDL_Window *win, SDL_Renderer *ren, Env *env) {
   int gridX = (windowWidth - gridWidth) / 2;
   int gridY = (windowHeight - gridHeight) / 2;
 
-  // tailles des cellules
-  int cellWidth = CELLULE_SIZE;
-  int cellHeight = CELLULE_SIZE;
-
   // Obtenir les dimensions du texte
   int textWidth, textHeight;
   SDL_QueryTexture(env->textTexture, NULL, NULL, &textWidth, &textHeight);
@@ -160,41 +322,12 @@ void render(SDL_Window *win, SDL_Renderer *ren, Env *env) {
   // Afficher le texte
   SDL_RenderCopy(ren, env->textTexture, NULL, &textRect);
 
-  // Dessiner la grille avec les cellules
-  SDL_SetRenderDrawColor(ren, 0, 255, 0, 255);
-  for (int i = 0; i < env->g->height; i++) {
-    for (int j = 0; j < env->g->width; j++) {
-      SDL_Rect rect = {gridX + j * cellWidth, gridY + i * cellHeight, cellWidth,
-                       cellHeight};
-      if (env->game_state == 1) {
-        SDL_SetRenderDrawColor(ren, 0, 255, 0, 255);  // Vert
-      } else {
-        SDL_SetRenderDrawColor(ren, 135, 206, 235,
-                               255);  // Bleu ciel (Sky Blue)
-      }
+  // Dessiner la grille en un seul appel, depuis l'atlas
+  int nb_cells = env->g->height * env->g->width;
+  update_geometry(env, gridX, gridY);
+  SDL_RenderGeometry(ren, env->atlas, env->vertices, 4 * nb_cells,
+                     env->indices, 6 * nb_cells);
 
-      SDL_RenderFillRect(ren, &rect);  // background blanc
-      SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
-      SDL_RenderDrawRect(ren, &rect);  // bordure noire
-
-      shape pieceShape = env->g->cases[i * env->g->width + j]
-                             .shape;  // recuperation de la shape de la cellule
-      int pieceOrientation = env->g->cases[i * env->g->width + j]
-                                 .orientation;  // recuperation de l'orientation
-
-      // si la piece existe on dessine
-      if (pieceShape != 0) {
-        SDL_Texture *pieceTexture = env->piece_textures[pieceShape - 1];
-        if (pieceTexture != NULL) {
-          SDL_Rect pieceRect = rect;  // La pièce doit occuper toute la cellule
-          double angle = (double)pieceOrientation * 90.0;
-          SDL_Point center = {cellWidth / 2, cellHeight / 2};
-          SDL_RenderCopyEx(ren, pieceTexture, NULL, &pieceRect, angle, &center,
-                           SDL_FLIP_NONE);
-        }
-      }
-    }
-  }
   // Positionner les boutons en ligne sous la grille
   int totalButtonWidth = (5 * BUTTON_SIZE) +
                          (4 * BUTTON_MARGIN);  // espace qu'occupent les boutons
@@ -222,7 +355,29 @@ void render(SDL_Window *win, SDL_Renderer *ren, Env *env) {
       SDL_RenderDrawRect(ren, &buttons[i]);
     }
   }
+}
+
+/* **************************************************************** */
 
+bool needs_render(Env *env) { return env->dirty; }
+
+/* **************************************************************** */
+
+void present(SDL_Window *win, SDL_Renderer *ren, Env *env) {
+  SDL_RenderPresent(ren);
+  env->dirty = false;
+
+  // latence entre l'entrée et l'image qui la montre
+  if (env->input_pending) {
+    env->last_latency = SDL_GetTicks() - env->input_time;
+    if (env->last_latency > env->max_latency)
+      env->max_latency = env->last_latency;
+    env->sum_latency += env->last_latency;
+    env->nb_latencies++;
+    env->input_pending = false;
+  }
+
+  // le message est affiché une fois la grille gagnante à l'écran
   if (env->game_state == 1 && !env->messageShown) {
     SDL_ShowSimpleMessageBox(
         SDL_MESSAGEBOX_INFORMATION,             // Type de la boîte de message
@@ -234,8 +389,21 @@ void render(SDL_Window *win, SDL_Renderer *ren, Env *env) {
     // Mettre à jour la variable pour éviter de montrer le message à nouveau
     env->messageShown = true;
   }
+}
 
-  SDL_RenderPresent(ren);
+/* **************************************************************** */
+
+Uint32 input_latency(Env *env) { return env->last_latency; }
+
+/* **************************************************************** */
+
+/* l'état a changé à cause de l'événement e : une image doit être affichée */
+static void changed(Env *env, SDL_Event *e) {
+  env->dirty = true;
+  if (!env->input_pending) {
+    env->input_pending = true;
+    env->input_time = e->common.timestamp;
+  }
 }
 
 /* **************************************************************** */
@@ -245,6 +413,20 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
     return true;
   }
 
+  // la fenêtre a été redimensionnée ou découverte : tout redessiner
+  if (e->type == SDL_WINDOWEVENT) {
+    env->dirty = true;
+    return false;
+  }
+
+  // le contenu des textures cibles a été perdu : redessiner l'atlas
+  if (e->type == SDL_RENDER_TARGETS_RESET ||
+      e->type == SDL_RENDER_DEVICE_RESET) {
+    bake_atlas(ren, env);
+    env->dirty = true;
+    return false;
+  }
+
   // Récupération de la taille de la fenêtre
   int windowWidth, windowHeight;
   SDL_GetWindowSize(win, &windowWidth, &windowHeight);
@@ -268,6 +450,7 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
       if (e->button.button == SDL_BUTTON_LEFT) {
         if (env->game_state == 0) {
           game_play_move(env->g, i, j, -1);
+          changed(env, e);
           if (game_won(env->g))
           {
             env->game_state = 1;
@@ -277,6 +460,7 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
       } else if (e->button.button == SDL_BUTTON_RIGHT) {
         if (env->game_state == 0) {
           game_play_move(env->g, i, j, 1);
+          changed(env, e);
           if (game_won(env->g))
           {
             env->game_state = 1;
@@ -307,6 +491,7 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
             if (env->game_state == 0) {
               printf("Annuler le coup\n");
               game_undo(env->g);
+              changed(env, e);
             }
 
             break;
@@ -314,6 +499,7 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
             if (env->game_state == 0) {
               printf("Refaire le coup\n");
               game_redo(env->g);
+              changed(env, e);
             }
 
             break;
@@ -321,12 +507,14 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
             printf("Réinitialiser la grille\n");
             game_shuffle_orientation(env->g);
             env->game_state = 0;
+            changed(env, e);
             break;
           case 3:
             printf("Solution du jeu\n");
             if (game_solve(env->g)) {
               env->game_state = 1;
             }
+            changed(env, e);
             break;
           case 4:
             printf("Quitter le jeu\n");
@@ -345,6 +533,7 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
         if (env->game_state == 0) {
           printf("Annuler le coup\n");
           game_undo(env->g);
+          changed(env, e);
         }
 
         break;
@@ -353,12 +542,14 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
         if (env->game_state == 0) {
           printf("Refaire le coup\n");
           game_redo(env->g);
+          changed(env, e);
         }
         break;
 
       case SDLK_r:
         printf("Réinitialiser la grille\n");
         game_shuffle_orientation(env->g);
+        changed(env, e);
         break;
 
       case SDLK_s:
@@ -366,6 +557,7 @@ bool process(SDL_Window *win, SDL_Renderer *ren, Env *env, SDL_Event *e) {
         if (game_solve(env->g)) {
           env->game_state = 1;
         }
+        changed(env, e);
         break;
 
       case SDLK_q:
@@ -412,6 +604,16 @@ void clean(SDL_Window *win, SDL_Renderer *ren, Env *env) {
   SDL_DestroyTexture(env->textTexture);
   TTF_CloseFont(env->font);
 
+  SDL_DestroyTexture(env->atlas);
+  free(env->vertices);
+  free(env->indices);
+  free(env->tiles);
+
+  if (env->nb_latencies > 0)
+    PRINT("Latence entrée-affichage : moyenne %u ms, max %u ms (%u images)\n",
+          (unsigned)(env->sum_latency / env->nb_latencies),
+          (unsigned)env->max_latency, (unsigned)env->nb_latencies);
+
   free(env);
 }
 
@@ -24,7 +24,6 @@ typedef struct Env_t Env;
 #define APP_NAME "SDL2 Demo"
 #define SCREEN_WIDTH 600
 #define SCREEN_HEIGHT 600
-#define DELAY 100
 #define CELLULE_SIZE 60
 #define BUTTON_MARGIN 20
 #define BUTTON_HEIGHT 50
@@ -38,6 +37,15 @@ void render(SDL_Window* win, SDL_Renderer* ren, Env * env);
 void clean(SDL_Window* win, SDL_Renderer* ren, Env * env);
 bool process(SDL_Window* win, SDL_Renderer* ren, Env * env, SDL_Event * e);
 
+/* the frame must be rendered again: the state has changed since the last
+ * present() (process() sets this flag) */
+bool needs_render(Env * env);
+/* present the rendered frame and measure the input-to-photon latency */
+void present(SDL_Window* win, SDL_Renderer* ren, Env * env);
+/* latency (ms) between the last input that changed the state and the present
+ * of the frame showing it, 0 before the first one */
+Uint32 input_latency(Env * env);
+
 /* **************************************************************** */
 
 #endif
\ No newline at end of file
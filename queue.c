@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* *********************************************************** */
 
@@ -18,22 +19,136 @@ struct element_s {
 
 typedef struct element_s element_t;
 
+/* Elements are allocated by blocks of growing size (up to CHUNK_MAX). Popped
+ * elements go to the spare list and are reused by the next pushes, so that
+ * push/pop do not allocate once the queue has reached its maximal length. */
+struct queue_chunk_s {
+  struct queue_chunk_s *next;
+  unsigned int length;
+  element_t elements[];
+};
+
+#define CHUNK_MIN 8
+#define CHUNK_MAX 1024
+#define RING_MIN 16
+
+/* *********************************************************** */
+
+static void *queue_alloc(queue *q, size_t size) {
+  void *p = q->alloc ? q->alloc(q->context, size) : malloc(size);
+  assert(p);
+  return p;
+}
+
+/* *********************************************************** */
+
+static void queue_release(queue *q, void *p, size_t size) {
+  if (q->release)
+    q->release(q->context, p, size);
+  else
+    free(p);
+}
+
+/* *********************************************************** */
+
+static element_t *element_new(queue *q) {
+  if (!q->spare) {
+    unsigned int length = q->chunk_length < CHUNK_MIN ? CHUNK_MIN : q->chunk_length;
+    if (q->chunks && length < CHUNK_MAX) length *= 2;
+    struct queue_chunk_s *c = queue_alloc(q, sizeof(struct queue_chunk_s) + length * sizeof(element_t));
+    c->next = q->chunks;
+    c->length = length;
+    q->chunks = c;
+    q->chunk_length = length;
+    for (unsigned int k = 0; k < length; k++) {
+      c->elements[k].next = q->spare;
+      q->spare = &c->elements[k];
+    }
+  }
+  element_t *e = q->spare;
+  q->spare = e->next;
+  return e;
+}
+
+/* *********************************************************** */
+
+static void element_free(queue *q, element_t *e) {
+  e->next = q->spare;
+  q->spare = e;
+}
+
+/* *********************************************************** */
+
+/* index of the k-th element of a contiguous queue */
+static unsigned int ring_index(const queue *q, unsigned int k) { return (q->first + k) & (q->capacity - 1); }
+
+/* *********************************************************** */
+
+static void ring_grow(queue *q) {
+  unsigned int capacity = q->capacity ? 2 * q->capacity : RING_MIN;
+  assert(capacity > q->capacity);
+  void **ring = queue_alloc(q, capacity * sizeof(void *));
+  for (unsigned int k = 0; k < q->length; k++) ring[k] = q->ring[ring_index(q, k)];
+  if (q->ring) queue_release(q, q->ring, q->capacity * sizeof(void *));
+  q->ring = ring;
+  q->capacity = capacity;
+  q->first = 0;
+}
+
 /* *********************************************************** */
 
 queue *queue_new() {
   queue *q = malloc(sizeof(queue));
   assert(q);
-  q->length = 0;
-  q->tail = q->head = NULL;
+  queue_init(q);
   return q;
 }
 
 /* *********************************************************** */
 
+queue *queue_new_contiguous() {
+  queue *q = queue_new();
+  queue_set_contiguous(q);
+  return q;
+}
+
+/* *********************************************************** */
+
+void queue_init(queue *q) {
+  queue_init_with_allocator(q, NULL, NULL, NULL);
+}
+
+/* *********************************************************** */
+
+void queue_init_with_allocator(queue *q, void *(*alloc)(void *context, size_t size),
+                               void (*release)(void *context, void *ptr, size_t size), void *context) {
+  assert(q);
+  memset(q, 0, sizeof(queue));
+  q->alloc = alloc;
+  q->release = release;
+  q->context = context;
+}
+
+/* *********************************************************** */
+
+void queue_set_contiguous(queue *q) {
+  assert(q);
+  assert(q->length == 0);
+  q->contiguous = true;
+}
+
+/* *********************************************************** */
+
 void queue_push_head(queue *q, void *data) {
   assert(q);
-  element_t *e = malloc(sizeof(element_t));
-  assert(e);
+  if (q->contiguous) {
+    if (q->length == q->capacity) ring_grow(q);
+    q->first = ring_index(q, q->capacity - 1);
+    q->ring[q->first] = data;
+    q->length++;
+    return;
+  }
+  element_t *e = element_new(q);
   e->data = data;
   e->prev = NULL;
   e->next = q->head;
@@ -47,8 +162,13 @@ void queue_push_head(queue *q, void *data) {
 
 void queue_push_tail(queue *q, void *data) {
   assert(q);
-  element_t *e = malloc(sizeof(element_t));
-  assert(e);
+  if (q->contiguous) {
+    if (q->length == q->capacity) ring_grow(q);
+    q->ring[ring_index(q, q->length)] = data;
+    q->length++;
+    return;
+  }
+  element_t *e = element_new(q);
   e->data = data;
   e->prev = q->tail;
   e->next = NULL;
@@ -63,11 +183,18 @@ void queue_push_tail(queue *q, void *data) {
 void *queue_pop_head(queue *q) {
   assert(q);
   assert(q->length > 0);
+  if (q->contiguous) {
+    if (q->length == 0) return NULL;
+    void *data = q->ring[q->first];
+    q->first = ring_index(q, 1);
+    q->length--;
+    return data;
+  }
   if (!q->head) return NULL;
   void *data = q->head->data;
   element_t *next = q->head->next;
   if (next) next->prev = NULL;
-  free(q->head);
+  element_free(q, q->head);
   q->head = next;
   q->length--;
   if (!q->head) q->tail = NULL;  // empty list
@@ -79,11 +206,16 @@ void *queue_pop_head(queue *q) {
 void *queue_pop_tail(queue *q) {
   assert(q);
   assert(q->length > 0);
+  if (q->contiguous) {
+    if (q->length == 0) return NULL;
+    q->length--;
+    return q->ring[ring_index(q, q->length)];
+  }
   if (!q->tail) return NULL;
   void *data = q->tail->data;
   element_t *prev = q->tail->prev;
   if (prev) prev->next = NULL;
-  free(q->tail);
+  element_free(q, q->tail);
   q->tail = prev;
   q->length--;
   if (!q->tail) q->head = NULL;  // empty list
@@ -108,6 +240,10 @@ bool queue_is_empty(const queue *q) {
 
 void *queue_peek_head(queue *q) {
   assert(q);
+  if (q->contiguous) {
+    assert(q->length > 0);
+    return q->ring[q->first];
+  }
   assert(q->head);
   return q->head->data;
 }
@@ -116,6 +252,10 @@ void *queue_peek_head(queue *q) {
 
 void *queue_peek_tail(queue *q) {
   assert(q);
+  if (q->contiguous) {
+    assert(q->length > 0);
+    return q->ring[ring_index(q, q->length - 1)];
+  }
   assert(q->tail);
   return q->tail->data;
 }
@@ -123,36 +263,52 @@ void *queue_peek_tail(queue *q) {
 /* *********************************************************** */
 
 void queue_clear(queue *q) {
+  queue_clear_full(q, NULL);
+}
+
+/* *********************************************************** */
+
+void queue_clear_full(queue *q, void (*destroy)(void *)) {
   assert(q);
-  element_t *e = q->head;
-  while (e) {
-    element_t *tmp = e;
-    e = e->next;
-    free(tmp);
+  if (q->contiguous) {
+    if (destroy)
+      for (unsigned int k = 0; k < q->length; k++) destroy(q->ring[ring_index(q, k)]);
+  } else if (q->head) {
+    element_t *e = q->head;
+    while (e) {
+      if (destroy) destroy(e->data);
+      e = e->next;
+    }
+    // the whole list goes to the spare list
+    q->tail->next = q->spare;
+    q->spare = q->head;
   }
   q->head = q->tail = NULL;
   q->length = 0;
+  q->first = 0;
 }
 
 /* *********************************************************** */
 
-void queue_clear_full(queue *q, void (*destroy)(void *)) {
+void queue_finalize(queue *q) {
   assert(q);
-  element_t *e = q->head;
-  while (e) {
-    element_t *tmp = e;
-    if (destroy) destroy(e->data);
-    e = e->next;
-    free(tmp);
+  struct queue_chunk_s *c = q->chunks;
+  while (c) {
+    struct queue_chunk_s *next = c->next;
+    queue_release(q, c, sizeof(struct queue_chunk_s) + c->length * sizeof(element_t));
+    c = next;
   }
-  q->head = q->tail = NULL;
-  q->length = 0;
+  if (q->ring) queue_release(q, q->ring, q->capacity * sizeof(void *));
+  q->chunks = NULL;
+  q->spare = q->head = q->tail = NULL;
+  q->ring = NULL;
+  q->capacity = q->length = q->first = 0;
 }
 
 /* *********************************************************** */
 
 void queue_free(queue *q) {
-  queue_clear(q);
+  queue_finalize(q);
   free(q);
 }
 
@@ -160,7 +316,7 @@ void queue_free(queue *q) {
 
 void queue_free_full(queue *q, void (*destroy)(void *)) {
   queue_clear_full(q, destroy);
-  free(q);
+  queue_free(q);
 }
 
-/* *********************************************************** */
\ No newline at end of file
+/* *********************************************************** */
@@ -11,6 +11,7 @@
 #define QUEUE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * @defgroup Queue Queue
@@ -23,6 +24,16 @@ struct queue_s
   struct element_s *head;
   struct element_s *tail;
   unsigned int length;
+  void *(*alloc)(void *context, size_t size);
+  void (*release)(void *context, void *ptr, size_t size);
+  void *context;
+  struct element_s *spare;    /* unused elements, reused by the next pushes */
+  struct queue_chunk_s *chunks;     /* blocks of elements allocated so far */
+  unsigned int chunk_length;  /* number of elements in the last block */
+  void **ring;                /* contiguous mode: circular array of data, or NULL */
+  unsigned int capacity;      /* contiguous mode: size of ring (a power of 2) */
+  unsigned int first;         /* contiguous mode: index of the head in ring */
+  bool contiguous;
 };
 
 /**
@@ -36,6 +47,43 @@ typedef struct queue_s queue;
  */
 queue *queue_new();
 
+/**
+ * @brief Creates a new queue in contiguous mode.
+ * @details The elements are stored in a circular array that doubles when it is full, instead of a linked list.
+ * @return A pointer to the newly created queue.
+ */
+queue *queue_new_contiguous();
+
+/**
+ * @brief Initializes a queue that was allocated by the caller (e.g. embedded in another structure).
+ * @param q Pointer to the queue.
+ * @note Such a queue must be released with queue_finalize() instead of queue_free().
+ */
+void queue_init(queue *q);
+
+/**
+ * @brief Initializes a queue whose elements are allocated with the given functions instead of malloc() and free().
+ * @param q Pointer to the queue.
+ * @param alloc Function returning a block of the given size (or NULL), called with @p context.
+ * @param release Function releasing a block returned by @p alloc, called with @p context and the block size.
+ * @param context Argument passed to @p alloc and @p release.
+ * @note Same as queue_init() otherwise.
+ */
+void queue_init_with_allocator(queue *q, void *(*alloc)(void *context, size_t size),
+                               void (*release)(void *context, void *ptr, size_t size), void *context);
+
+/**
+ * @brief Switches an empty queue to contiguous mode (see queue_new_contiguous()).
+ * @param q Pointer to the queue.
+ */
+void queue_set_contiguous(queue *q);
+
+/**
+ * @brief Frees all the memory used by a queue initialized with queue_init(), but not the queue itself.
+ * @param q Pointer to the queue.
+ */
+void queue_finalize(queue *q);
+
 /**
  * @brief Adds a new element at the head of the queue.
  * @param q Pointer to the queue.
@@ -98,6 +146,7 @@ void *queue_peek_tail(queue *q);
  * @brief Removes all the elements in the queue.
  * @param q Pointer to the queue.
  * @note If queue elements contain dynamically-allocated memory, they should be freed first.
+ * @note The memory of the elements is kept to be reused by the next pushes, until queue_free() or queue_finalize().
  */
 void queue_clear(queue *q);
 
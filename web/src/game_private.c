@@ -19,13 +19,35 @@
 /*                             STACK ROUTINES                                 */
 /* ************************************************************************** */
 
+/* Popped moves are kept in a free list and reused by the next pushes, so that
+ * playing does not allocate once the history has reached its maximal length. */
+typedef union move_cell_u {
+  move m;
+  union move_cell_u* next;
+} move_cell;
+
+static move_cell* free_moves = NULL;
+
+static void _move_release(void* pm)
+{
+  move_cell* c = pm;
+  c->next = free_moves;
+  free_moves = c;
+}
+
+/* ************************************************************************** */
+
 void _stack_push_move(queue* q, move m)
 {
   assert(q);
-  move* pm = malloc(sizeof(move));
-  assert(pm);
-  *pm = m;
-  queue_push_head(q, pm);
+  move_cell* c = free_moves;
+  if (c)
+    free_moves = c->next;
+  else
+    c = malloc(sizeof(move_cell));
+  assert(c);
+  c->m = m;
+  queue_push_head(q, c);
 }
 
 /* ************************************************************************** */
@@ -33,10 +55,10 @@ void _stack_push_move(queue* q, move m)
 move _stack_pop_move(queue* q)
 {
   assert(q);
-  move* pm = queue_pop_head(q);
-  assert(pm);
-  move m = *pm;
-  free(pm);
+  move_cell* c = queue_pop_head(q);
+  assert(c);
+  move m = c->m;
+  _move_release(c);
   return m;
 }
 
@@ -53,7 +75,7 @@ bool _stack_is_empty(queue* q)
 void _stack_clear(queue* q)
 {
   assert(q);
-  queue_clear_full(q, free);
+  queue_clear_full(q, _move_release);
   assert(queue_is_empty(q));
 }
 
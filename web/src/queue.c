@@ -10,6 +10,7 @@ struct queue_s {
   struct element_s* head;
   struct element_s* tail;
   unsigned int length;
+  struct element_s* spare;  // popped elements, reused by the next pushes
 };
 
 /* *********************************************************** */
@@ -27,12 +28,33 @@ typedef struct element_s element_t;
 
 /* *********************************************************** */
 
+static element_t* element_new(queue* q)
+{
+  element_t* e = q->spare;
+  if (e)
+    q->spare = e->next;
+  else
+    e = malloc(sizeof(element_t));
+  assert(e);
+  return e;
+}
+
+/* *********************************************************** */
+
+static void element_free(queue* q, element_t* e)
+{
+  e->next = q->spare;
+  q->spare = e;
+}
+
+/* *********************************************************** */
+
 queue* queue_new()
 {
   queue* q = malloc(sizeof(queue));
   assert(q);
   q->length = 0;
-  q->tail = q->head = NULL;
+  q->tail = q->head = q->spare = NULL;
   return q;
 }
 
@@ -41,8 +63,7 @@ queue* queue_new()
 void queue_push_head(queue* q, void* data)
 {
   assert(q);
-  element_t* e = malloc(sizeof(element_t));
-  assert(e);
+  element_t* e = element_new(q);
   e->data = data;
   e->prev = NULL;
   e->next = q->head;
@@ -57,8 +78,7 @@ void queue_push_head(queue* q, void* data)
 void queue_push_tail(queue* q, void* data)
 {
   assert(q);
-  element_t* e = malloc(sizeof(element_t));
-  assert(e);
+  element_t* e = element_new(q);
   e->data = data;
   e->prev = q->tail;
   e->next = NULL;
@@ -78,7 +98,7 @@ void* queue_pop_head(queue* q)
   void* data = q->head->data;
   element_t* next = q->head->next;
   if (next) next->prev = NULL;
-  free(q->head);
+  element_free(q, q->head);
   q->head = next;
   q->length--;
   if (!q->head) q->tail = NULL;  // empty list
@@ -95,7 +115,7 @@ void* queue_pop_tail(queue* q)
   void* data = q->tail->data;
   element_t* prev = q->tail->prev;
   if (prev) prev->next = NULL;
-  free(q->tail);
+  element_free(q, q->tail);
   q->tail = prev;
   q->length--;
   if (!q->tail) q->head = NULL;  // empty list
@@ -145,7 +165,7 @@ void queue_clear(queue* q)
   while (e) {
     element_t* tmp = e;
     e = e->next;
-    free(tmp);
+    element_free(q, tmp);
   }
   q->head = q->tail = NULL;
   q->length = 0;
@@ -161,7 +181,7 @@ void queue_clear_full(queue* q, void (*destroy)(void*))
     element_t* tmp = e;
     if (destroy) destroy(e->data);
     e = e->next;
-    free(tmp);
+    element_free(q, tmp);
   }
   q->head = q->tail = NULL;
   q->length = 0;
@@ -169,9 +189,23 @@ void queue_clear_full(queue* q, void (*destroy)(void*))
 
 /* *********************************************************** */
 
+static void queue_free_spare(queue* q)
+{
+  element_t* e = q->spare;
+  while (e) {
+    element_t* tmp = e;
+    e = e->next;
+    free(tmp);
+  }
+  q->spare = NULL;
+}
+
+/* *********************************************************** */
+
 void queue_free(queue* q)
 {
   queue_clear(q);
+  queue_free_spare(q);
   free(q);
 }
 
@@ -180,6 +214,7 @@ void queue_free(queue* q)
 void queue_free_full(queue* q, void (*destroy)(void*))
 {
   queue_clear_full(q, destroy);
+  queue_free_spare(q);
   free(q);
 }
 